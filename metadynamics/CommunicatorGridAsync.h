@@ -0,0 +1,258 @@
+#ifndef __COMMUNICATOR_GRID_ASYNC_H__
+#define __COMMUNICATOR_GRID_ASYNC_H__
+
+/*! \file CommunicatorGridAsync.h
+    \brief Declares a ghost cell communicator for decomposed meshes with non-blocking exchange
+ */
+
+#ifdef ENABLE_MPI
+
+#include <hoomd/SystemDefinition.h>
+#include <hoomd/GlobalArray.h>
+
+#include "MeshPrecision.h"
+
+#include <mpi.h>
+#include <vector>
+#include <stdexcept>
+
+//! Accumulate a received mesh value
+template<typename T>
+inline void addGridValue(T& a, const T& b)
+    {
+    a += b;
+    }
+
+//! Accumulate a received complex mesh value
+template<>
+inline void addGridValue<mesh_cpx>(mesh_cpx& a, const mesh_cpx& b)
+    {
+    a.r += b.r;
+    a.i += b.i;
+    }
+
+/*! Ghost cell communication of a mesh decomposed with the particle domains
+
+    The semantics are those of CommunicatorGrid: with add_outer_layer_to_inner, the
+    ghost layer of every rank is added to the inner cells of the ranks it overlaps,
+    otherwise the ghost layer is filled with the inner cells of those ranks.
+
+    Every part of the ghost layer is exchanged directly with the rank it overlaps,
+    including the ranks across edges and corners, so a single round of messages
+    suffices and the exchange can be split into begin() and finish(). Between the
+    two, the caller may keep working on the mesh, as long as it does not
+    - write contributions to the ghost layer that should be communicated
+      (add_outer_layer_to_inner), or
+    - read the ghost layer (otherwise).
+ */
+template<typename T>
+class CommunicatorGridAsync
+    {
+    public:
+        /*! Constructor
+            \param sysdef The system definition
+            \param dim Number of inner mesh points per rank
+            \param embed Dimensions of the local mesh including the ghost layer
+            \param offset Width of the ghost layer on every side
+            \param add_outer_layer_to_inner True if the ghost layer is added to the neighbors' inner cells
+         */
+        CommunicatorGridAsync(std::shared_ptr<SystemDefinition> sysdef, uint3 dim, uint3 embed, uint3 offset,
+            bool add_outer_layer_to_inner)
+            : m_exec_conf(sysdef->getParticleData()->getExecConf()),
+              m_add_outer(add_outer_layer_to_inner),
+              m_pending(false)
+            {
+            initGridComm(sysdef->getParticleData()->getDomainDecomposition(), dim, embed, offset);
+            }
+
+        virtual ~CommunicatorGridAsync()
+            {
+            // do not leave messages in flight referring to our buffers
+            if (m_pending && m_reqs.size())
+                MPI_Waitall(m_reqs.size(), &m_reqs.front(), MPI_STATUSES_IGNORE);
+            }
+
+        /*! Start the exchange
+            \param grid The local mesh (host memory)
+
+            The outgoing cells are copied when the exchange is started.
+         */
+        void begin(const T *grid)
+            {
+            if (m_pending)
+                {
+                m_exec_conf->msg->error() << "cv.mesh: Ghost cell exchange is already in progress." << std::endl;
+                throw std::runtime_error("Error communicating ghost cells");
+                }
+
+            for (unsigned int i = 0; i < m_send_idx.size(); ++i)
+                m_send_buf[i] = grid[m_send_idx[i]];
+
+            MPI_Comm comm = m_exec_conf->getMPICommunicator();
+            unsigned int n_neighbors = m_neighbor_rank.size();
+            for (unsigned int nb = 0; nb < n_neighbors; ++nb)
+                {
+                unsigned int n = m_recv_begin[nb+1] - m_recv_begin[nb];
+                MPI_Irecv(&m_recv_buf[m_recv_begin[nb]], n*sizeof(T), MPI_BYTE, m_neighbor_rank[nb],
+                    m_recv_tag[nb], comm, &m_reqs[nb]);
+                }
+            for (unsigned int nb = 0; nb < n_neighbors; ++nb)
+                {
+                unsigned int n = m_send_begin[nb+1] - m_send_begin[nb];
+                MPI_Isend(&m_send_buf[m_send_begin[nb]], n*sizeof(T), MPI_BYTE, m_neighbor_rank[nb],
+                    m_send_tag[nb], comm, &m_reqs[n_neighbors+nb]);
+                }
+
+            m_pending = true;
+            }
+
+        /*! Complete the exchange
+            \param grid The local mesh (host memory)
+         */
+        void finish(T *grid)
+            {
+            if (! m_pending)
+                return;
+
+            if (m_reqs.size())
+                MPI_Waitall(m_reqs.size(), &m_reqs.front(), MPI_STATUSES_IGNORE);
+
+            if (m_add_outer)
+                {
+                for (unsigned int i = 0; i < m_recv_idx.size(); ++i)
+                    addGridValue(grid[m_recv_idx[i]], m_recv_buf[i]);
+                }
+            else
+                {
+                for (unsigned int i = 0; i < m_recv_idx.size(); ++i)
+                    grid[m_recv_idx[i]] = m_recv_buf[i];
+                }
+
+            m_pending = false;
+            }
+
+        //! Returns true if an exchange has been started and not yet completed
+        bool isPending() const
+            {
+            return m_pending;
+            }
+
+        //! Exchange the ghost cells of a mesh (blocking)
+        void communicate(const GlobalArray<T>& grid)
+            {
+            ArrayHandle<T> h_grid(grid, access_location::host, access_mode::readwrite);
+            begin(h_grid.data);
+            finish(h_grid.data);
+            }
+
+    private:
+        std::shared_ptr<const ExecutionConfiguration> m_exec_conf; //!< The execution configuration
+        bool m_add_outer;                          //!< True if the ghost layer is added to the inner cells
+        bool m_pending;                            //!< True if an exchange is in progress
+
+        std::vector<unsigned int> m_neighbor_rank; //!< Rank of every neighbor we exchange with
+        std::vector<int> m_send_tag;               //!< Tag of the message to every neighbor
+        std::vector<int> m_recv_tag;               //!< Tag of the message from every neighbor
+        std::vector<unsigned int> m_send_begin;    //!< Start of the outgoing cells of every neighbor
+        std::vector<unsigned int> m_recv_begin;    //!< Start of the incoming cells of every neighbor
+        std::vector<unsigned int> m_send_idx;      //!< Local mesh index of every outgoing cell
+        std::vector<unsigned int> m_recv_idx;      //!< Local mesh index of every incoming cell
+        std::vector<T> m_send_buf;                 //!< Outgoing cells
+        std::vector<T> m_recv_buf;                 //!< Incoming cells
+        std::vector<MPI_Request> m_reqs;           //!< Requests of the exchange in progress
+
+        /*! Returns the range of cells along one axis next to a neighbor
+            \param c Direction of the neighbor (-1, 0 or 1)
+            \param n Number of inner cells
+            \param g Width of the ghost layer
+            \param ghost If true, the range within the ghost layer, otherwise the inner cells it overlaps
+         */
+        static uint2 getRange(int c, unsigned int n, unsigned int g, bool ghost)
+            {
+            if (c < 0)
+                return ghost ? make_uint2(0, g) : make_uint2(g, 2*g);
+            else if (c > 0)
+                return ghost ? make_uint2(g+n, 2*g+n) : make_uint2(n, n+g);
+            return make_uint2(g, g+n);
+            }
+
+        //! Append the local indices of a block of the mesh
+        static void appendBlock(std::vector<unsigned int>& idx, const uint2 *range, uint3 embed)
+            {
+            for (unsigned int k = range[2].x; k < range[2].y; ++k)
+                for (unsigned int j = range[1].x; j < range[1].y; ++j)
+                    for (unsigned int i = range[0].x; i < range[0].y; ++i)
+                        idx.push_back((k*embed.y + j)*embed.x + i);
+            }
+
+        //! Set up the neighbors and the cells exchanged with them
+        void initGridComm(std::shared_ptr<DomainDecomposition> decomposition, uint3 dim, uint3 embed, uint3 offset)
+            {
+            Index3D di = decomposition->getDomainIndexer();
+            uint3 pos = decomposition->getGridPos();
+            ArrayHandle<unsigned int> h_cart_ranks(decomposition->getCartRanks(), access_location::host, access_mode::read);
+
+            unsigned int n[3] = {dim.x, dim.y, dim.z};
+            unsigned int g[3] = {offset.x, offset.y, offset.z};
+            unsigned int p[3] = {di.getW(), di.getH(), di.getD()};
+            unsigned int q[3] = {pos.x, pos.y, pos.z};
+
+            for (unsigned int axis = 0; axis < 3; ++axis)
+                if (g[axis] > n[axis])
+                    {
+                    m_exec_conf->msg->error() << "cv.mesh: Ghost layer (" << g[axis] << " cells) wider than the local mesh ("
+                        << n[axis] << " cells)." << std::endl << "Use fewer ranks or a finer mesh." << std::endl;
+                    throw std::runtime_error("Error setting up ghost cell communication");
+                    }
+
+            m_send_begin.push_back(0);
+            m_recv_begin.push_back(0);
+
+            for (int dz = -1; dz <= 1; ++dz)
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx)
+                        {
+                        int d[3] = {dx, dy, dz};
+
+                        // only exchange across the decomposed directions
+                        bool exchange = dx || dy || dz;
+                        for (unsigned int axis = 0; axis < 3; ++axis)
+                            if (d[axis] && !g[axis])
+                                exchange = false;
+                        if (! exchange)
+                            continue;
+
+                        unsigned int nb_pos[3];
+                        for (unsigned int axis = 0; axis < 3; ++axis)
+                            nb_pos[axis] = (q[axis] + p[axis] + d[axis]) % p[axis];
+                        m_neighbor_rank.push_back(h_cart_ranks.data[di(nb_pos[0], nb_pos[1], nb_pos[2])]);
+
+                        // the message to a neighbor carries our direction as seen from us,
+                        // the message from it the opposite direction
+                        int dir = (dx+1) + 3*((dy+1) + 3*(dz+1));
+                        m_send_tag.push_back(dir);
+                        m_recv_tag.push_back(26-dir);
+
+                        // forward: our ghost layer goes to the neighbor's inner cells,
+                        // reverse: our inner cells go to the neighbor's ghost layer
+                        uint2 send_range[3], recv_range[3];
+                        for (unsigned int axis = 0; axis < 3; ++axis)
+                            {
+                            send_range[axis] = getRange(d[axis], n[axis], g[axis], m_add_outer);
+                            recv_range[axis] = getRange(d[axis], n[axis], g[axis], !m_add_outer);
+                            }
+
+                        appendBlock(m_send_idx, send_range, embed);
+                        appendBlock(m_recv_idx, recv_range, embed);
+                        m_send_begin.push_back(m_send_idx.size());
+                        m_recv_begin.push_back(m_recv_idx.size());
+                        }
+
+            m_send_buf.resize(m_send_idx.size());
+            m_recv_buf.resize(m_recv_idx.size());
+            m_reqs.resize(2*m_neighbor_rank.size());
+            }
+    };
+
+#endif // ENABLE_MPI
+#endif // __COMMUNICATOR_GRID_ASYNC_H__
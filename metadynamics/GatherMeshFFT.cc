@@ -0,0 +1,165 @@
+/*! \file GatherMeshFFT.cc
+    \brief Implements the GatherMeshFFT class
+ */
+
+#ifdef ENABLE_MPI
+
+#include "GatherMeshFFT.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/*! \param sysdef The system definition
+    \param dim Number of inner mesh points per rank
+    \param embed Dimensions of the local real space mesh including the ghost layer
+    \param backend Name of the local FFT backend on the root rank
+    \param num_threads Number of threads for the local FFT
+    \param wisdom_file File for FFTW wisdom (may be empty)
+ */
+GatherMeshFFT::GatherMeshFFT(std::shared_ptr<SystemDefinition> sysdef, uint3 dim, uint3 embed,
+    const std::string& backend, unsigned int num_threads, const std::string& wisdom_file)
+    : m_exec_conf(sysdef->getParticleData()->getExecConf()), m_dim(dim), m_embed(embed)
+    {
+    std::shared_ptr<DomainDecomposition> decomposition = sysdef->getParticleData()->getDomainDecomposition();
+    Index3D di = decomposition->getDomainIndexer();
+
+    m_proc_dim = make_uint3(di.getW(), di.getH(), di.getD());
+    m_global_dim = make_uint3(dim.x*m_proc_dim.x, dim.y*m_proc_dim.y, dim.z*m_proc_dim.z);
+    m_n_local = dim.x*dim.y*dim.z;
+    m_is_root = m_exec_conf->getRank() == 0;
+
+    m_local_buf.resize(m_n_local);
+
+    if (! m_is_root)
+        return;
+
+    // the grid positions of the ranks, which may be ordered differently than the grid
+    unsigned int n_ranks = m_exec_conf->getNRanks();
+    m_rank_pos.resize(n_ranks);
+    ArrayHandle<unsigned int> h_cart_ranks(decomposition->getCartRanks(), access_location::host, access_mode::read);
+    for (unsigned int idx = 0; idx < di.getNumElements(); ++idx)
+        m_rank_pos[h_cart_ranks.data[idx]] = di.getTriple(idx);
+
+    m_fft = MeshFFT::create(backend, m_global_dim, num_threads, wisdom_file, false);
+    if (! m_fft)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: FFT backend " << backend << " is not available." << std::endl;
+        throw std::runtime_error("Error initializing GatherMeshFFT");
+        }
+
+    unsigned int n_global = m_global_dim.x*m_global_dim.y*m_global_dim.z;
+    m_rank_buf.resize(n_ranks*m_n_local);
+    m_global_buf.resize(n_global);
+    m_fourier_buf.resize(n_global);
+    }
+
+/*! \param to_global True if the parts of the ranks are copied into the global mesh, false for the reverse
+ */
+void GatherMeshFFT::copyBlocks(bool to_global)
+    {
+    for (unsigned int rank = 0; rank < m_rank_pos.size(); ++rank)
+        {
+        uint3 pos = m_rank_pos[rank];
+        mesh_cpx *part = &m_rank_buf[rank*m_n_local];
+
+        for (unsigned int k = 0; k < m_dim.z; ++k)
+            for (unsigned int j = 0; j < m_dim.y; ++j)
+                {
+                unsigned int global_row = ((pos.z*m_dim.z + k)*m_global_dim.y + pos.y*m_dim.y + j)*m_global_dim.x
+                    + pos.x*m_dim.x;
+                mesh_cpx *local = part + (k*m_dim.y + j)*m_dim.x;
+                mesh_cpx *global = &m_global_buf[global_row];
+
+                if (to_global)
+                    std::copy(local, local + m_dim.x, global);
+                else
+                    std::copy(global, global + m_dim.x, local);
+                }
+        }
+    }
+
+/*! \param to_global True if the parts of the ranks are copied into the global mesh, false for the reverse
+ */
+void GatherMeshFFT::copyCyclic(bool to_global)
+    {
+    for (unsigned int rank = 0; rank < m_rank_pos.size(); ++rank)
+        {
+        uint3 pos = m_rank_pos[rank];
+        mesh_cpx *part = &m_rank_buf[rank*m_n_local];
+
+        for (unsigned int k = 0; k < m_dim.z; ++k)
+            for (unsigned int j = 0; j < m_dim.y; ++j)
+                {
+                unsigned int global_row = ((k*m_proc_dim.z + pos.z)*m_global_dim.y + j*m_proc_dim.y + pos.y)*m_global_dim.x
+                    + pos.x;
+                mesh_cpx *local = part + (k*m_dim.y + j)*m_dim.x;
+                mesh_cpx *global = &m_fourier_buf[global_row];
+
+                for (unsigned int i = 0; i < m_dim.x; ++i)
+                    {
+                    if (to_global)
+                        global[i*m_proc_dim.x] = local[i];
+                    else
+                        local[i] = global[i*m_proc_dim.x];
+                    }
+                }
+        }
+    }
+
+/*! \param in First inner cell of the local real space mesh, in the embedding layout
+    \param out Local part of the Fourier space mesh
+ */
+void GatherMeshFFT::forward(const mesh_cpx *in, mesh_cpx *out)
+    {
+    // remove the ghost layer
+    for (unsigned int k = 0; k < m_dim.z; ++k)
+        for (unsigned int j = 0; j < m_dim.y; ++j)
+            {
+            const mesh_cpx *row = in + (k*m_embed.y + j)*m_embed.x;
+            std::copy(row, row + m_dim.x, &m_local_buf[(k*m_dim.y + j)*m_dim.x]);
+            }
+
+    MPI_Comm comm = m_exec_conf->getMPICommunicator();
+    MPI_Gather(&m_local_buf.front(), m_n_local*sizeof(mesh_cpx), MPI_BYTE,
+        m_is_root ? &m_rank_buf.front() : NULL, m_n_local*sizeof(mesh_cpx), MPI_BYTE, 0, comm);
+
+    if (m_is_root)
+        {
+        copyBlocks(true);
+        m_fft->forward(&m_global_buf.front(), &m_fourier_buf.front());
+        copyCyclic(false);
+        }
+
+    MPI_Scatter(m_is_root ? &m_rank_buf.front() : NULL, m_n_local*sizeof(mesh_cpx), MPI_BYTE,
+        out, m_n_local*sizeof(mesh_cpx), MPI_BYTE, 0, comm);
+    }
+
+/*! \param in Local part of the Fourier space mesh
+    \param out First inner cell of the local real space mesh, in the embedding layout
+ */
+void GatherMeshFFT::inverse(const mesh_cpx *in, mesh_cpx *out)
+    {
+    MPI_Comm comm = m_exec_conf->getMPICommunicator();
+    MPI_Gather((void *) in, m_n_local*sizeof(mesh_cpx), MPI_BYTE,
+        m_is_root ? &m_rank_buf.front() : NULL, m_n_local*sizeof(mesh_cpx), MPI_BYTE, 0, comm);
+
+    if (m_is_root)
+        {
+        copyCyclic(true);
+        m_fft->inverse(&m_fourier_buf.front(), &m_global_buf.front());
+        copyBlocks(false);
+        }
+
+    MPI_Scatter(m_is_root ? &m_rank_buf.front() : NULL, m_n_local*sizeof(mesh_cpx), MPI_BYTE,
+        &m_local_buf.front(), m_n_local*sizeof(mesh_cpx), MPI_BYTE, 0, comm);
+
+    // the ghost layer is filled by the ghost cell exchange
+    for (unsigned int k = 0; k < m_dim.z; ++k)
+        for (unsigned int j = 0; j < m_dim.y; ++j)
+            {
+            const mesh_cpx *row = &m_local_buf[(k*m_dim.y + j)*m_dim.x];
+            std::copy(row, row + m_dim.x, out + (k*m_embed.y + j)*m_embed.x);
+            }
+    }
+
+#endif // ENABLE_MPI
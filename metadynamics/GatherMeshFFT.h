@@ -0,0 +1,83 @@
+#ifndef __GATHER_MESH_FFT_H__
+#define __GATHER_MESH_FFT_H__
+
+/*! \file GatherMeshFFT.h
+    \brief Declares a distributed FFT that transforms the whole mesh on a single rank
+ */
+
+#ifdef ENABLE_MPI
+
+#include <hoomd/SystemDefinition.h>
+
+#include "MeshFFT.h"
+#include "MeshPrecision.h"
+
+#include <mpi.h>
+#include <memory>
+#include <vector>
+
+/*! Distributed FFT of a decomposed mesh by gathering it onto the root rank
+
+    The inner cells of all ranks are collected on the root rank, which transforms
+    the global mesh with a local MeshFFT and returns to every rank its part of the
+    result. The data layout is that of the host dfft plans of OrderParameterMesh:
+    the real space mesh is distributed in blocks following the domain decomposition,
+    and the Fourier space mesh cyclically, i.e. rank (px,py,pz) of a (Px,Py,Pz) grid
+    holds the wave vectors with indices (l*Px+px, m*Py+py, n*Pz+pz).
+
+    Every transform costs one gather and one scatter, instead of the several rounds
+    of all-to-all communication of the dfft plans, which pays off for small meshes
+    on many ranks. Neither direction is normalized.
+ */
+class GatherMeshFFT
+    {
+    public:
+        /*! Constructor
+            \param sysdef The system definition
+            \param dim Number of inner mesh points per rank
+            \param embed Dimensions of the local real space mesh including the ghost layer
+            \param backend Name of the local FFT backend on the root rank
+            \param num_threads Number of threads for the local FFT
+            \param wisdom_file File for FFTW wisdom (may be empty)
+         */
+        GatherMeshFFT(std::shared_ptr<SystemDefinition> sysdef, uint3 dim, uint3 embed,
+            const std::string& backend, unsigned int num_threads, const std::string& wisdom_file);
+
+        /*! Forward transform
+            \param in First inner cell of the local real space mesh, in the embedding layout
+            \param out Local part of the Fourier space mesh
+         */
+        void forward(const mesh_cpx *in, mesh_cpx *out);
+
+        /*! Inverse transform
+            \param in Local part of the Fourier space mesh
+            \param out First inner cell of the local real space mesh, in the embedding layout
+         */
+        void inverse(const mesh_cpx *in, mesh_cpx *out);
+
+    private:
+        std::shared_ptr<const ExecutionConfiguration> m_exec_conf; //!< The execution configuration
+        uint3 m_dim;                         //!< Number of inner mesh points per rank
+        uint3 m_embed;                       //!< Dimensions of the local mesh including the ghost layer
+        uint3 m_proc_dim;                    //!< Dimensions of the processor grid
+        uint3 m_global_dim;                  //!< Dimensions of the global mesh
+        unsigned int m_n_local;              //!< Number of inner cells per rank
+        bool m_is_root;                      //!< True on the rank that performs the FFT
+
+        std::vector<uint3> m_rank_pos;       //!< Grid position of every rank (root only)
+        std::unique_ptr<MeshFFT> m_fft;      //!< Local FFT of the global mesh (root only)
+
+        std::vector<mesh_cpx> m_local_buf;   //!< Contiguous copy of the local part of the mesh
+        std::vector<mesh_cpx> m_rank_buf;    //!< Parts of all ranks, in rank order (root only)
+        std::vector<mesh_cpx> m_global_buf;  //!< The global real space mesh (root only)
+        std::vector<mesh_cpx> m_fourier_buf; //!< The global Fourier space mesh (root only)
+
+        //! Copy between the parts of all ranks and the global real space mesh
+        void copyBlocks(bool to_global);
+
+        //! Copy between the parts of all ranks and the global Fourier space mesh
+        void copyCyclic(bool to_global);
+    };
+
+#endif // ENABLE_MPI
+#endif // __GATHER_MESH_FFT_H__
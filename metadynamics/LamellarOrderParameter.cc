@@ -3,13 +3,16 @@
  */
 #include "LamellarOrderParameter.h"
 
+#include <algorithm>
+
 namespace py = pybind11;
 
 LamellarOrderParameter::LamellarOrderParameter(std::shared_ptr<SystemDefinition> sysdef,
                                const std::vector<Scalar>& mode,
                                const std::vector<int3>& lattice_vectors,
                                const std::string& suffix)
-    : CollectiveVariable(sysdef, "cv_lamellar"), m_mode(mode), m_cv(0.0)
+    : CollectiveVariable(sysdef, "cv_lamellar"), m_mode(mode), m_cv(0.0), m_gradient_valid(false),
+      m_num_threads(1)
     {
     if (mode.size() != m_pdata->getNTypes())
         {
@@ -33,10 +36,115 @@ LamellarOrderParameter::LamellarOrderParameter(std::shared_ptr<SystemDefinition>
 
     m_cv_last_updated = 0;
 
+    #ifdef _OPENMP
+    m_num_threads = omp_get_max_threads();
+    #endif
+
+    // the per-particle gradient is indexed by the local particle order
+    m_pdata->getParticleSortSignal().connect<LamellarOrderParameter, &LamellarOrderParameter::setParticlesSorted>(this);
+
     // copy over lattice vectors
     ArrayHandle<int3> h_lattice_vectors(m_lattice_vectors, access_location::host, access_mode::overwrite);
+    m_miller_min = make_int3(0,0,0);
+    m_miller_max = make_int3(0,0,0);
     for (unsigned int k = 0; k < lattice_vectors.size(); k++)
-        h_lattice_vectors.data[k] = lattice_vectors[k];
+        {
+        int3 n = lattice_vectors[k];
+        h_lattice_vectors.data[k] = n;
+
+        m_miller_min = make_int3(std::min(m_miller_min.x, n.x), std::min(m_miller_min.y, n.y), std::min(m_miller_min.z, n.z));
+        m_miller_max = make_int3(std::max(m_miller_max.x, n.x), std::max(m_miller_max.y, n.y), std::max(m_miller_max.z, n.z));
+        }
+    }
+
+LamellarOrderParameter::~LamellarOrderParameter()
+    {
+    m_pdata->getParticleSortSignal().disconnect<LamellarOrderParameter, &LamellarOrderParameter::setParticlesSorted>(this);
+    }
+
+/*! \param num_threads Number of threads
+
+    The particles are divided into contiguous blocks, one per thread. The partial
+    Fourier modes of the threads are summed in the order of the threads, so that
+    the result does not depend on the scheduling.
+ */
+void LamellarOrderParameter::setNumThreads(unsigned int num_threads)
+    {
+    if (num_threads == 0)
+        {
+        m_exec_conf->msg->error() << "cv.lamellar: Number of threads has to be positive." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.lamellar");
+        }
+
+    #ifdef _OPENMP
+    m_num_threads = num_threads;
+    #else
+    if (num_threads > 1)
+        m_exec_conf->msg->warning() << "cv.lamellar: Plugin compiled without OpenMP support, ignoring number of threads." << std::endl;
+    #endif
+    }
+
+/*! \param b1 Output first reciprocal lattice vector
+    \param b2 Output second reciprocal lattice vector
+    \param b3 Output third reciprocal lattice vector
+ */
+void LamellarOrderParameter::computeReciprocalVectors(Scalar3& b1, Scalar3& b2, Scalar3& b3) const
+    {
+    const BoxDim& global_box = m_pdata->getGlobalBox();
+    Scalar3 a1 = global_box.getLatticeVector(0);
+    Scalar3 a2 = global_box.getLatticeVector(1);
+    Scalar3 a3 = global_box.getLatticeVector(2);
+
+    Scalar V_box = global_box.getVolume();
+    b1 = Scalar(2.0*M_PI)*make_scalar3(a2.y*a3.z-a2.z*a3.y, a2.z*a3.x-a2.x*a3.z, a2.x*a3.y-a2.y*a3.x)/V_box;
+    b2 = Scalar(2.0*M_PI)*make_scalar3(a3.y*a1.z-a3.z*a1.y, a3.z*a1.x-a3.x*a1.z, a3.x*a1.y-a3.y*a1.x)/V_box;
+    b3 = Scalar(2.0*M_PI)*make_scalar3(a1.y*a2.z-a1.z*a2.y, a1.z*a2.x-a1.x*a2.z, a1.x*a2.y-a1.y*a2.x)/V_box;
+    }
+
+//! Complex product of two phase factors
+inline Scalar2 complexMultiply(const Scalar2& a, const Scalar2& b)
+    {
+    return make_scalar2(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x);
+    }
+
+/*! \param pos The particle position
+    \param b1 First reciprocal lattice vector
+    \param b2 Second reciprocal lattice vector
+    \param b3 Third reciprocal lattice vector
+    \param lattice_vectors The Miller indices of the wave vectors
+    \param powers Scratch space for getNumPowers() values
+    \param phases Output phase factors, one per wave vector
+ */
+void LamellarOrderParameter::computePhases(const Scalar3& pos, const Scalar3& b1, const Scalar3& b2, const Scalar3& b3,
+    const int3 *lattice_vectors, Scalar2 *powers, Scalar2 *phases) const
+    {
+    Scalar3 b[3] = {b1, b2, b3};
+    int n_min[3] = {m_miller_min.x, m_miller_min.y, m_miller_min.z};
+    int n_max[3] = {m_miller_max.x, m_miller_max.y, m_miller_max.z};
+
+    // tables of exp(i n b.r), indexed by the Miller index n
+    Scalar2 *table[3];
+    for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+        table[axis] = powers - n_min[axis];
+        powers += n_max[axis] - n_min[axis] + 1;
+
+        Scalar arg = dot(b[axis], pos);
+        Scalar2 e = make_scalar2(fast::cos(arg), fast::sin(arg));
+        Scalar2 e_conj = make_scalar2(e.x, -e.y);
+
+        table[axis][0] = make_scalar2(1.0, 0.0);
+        for (int n = 1; n <= n_max[axis]; ++n)
+            table[axis][n] = complexMultiply(table[axis][n-1], e);
+        for (int n = -1; n >= n_min[axis]; --n)
+            table[axis][n] = complexMultiply(table[axis][n+1], e_conj);
+        }
+
+    for (unsigned int k = 0; k < m_lattice_vectors.getNumElements(); k++)
+        {
+        int3 n = lattice_vectors[k];
+        phases[k] = complexMultiply(complexMultiply(table[0][n.x], table[1][n.y]), table[2][n.z]);
+        }
     }
 
 void LamellarOrderParameter::computeCV(unsigned int timestep)
@@ -74,65 +182,29 @@ void LamellarOrderParameter::computeCV(unsigned int timestep)
     }
 
 
+/*! The forces are obtained from the per-particle gradient of the CV pass of the
+    same time step, which is repeated only if it is out of date.
+ */
 void LamellarOrderParameter::computeBiasForces(unsigned int timestep)
     {
     if (m_prof)
         m_prof->push("Lamellar");
 
-    if (m_cv_last_updated < timestep || timestep == 0)
+    if (m_cv_last_updated < timestep || timestep == 0 || !m_gradient_valid)
         computeCV(timestep);
 
-    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<Scalar3> h_gradient(m_gradient, access_location::host, access_mode::read);
     ArrayHandle<Scalar4> h_force(m_force, access_location::host, access_mode::overwrite);
-    ArrayHandle<int3> h_lattice_vectors(m_lattice_vectors, access_location::host, access_mode::read);
 
     unsigned int N = m_pdata->getNGlobal();
 
-    Scalar denom = (Scalar)N;
-
-    // compute reciprocal lattice vectors
-    const BoxDim& global_box = m_pdata->getGlobalBox();
-    Scalar3 a1 = global_box.getLatticeVector(0);
-    Scalar3 a2 = global_box.getLatticeVector(1);
-    Scalar3 a3 = global_box.getLatticeVector(2);
-
-    Scalar V_box = global_box.getVolume();
-    Scalar3 b1 = Scalar(2.0*M_PI)*make_scalar3(a2.y*a3.z-a2.z*a3.y, a2.z*a3.x-a2.x*a3.z, a2.x*a3.y-a2.y*a3.x)/V_box;
-    Scalar3 b2 = Scalar(2.0*M_PI)*make_scalar3(a3.y*a1.z-a3.z*a1.y, a3.z*a1.x-a3.x*a1.z, a3.x*a1.y-a3.y*a1.x)/V_box;
-    Scalar3 b3 = Scalar(2.0*M_PI)*make_scalar3(a1.y*a2.z-a1.z*a2.y, a1.z*a2.x-a1.x*a2.z, a1.x*a2.y-a1.y*a2.x)/V_box;
+    Scalar fac = m_bias/(Scalar)N;
 
-    for (unsigned int idx = 0; idx < m_pdata->getN(); idx++)
+    #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+    for (int idx = 0; idx < (int) m_pdata->getN(); idx++)
         {
-        Scalar4 postype = h_postype.data[idx];
-
-        Scalar3 pos = make_scalar3(postype.x, postype.y, postype.z);
-        unsigned int type = __scalar_as_int(postype.w);
-        Scalar mode = m_mode[type];
-
-        Scalar4 force_energy = make_scalar4(0,0,0,0);
-
-        for (unsigned int k = 0; k < m_lattice_vectors.getNumElements(); k++)
-            {
-            Scalar3 q = b1*(Scalar)h_lattice_vectors.data[k].x + b2*(Scalar)h_lattice_vectors.data[k].y + b3*(Scalar)h_lattice_vectors.data[k].z;
-            Scalar dotproduct = dot(pos,q);
-
-            Scalar f;
-            f = Scalar(2.0)*mode*sin(dotproduct);
-
-            force_energy.x += q.x*f;
-            force_energy.y += q.y*f;
-            force_energy.z += q.z*f;
-            }
-
-        force_energy.x *= m_bias;
-        force_energy.y *= m_bias;
-        force_energy.z *= m_bias;
-
-        force_energy.x /= denom;
-        force_energy.y /= denom;
-        force_energy.z /= denom;
-
-        h_force.data[idx] = force_energy;
+        Scalar3 gradient = h_gradient.data[idx];
+        h_force.data[idx] = make_scalar4(fac*gradient.x, fac*gradient.y, fac*gradient.z, 0.0);
         }
 
     if (m_prof)
@@ -140,6 +212,14 @@ void LamellarOrderParameter::computeBiasForces(unsigned int timestep)
     }
 
 //! Returns a list of fourier modes (for all wave vectors)
+/*! The particles are visited in the outer loop, so that the phase factors of all
+    wave vectors can be built from three sines and cosines per particle.
+
+    Every thread handles a contiguous block of particles and accumulates its own
+    partial Fourier modes, which are then summed in the order of the threads.
+    The wave vectors are stored component-wise, so that the inner loop over them
+    is free of aliasing and can be vectorized by the compiler.
+ */
 void LamellarOrderParameter::calculateFourierModes()
     {
     ArrayHandle<Scalar2> h_fourier_modes(m_fourier_modes, access_location::host, access_mode::overwrite);
@@ -148,34 +228,86 @@ void LamellarOrderParameter::calculateFourierModes()
     ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
 
     // compute reciprocal lattice vectors
-    const BoxDim& global_box = m_pdata->getGlobalBox();
-    Scalar3 a1 = global_box.getLatticeVector(0);
-    Scalar3 a2 = global_box.getLatticeVector(1);
-    Scalar3 a3 = global_box.getLatticeVector(2);
+    Scalar3 b1, b2, b3;
+    computeReciprocalVectors(b1, b2, b3);
 
-    Scalar V_box = global_box.getVolume();
-    Scalar3 b1 = Scalar(2.0*M_PI)*make_scalar3(a2.y*a3.z-a2.z*a3.y, a2.z*a3.x-a2.x*a3.z, a2.x*a3.y-a2.y*a3.x)/V_box;
-    Scalar3 b2 = Scalar(2.0*M_PI)*make_scalar3(a3.y*a1.z-a3.z*a1.y, a3.z*a1.x-a3.x*a1.z, a3.x*a1.y-a3.y*a1.x)/V_box;
-    Scalar3 b3 = Scalar(2.0*M_PI)*make_scalar3(a1.y*a2.z-a1.z*a2.y, a1.z*a2.x-a1.x*a2.z, a1.x*a2.y-a1.y*a2.x)/V_box;
+    unsigned int n_wave = m_lattice_vectors.getNumElements();
+    std::vector<Scalar> qx(n_wave), qy(n_wave), qz(n_wave);
+    for (unsigned int k = 0; k < n_wave; k++)
+        {
+        Scalar3 q = b1*(Scalar)h_lattice_vectors.data[k].x + b2*(Scalar)h_lattice_vectors.data[k].y + b3*(Scalar)h_lattice_vectors.data[k].z;
+        qx[k] = q.x;
+        qy[k] = q.y;
+        qz[k] = q.z;
+        }
 
+    if (m_gradient.getNumElements() < m_pdata->getN())
+        {
+        GPUArray<Scalar3> gradient(m_pdata->getMaxN(), m_exec_conf);
+        m_gradient.swap(gradient);
+        }
+    ArrayHandle<Scalar3> h_gradient(m_gradient, access_location::host, access_mode::overwrite);
 
-    for (unsigned int k = 0; k < m_lattice_vectors.getNumElements(); k++)
+    unsigned int n_powers = getNumPowers();
+    m_thread_modes.assign(n_wave*m_num_threads, make_scalar2(0.0,0.0));
+
+    unsigned int nparticles = m_pdata->getN();
+
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
         {
-        h_fourier_modes.data[k] = make_scalar2(0.0,0.0);
-        Scalar3 q = b1*(Scalar)h_lattice_vectors.data[k].x + b2*(Scalar)h_lattice_vectors.data[k].y + b3*(Scalar)h_lattice_vectors.data[k].z;
+        unsigned int start = (unsigned long)nparticles*thread/m_num_threads;
+        unsigned int end = (unsigned long)nparticles*(thread+1)/m_num_threads;
+
+        std::vector<Scalar2> powers(n_powers);
+        std::vector<Scalar2> phases(n_wave);
 
-        for (unsigned int idx = 0; idx < m_pdata->getN(); idx++)
+        Scalar2 *modes = &m_thread_modes[n_wave*thread];
+        const Scalar2 *phase = &phases.front();
+        const Scalar *qx_k = &qx.front();
+        const Scalar *qy_k = &qy.front();
+        const Scalar *qz_k = &qz.front();
+
+        for (unsigned int idx = start; idx < end; idx++)
             {
             Scalar4 postype = h_postype.data[idx];
 
             Scalar3 pos = make_scalar3(postype.x, postype.y, postype.z);
             unsigned int type = __scalar_as_int(postype.w);
             Scalar mode = m_mode[type];
-            Scalar dotproduct = dot(q,pos);
-            h_fourier_modes.data[k].x += mode * cos(dotproduct);
-            h_fourier_modes.data[k].y += mode * sin(dotproduct);
+
+            computePhases(pos, b1, b2, b3, h_lattice_vectors.data, &powers.front(), &phases.front());
+
+            Scalar gx(0.0), gy(0.0), gz(0.0);
+            for (unsigned int k = 0; k < n_wave; k++)
+                {
+                modes[k].x += mode * phase[k].x;
+                modes[k].y += mode * phase[k].y;
+
+                // the imaginary part of the phase factor is sin(q.r)
+                Scalar f = Scalar(2.0)*mode*phase[k].y;
+                gx += qx_k[k]*f;
+                gy += qy_k[k]*f;
+                gz += qz_k[k]*f;
+                }
+
+            h_gradient.data[idx] = make_scalar3(gx, gy, gz);
             }
         }
+
+    // combine partial results in the order of the threads
+    for (unsigned int k = 0; k < n_wave; k++)
+        {
+        Scalar2 sum = make_scalar2(0.0,0.0);
+        for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+            {
+            sum.x += m_thread_modes[n_wave*thread+k].x;
+            sum.y += m_thread_modes[n_wave*thread+k].y;
+            }
+        h_fourier_modes.data[k] = sum;
+        }
+
+    m_gradient_valid = true;
     }
 
 Scalar LamellarOrderParameter::getLogValue(const std::string& quantity, unsigned int timestep)
@@ -196,5 +328,6 @@ void export_LamellarOrderParameter(py::module& m)
         .def(py::init<std::shared_ptr<SystemDefinition>,
                      const std::vector<Scalar>&,
                      const std::vector<int3>,
-                     const std::string&>());
+                     const std::string&>())
+        .def("setNumThreads", &LamellarOrderParameter::setNumThreads);
     }
@@ -8,6 +8,10 @@
 
 #include "CollectiveVariable.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 // need to declare these classes with __host__ __device__ qualifiers when building in nvcc
 // HOSTDEVICE is __host__ __device__ when included in nvcc and blank when included into the host compiler
 #ifdef NVCC
@@ -44,7 +48,7 @@ class LamellarOrderParameter : public CollectiveVariable
                                const std::vector<int3>& lattice_vectors,
                                const std::string& suffix = ""
                                );
-        virtual ~LamellarOrderParameter() {}
+        virtual ~LamellarOrderParameter();
 
         /*! Compute the forces for this collective variable.
             The force that is written to the force arrays must be
@@ -78,6 +82,11 @@ class LamellarOrderParameter : public CollectiveVariable
             return m_cv;
             } 
 
+        /*! Set the number of host threads used for the Fourier modes and the forces
+            \param num_threads Number of threads
+         */
+        void setNumThreads(unsigned int num_threads);
+
     protected:
         std::string m_log_name;               //!< The log name for this collective variable
         std::vector<Scalar> m_mode;           //!< Stores the per-type mode coefficients
@@ -89,11 +98,51 @@ class LamellarOrderParameter : public CollectiveVariable
 
         unsigned int m_cv_last_updated;       //!< Timestep the collective variable was last updated
 
+        GPUArray<Scalar3> m_gradient;         //!< Per-particle sum of 2 a q sin(q.r) over the wave vectors, from the last CV pass
+        bool m_gradient_valid;                //!< False if the particles were reordered since the last CV pass
+
+        int3 m_miller_min;                    //!< Smallest Miller index along every axis (at most zero)
+        int3 m_miller_max;                    //!< Largest Miller index along every axis (at least zero)
+
+        unsigned int m_num_threads;           //!< Number of host threads
+        std::vector<Scalar2> m_thread_modes;  //!< Per-thread partial sums of the Fourier modes
+
         //! Calculates the current value of the collective variable
         virtual void computeCV(unsigned int timestep);
 
+        //! Compute the reciprocal lattice vectors of the global box (including the factor 2 pi)
+        void computeReciprocalVectors(Scalar3& b1, Scalar3& b2, Scalar3& b3) const;
+
+        /*! Compute exp(i q.r) of a particle for all wave vectors
+            \param pos The particle position
+            \param b1 First reciprocal lattice vector
+            \param b2 Second reciprocal lattice vector
+            \param b3 Third reciprocal lattice vector
+            \param lattice_vectors The Miller indices of the wave vectors
+            \param powers Scratch space for getNumPowers() values
+            \param phases Output phase factors, one per wave vector
+
+            Only one sine and cosine per reciprocal lattice vector are evaluated, the
+            phase factors for all Miller indices are obtained by complex multiplication.
+         */
+        void computePhases(const Scalar3& pos, const Scalar3& b1, const Scalar3& b2, const Scalar3& b3,
+            const int3 *lattice_vectors, Scalar2 *powers, Scalar2 *phases) const;
+
+        //! Size of the table of powers of exp(i b.r) used by computePhases()
+        unsigned int getNumPowers() const
+            {
+            return (m_miller_max.x - m_miller_min.x + 1) + (m_miller_max.y - m_miller_min.y + 1)
+                + (m_miller_max.z - m_miller_min.z + 1);
+            }
+
+        //! Invalidate the per-particle gradient after the particles have been reordered
+        void setParticlesSorted()
+            {
+            m_gradient_valid = false;
+            }
+
     private:
-        //! Helper function to calculate the Fourier modes
+        //! Helper function to calculate the Fourier modes, and the per-particle gradient
         void calculateFourierModes();
 
     };
@@ -0,0 +1,257 @@
+/*! \file LamellarOrderParameterMesh.cc
+    \brief Implements the lamellar order parameter evaluated on a mesh
+ */
+
+#include "LamellarOrderParameterMesh.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace py = pybind11;
+
+const unsigned int LamellarOrderParameterMesh::not_local;
+
+/*! \param sysdef The system definition
+    \param nx Number of cells along first axis
+    \param ny Number of cells along second axis
+    \param nz Number of cells along third axis
+    \param mode Per-type mode coefficients
+    \param lattice_vectors The Miller indices of the wave vectors
+    \param suffix The suffix appended to the log name for this quantity
+    \param fft_backend Local FFT backend ("auto", "kiss" or "fftw")
+ */
+LamellarOrderParameterMesh::LamellarOrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
+                                                       const unsigned int nx,
+                                                       const unsigned int ny,
+                                                       const unsigned int nz,
+                                                       const std::vector<Scalar>& mode,
+                                                       const std::vector<int3>& lattice_vectors,
+                                                       const std::string& suffix,
+                                                       const std::string& fft_backend)
+    : OrderParameterMesh(sysdef, nx, ny, nz, mode, std::vector<int3>(), fft_backend),
+      m_lattice_vectors(lattice_vectors),
+      m_mode_sum(0.0)
+    {
+    m_cv_name = "cv_lamellar" + suffix;
+    m_log_name = m_cv_name;
+
+    m_global_dim = make_uint3(nx, ny, m_2d ? 1 : nz);
+
+    // the modes have to be resolved by the mesh without ambiguity
+    for (unsigned int k = 0; k < m_lattice_vectors.size(); ++k)
+        {
+        int3 n = m_lattice_vectors[k];
+        if (2*abs(n.x) >= (int) m_global_dim.x || 2*abs(n.y) >= (int) m_global_dim.y || 2*abs(n.z) >= (int) m_global_dim.z)
+            {
+            m_exec_conf->msg->error() << "cv.lamellar: Lattice vector (" << n.x << "," << n.y << "," << n.z
+                << ") is not below the Nyquist frequency of the mesh." << std::endl << std::endl;
+            throw std::runtime_error("Error setting up cv.lamellar");
+            }
+        }
+
+    m_mode_cell.resize(m_lattice_vectors.size(), not_local);
+    m_conj_cell.resize(m_lattice_vectors.size(), not_local);
+    m_mode_factor.resize(m_lattice_vectors.size(), make_scalar2(0.0,0.0));
+    }
+
+void LamellarOrderParameterMesh::setInterlace(bool interlace)
+    {
+    if (interlace)
+        {
+        m_exec_conf->msg->error() << "cv.lamellar: Interlacing is not supported with a mesh." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.lamellar");
+        }
+    }
+
+void LamellarOrderParameterMesh::computeInfluenceFunction()
+    {
+    OrderParameterMesh::computeInfluenceFunction();
+
+    // the influence function may have been read from the cache without rescaling
+    findModeCells();
+    computeModeFactors();
+    }
+
+void LamellarOrderParameterMesh::rescaleInfluenceFunction()
+    {
+    OrderParameterMesh::rescaleInfluenceFunction();
+
+    computeModeFactors();
+    }
+
+/*! The wave vectors n and -n of every mode are looked up among the locally stored
+    wave vectors of the Fourier mesh. With a decomposed mesh, they are in general
+    stored on different ranks, and with a real-to-complex FFT often only one of them
+    is stored at all.
+ */
+void LamellarOrderParameterMesh::findModeCells()
+    {
+    // global mesh index of n and -n, with the mode index and whether it is the conjugate
+    std::vector<std::pair<unsigned int, unsigned int> > keys;
+    for (unsigned int k = 0; k < m_lattice_vectors.size(); ++k)
+        {
+        int3 n = m_lattice_vectors[k];
+        for (unsigned int conj = 0; conj < 2; ++conj)
+            {
+            int sign = conj ? -1 : 1;
+            unsigned int i = (sign*n.x + (int) m_global_dim.x) % m_global_dim.x;
+            unsigned int j = (sign*n.y + (int) m_global_dim.y) % m_global_dim.y;
+            unsigned int l = (sign*n.z + (int) m_global_dim.z) % m_global_dim.z;
+            keys.push_back(std::make_pair((l*m_global_dim.y + j)*m_global_dim.x + i, 2*k + conj));
+            }
+        }
+    std::sort(keys.begin(), keys.end());
+
+    m_mode_cell.assign(m_lattice_vectors.size(), not_local);
+    m_conj_cell.assign(m_lattice_vectors.size(), not_local);
+
+    ArrayHandle<int3> h_miller(m_miller, access_location::host, access_mode::read);
+
+    // every mode is stored at most once per rank, so the threads write to distinct entries
+    #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+    for (int cell_idx = 0; cell_idx < (int) m_n_fourier_cells; ++cell_idx)
+        {
+        int3 n = h_miller.data[cell_idx];
+        unsigned int i = (n.x + (int) m_global_dim.x) % m_global_dim.x;
+        unsigned int j = (n.y + (int) m_global_dim.y) % m_global_dim.y;
+        unsigned int l = (n.z + (int) m_global_dim.z) % m_global_dim.z;
+        unsigned int key = (l*m_global_dim.y + j)*m_global_dim.x + i;
+
+        std::vector<std::pair<unsigned int, unsigned int> >::const_iterator it =
+            std::lower_bound(keys.begin(), keys.end(), std::make_pair(key, 0u));
+        for (; it != keys.end() && it->first == key; ++it)
+            {
+            unsigned int k = it->second/2;
+            if (it->second % 2)
+                m_conj_cell[k] = cell_idx;
+            else
+                m_mode_cell[k] = cell_idx;
+            }
+        }
+    }
+
+/*! The factors combine the phase of the mesh origin, which is half a cell above the
+    lower corner of the global box, with the inverse of the Fourier transform of the
+    assignment function.
+ */
+void LamellarOrderParameterMesh::computeModeFactors()
+    {
+    Scalar3 b1, b2, b3;
+    computeReciprocalVectors(b1, b2, b3);
+
+    Scalar3 lo = m_pdata->getGlobalBox().getLo();
+
+    for (unsigned int k = 0; k < m_lattice_vectors.size(); ++k)
+        {
+        int3 n = m_lattice_vectors[k];
+        Scalar3 q = (Scalar)n.x*b1 + (Scalar)n.y*b2 + (Scalar)n.z*b3;
+
+        Scalar arg = dot(q, lo) + Scalar(M_PI)*((Scalar)n.x/(Scalar)m_global_dim.x
+            + (Scalar)n.y/(Scalar)m_global_dim.y + (Scalar)n.z/(Scalar)m_global_dim.z);
+
+        // transform of the B-spline, sinc(k h/2)^P per axis, which is one along z in two dimensions
+        Scalar W = assignFourier(Scalar(M_PI)*(Scalar)n.x/(Scalar)m_global_dim.x)
+            * assignFourier(Scalar(M_PI)*(Scalar)n.y/(Scalar)m_global_dim.y)
+            * assignFourier(Scalar(M_PI)*(Scalar)n.z/(Scalar)m_global_dim.z);
+
+        m_mode_factor[k] = make_scalar2(cos(arg)/W, sin(arg)/W);
+        }
+    }
+
+/*! \param compute_virial Ignored, since the collective variable has no virial
+
+    The force mesh is Hermitian, with c(n)/2 at n and its complex conjugate at -n,
+    so that the inverse transform is the real potential sum_k cos(q_k.r), and only
+    the stored half of it is needed for a complex-to-real transform.
+ */
+void LamellarOrderParameterMesh::computeForceMesh(bool compute_virial)
+    {
+    if (m_prof) m_prof->push("k-space");
+
+    ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::read);
+    ArrayHandle<mesh_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::overwrite);
+
+    memset(h_fourier_mesh_G.data, 0, sizeof(mesh_cpx)*m_n_fourier_cells);
+
+    Scalar sum(0.0);
+    for (unsigned int k = 0; k < m_lattice_vectors.size(); ++k)
+        {
+        Scalar2 c = m_mode_factor[k];
+        unsigned int cell = m_mode_cell[k];
+        unsigned int conj_cell = m_conj_cell[k];
+
+        // real part of c F(n)^*, or of c F(-n) if only the conjugate is stored
+        if (cell != not_local)
+            {
+            kiss_fft_cpx f = make_kiss_cpx(h_fourier_mesh.data[cell]);
+            sum += c.x*f.r + c.y*f.i;
+
+            h_fourier_mesh_G.data[cell].r += Scalar(0.5)*c.x;
+            h_fourier_mesh_G.data[cell].i += Scalar(0.5)*c.y;
+            }
+        else if (m_real_fft && conj_cell != not_local)
+            {
+            kiss_fft_cpx f = make_kiss_cpx(h_fourier_mesh.data[conj_cell]);
+            sum += c.x*f.r - c.y*f.i;
+            }
+
+        if (conj_cell != not_local)
+            {
+            h_fourier_mesh_G.data[conj_cell].r += Scalar(0.5)*c.x;
+            h_fourier_mesh_G.data[conj_cell].i -= Scalar(0.5)*c.y;
+            }
+        }
+
+    m_mode_sum = sum;
+
+    if (m_prof) m_prof->pop();
+    }
+
+Scalar LamellarOrderParameterMesh::computeCV()
+    {
+    Scalar sum = m_mode_sum;
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        // reduce sum
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &sum,
+                      1,
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
+        }
+    #endif
+
+    return sum/(Scalar)m_pdata->getNGlobal();
+    }
+
+void LamellarOrderParameterMesh::computeVirial()
+    {
+    for (unsigned int i = 0; i < 6; ++i)
+        m_external_virial[i] = Scalar(0.0);
+    }
+
+Scalar LamellarOrderParameterMesh::getLogValue(const std::string& quantity, unsigned int timestep)
+    {
+    if (quantity == m_log_name)
+        return getCurrentValue(timestep);
+
+    // nothing found, turn to base class
+    return CollectiveVariable::getLogValue(quantity, timestep);
+    }
+
+void export_LamellarOrderParameterMesh(py::module& m)
+    {
+    py::class_<LamellarOrderParameterMesh, std::shared_ptr<LamellarOrderParameterMesh> >(m,"LamellarOrderParameterMesh", py::base<OrderParameterMesh> ())
+        .def(py::init<std::shared_ptr<SystemDefinition>,
+                                     const unsigned int,
+                                     const unsigned int,
+                                     const unsigned int,
+                                     const std::vector<Scalar>&,
+                                     const std::vector<int3>&,
+                                     const std::string&,
+                                     const std::string&
+                                    >());
+    }
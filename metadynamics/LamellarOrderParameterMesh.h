@@ -0,0 +1,105 @@
+#ifndef __LAMELLAR_ORDER_PARAMETER_MESH_H__
+#define __LAMELLAR_ORDER_PARAMETER_MESH_H__
+
+/*! \file LamellarOrderParameterMesh.h
+    \brief Declares the lamellar order parameter evaluated on a mesh
+ */
+
+#include "OrderParameterMesh.h"
+
+/*! Lamellar order parameter evaluated with the particle mesh machinery
+
+    The collective variable and the forces are those of LamellarOrderParameter,
+    s = N^{-1} \sum_k \sum_j a(type_j) \cos(\mathbf{q}_k\mathbf{r}_j), but the
+    Fourier modes are sampled from the transformed density mesh instead of
+    being summed over the particles, so that the cost is O(N + M log M) for M
+    mesh points, independent of the number of wave vectors.
+
+    The mode of a wave vector with Miller indices n is obtained from the
+    mesh transform F(n) by dividing out the transform of the assignment function
+    W(n) and the phase of the mesh origin,
+    \f$ \rho(\mathbf{q}) = c(n) F(n)^* \f$ with
+    \f$ c(n) = e^{i \mathbf{q}\cdot\mathbf{r}_{lo} + i\pi \sum_a n_a/N_a} / W(n) \f$.
+    The same factors, placed at n on an otherwise empty Fourier mesh, give after
+    the inverse transform the potential \f$ \sum_k \cos(\mathbf{q}_k\mathbf{r}) \f$,
+    whose gradient is interpolated onto the particles like the force mesh of the
+    base class.
+
+    The remaining error is aliasing of the modes n + N m onto n, which decreases
+    with the order of the assignment function and the ratio of the mesh size
+    to the wave length. Every Miller index has to be smaller than half the number
+    of mesh points along its axis.
+ */
+class LamellarOrderParameterMesh : public OrderParameterMesh
+    {
+    public:
+        //! Constructor
+        LamellarOrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
+                                   const unsigned int nx,
+                                   const unsigned int ny,
+                                   const unsigned int nz,
+                                   const std::vector<Scalar>& mode,
+                                   const std::vector<int3>& lattice_vectors,
+                                   const std::string& suffix = "",
+                                   const std::string& fft_backend = std::string("auto"));
+        virtual ~LamellarOrderParameterMesh() {}
+
+        //! Interlacing is not supported, the assignment function is deconvolved instead
+        virtual void setInterlace(bool interlace);
+
+        /*! Returns the names of provided log quantities.
+         */
+        std::vector<std::string> getProvidedLogQuantities()
+            {
+            std::vector<std::string> list = CollectiveVariable::getProvidedLogQuantities();
+            list.push_back(m_log_name);
+            return list;
+            }
+
+        /*! Returns the value of a specific log quantity.
+         * \param quantity The name of the quantity to return the value of
+         * \param timestep The current value of the time step
+         */
+        Scalar getLogValue(const std::string& quantity, unsigned int timestep);
+
+    protected:
+        //! Compute the wave vectors and find the locally stored modes
+        virtual void computeInfluenceFunction();
+
+        //! Update the deconvolution factors for a new box
+        virtual void rescaleInfluenceFunction();
+
+        //! Sample the modes of the lattice vectors and build the force mesh
+        virtual void computeForceMesh(bool compute_virial);
+
+        //! Helper function to calculate value of collective variable
+        virtual Scalar computeCV();
+
+        //! The collective variable does not contribute to the virial
+        virtual void computeVirial();
+
+    private:
+        //! Marks a mode that is not stored on this rank
+        static const unsigned int not_local = 0xffffffff;
+
+        std::string m_log_name;                  //!< The log name for this collective variable
+        std::vector<int3> m_lattice_vectors;     //!< Miller indices of the wave vectors
+        uint3 m_global_dim;                      //!< Number of mesh points of the global mesh
+
+        std::vector<unsigned int> m_mode_cell;   //!< Local index of the wave vector n in the Fourier mesh, per mode
+        std::vector<unsigned int> m_conj_cell;   //!< Local index of the wave vector -n in the Fourier mesh, per mode
+        std::vector<Scalar2> m_mode_factor;      //!< Phase and deconvolution factor c(n), per mode
+
+        Scalar m_mode_sum;                       //!< Local sum of the real parts of the modes
+
+        //! Find the locally stored wave vectors of all modes
+        void findModeCells();
+
+        //! Compute the factors c(n) for the current box
+        void computeModeFactors();
+    };
+
+//! Export LamellarOrderParameterMesh to python
+void export_LamellarOrderParameterMesh(pybind11::module& m);
+
+#endif // __LAMELLAR_ORDER_PARAMETER_MESH_H__
@@ -0,0 +1,296 @@
+/*! \file MeshFFT.cc
+    \brief Implements the local FFT backends of OrderParameterMesh
+ */
+
+#include "MeshFFT.h"
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#ifdef ENABLE_FFTW
+#include <fftw3.h>
+
+#if defined(SINGLE_PRECISION) || defined(MESH_MIXED_PRECISION)
+#define FFTW_NAME(name) fftwf_ ## name
+#else
+#define FFTW_NAME(name) fftw_ ## name
+#endif
+
+typedef FFTW_NAME(complex) fftw_cpx;
+typedef FFTW_NAME(plan) fftw_plan_t;
+#endif
+
+#ifndef MESH_MIXED_PRECISION
+/*! FFT backend using the bundled kissfft
+
+    kissfft is only available in Scalar precision, so it is not used if the
+    meshes are stored in a lower precision.
+ */
+class KissMeshFFT : public MeshFFT
+    {
+    public:
+        //! Constructor
+        KissMeshFFT(uint3 dim, bool allow_real)
+            : MeshFFT(dim, allow_real), m_fftr(NULL), m_ifftr(NULL), m_fft(NULL), m_ifft(NULL)
+            {
+            int dims[3];
+            int ndims = getDimensions(m_dim, dims);
+
+            if (m_real)
+                {
+                m_fftr = kiss_fftndr_alloc(dims, ndims, 0);
+                m_ifftr = kiss_fftndr_alloc(dims, ndims, 1);
+                }
+            else
+                {
+                m_fft = kiss_fftnd_alloc(dims, ndims, 0, NULL, NULL);
+                m_ifft = kiss_fftnd_alloc(dims, ndims, 1, NULL, NULL);
+                }
+            }
+
+        //! Destructor
+        virtual ~KissMeshFFT()
+            {
+            kiss_fftndr_free(m_fftr);
+            kiss_fftndr_free(m_ifftr);
+            free(m_fft);
+            free(m_ifft);
+            kiss_fft_cleanup();
+            }
+
+        virtual void forward(const mesh_scalar *in, mesh_cpx *out)
+            {
+            kiss_fftndr(m_fftr, in, out);
+            }
+
+        virtual void inverse(const mesh_cpx *in, mesh_scalar *out)
+            {
+            kiss_fftndri(m_ifftr, in, out);
+            }
+
+        virtual void forward(const mesh_cpx *in, mesh_cpx *out)
+            {
+            kiss_fftnd(m_fft, in, out);
+            }
+
+        virtual void inverse(const mesh_cpx *in, mesh_cpx *out)
+            {
+            kiss_fftnd(m_ifft, in, out);
+            }
+
+    private:
+        kiss_fftndr_cfg m_fftr;    //!< Real-to-complex FFT configuration
+        kiss_fftndr_cfg m_ifftr;   //!< Complex-to-real FFT configuration
+        kiss_fftnd_cfg m_fft;      //!< Forward complex FFT configuration
+        kiss_fftnd_cfg m_ifft;     //!< Inverse complex FFT configuration
+    };
+#endif
+
+#ifdef ENABLE_FFTW
+/*! FFTW plans for a given mesh, shared by all meshes of equal dimensions
+
+    The plans are created on scratch buffers and executed with the new-array
+    interface. Arrays that do not have the alignment of the scratch buffers,
+    and the input to the complex-to-real transform (which FFTW overwrites),
+    are passed through the scratch buffers.
+ */
+struct FFTWPlans
+    {
+    //! Constructor
+    FFTWPlans(uint3 dim, bool real, unsigned int num_threads)
+        {
+        n_real = dim.x*dim.y*dim.z;
+        n_fourier = (real ? dim.x/2+1 : dim.x)*dim.y*dim.z;
+
+        scratch_in = (fftw_cpx *) FFTW_NAME(malloc)(sizeof(fftw_cpx)*n_real);
+        scratch_out = (fftw_cpx *) FFTW_NAME(malloc)(sizeof(fftw_cpx)*n_real);
+
+        #ifdef ENABLE_FFTW_THREADS
+        FFTW_NAME(plan_with_nthreads)(num_threads);
+        #endif
+
+        int dims[3];
+        int ndims = MeshFFT::getDimensions(dim, dims);
+        if (real)
+            {
+            forward = FFTW_NAME(plan_dft_r2c)(ndims, dims, (mesh_scalar *) scratch_in, scratch_out, FFTW_MEASURE);
+            inverse = FFTW_NAME(plan_dft_c2r)(ndims, dims, scratch_in, (mesh_scalar *) scratch_out, FFTW_MEASURE);
+            }
+        else
+            {
+            forward = FFTW_NAME(plan_dft)(ndims, dims, scratch_in, scratch_out, FFTW_FORWARD, FFTW_MEASURE);
+            inverse = FFTW_NAME(plan_dft)(ndims, dims, scratch_in, scratch_out, FFTW_BACKWARD, FFTW_MEASURE);
+            }
+        }
+
+    //! Destructor
+    ~FFTWPlans()
+        {
+        FFTW_NAME(destroy_plan)(forward);
+        FFTW_NAME(destroy_plan)(inverse);
+        FFTW_NAME(free)(scratch_in);
+        FFTW_NAME(free)(scratch_out);
+        }
+
+    //! Returns true if an array has the alignment the plans were created for
+    bool isAligned(const void *ptr) const
+        {
+        return FFTW_NAME(alignment_of)((mesh_scalar *) ptr) == FFTW_NAME(alignment_of)((mesh_scalar *) scratch_in);
+        }
+
+    fftw_plan_t forward;        //!< Forward transform
+    fftw_plan_t inverse;        //!< Inverse transform
+    fftw_cpx *scratch_in;       //!< Scratch input buffer
+    fftw_cpx *scratch_out;      //!< Scratch output buffer
+    unsigned int n_real;        //!< Number of mesh points in real space
+    unsigned int n_fourier;     //!< Number of mesh points in Fourier space
+    };
+
+//! Cache of FFTW plans, indexed by mesh dimensions, transform type and number of threads
+static std::map<std::tuple<unsigned int, unsigned int, unsigned int, bool, unsigned int>,
+    std::shared_ptr<FFTWPlans> > fftw_plan_cache;
+
+//! FFT backend using FFTW
+class FFTWMeshFFT : public MeshFFT
+    {
+    public:
+        //! Constructor
+        FFTWMeshFFT(uint3 dim, unsigned int num_threads, const std::string& wisdom_file, bool allow_real)
+            : MeshFFT(dim, allow_real)
+            {
+            #ifdef ENABLE_FFTW_THREADS
+            static bool threads_initialized = false;
+            if (! threads_initialized)
+                {
+                FFTW_NAME(init_threads)();
+                threads_initialized = true;
+                }
+            #else
+            num_threads = 1;
+            #endif
+
+            std::tuple<unsigned int, unsigned int, unsigned int, bool, unsigned int> key(dim.x, dim.y, dim.z, m_real, num_threads);
+            std::shared_ptr<FFTWPlans>& plans = fftw_plan_cache[key];
+
+            if (! plans)
+                {
+                if (wisdom_file.size())
+                    FFTW_NAME(import_wisdom_from_filename)(wisdom_file.c_str());
+
+                plans = std::shared_ptr<FFTWPlans>(new FFTWPlans(dim, m_real, num_threads));
+
+                if (wisdom_file.size())
+                    FFTW_NAME(export_wisdom_to_filename)(wisdom_file.c_str());
+                }
+
+            m_plans = plans;
+            }
+
+        virtual void forward(const mesh_scalar *in, mesh_cpx *out)
+            {
+            mesh_scalar *in_ptr = (mesh_scalar *) in;
+            if (! m_plans->isAligned(in))
+                {
+                in_ptr = (mesh_scalar *) m_plans->scratch_in;
+                memcpy(in_ptr, in, sizeof(mesh_scalar)*m_plans->n_real);
+                }
+
+            if (m_plans->isAligned(out))
+                {
+                FFTW_NAME(execute_dft_r2c)(m_plans->forward, in_ptr, (fftw_cpx *) out);
+                }
+            else
+                {
+                FFTW_NAME(execute_dft_r2c)(m_plans->forward, in_ptr, m_plans->scratch_out);
+                memcpy(out, m_plans->scratch_out, sizeof(fftw_cpx)*m_plans->n_fourier);
+                }
+            }
+
+        virtual void inverse(const mesh_cpx *in, mesh_scalar *out)
+            {
+            // the complex-to-real transform destroys its input
+            memcpy(m_plans->scratch_in, in, sizeof(fftw_cpx)*m_plans->n_fourier);
+
+            if (m_plans->isAligned(out))
+                {
+                FFTW_NAME(execute_dft_c2r)(m_plans->inverse, m_plans->scratch_in, out);
+                }
+            else
+                {
+                FFTW_NAME(execute_dft_c2r)(m_plans->inverse, m_plans->scratch_in, (mesh_scalar *) m_plans->scratch_out);
+                memcpy(out, m_plans->scratch_out, sizeof(mesh_scalar)*m_plans->n_real);
+                }
+            }
+
+        virtual void forward(const mesh_cpx *in, mesh_cpx *out)
+            {
+            execute(m_plans->forward, in, out);
+            }
+
+        virtual void inverse(const mesh_cpx *in, mesh_cpx *out)
+            {
+            execute(m_plans->inverse, in, out);
+            }
+
+    private:
+        std::shared_ptr<FFTWPlans> m_plans;    //!< The (shared) plans
+
+        //! Execute a complex-to-complex plan
+        void execute(fftw_plan_t plan, const mesh_cpx *in, mesh_cpx *out)
+            {
+            fftw_cpx *in_ptr = (fftw_cpx *) in;
+            if (! m_plans->isAligned(in))
+                {
+                in_ptr = m_plans->scratch_in;
+                memcpy(in_ptr, in, sizeof(fftw_cpx)*m_plans->n_real);
+                }
+
+            if (m_plans->isAligned(out))
+                {
+                FFTW_NAME(execute_dft)(plan, in_ptr, (fftw_cpx *) out);
+                }
+            else
+                {
+                FFTW_NAME(execute_dft)(plan, in_ptr, m_plans->scratch_out);
+                memcpy(out, m_plans->scratch_out, sizeof(fftw_cpx)*m_plans->n_real);
+                }
+            }
+    };
+#endif
+
+bool MeshFFT::isAvailable(const std::string& backend)
+    {
+    if (backend == "auto")
+        return true;
+
+    #ifndef MESH_MIXED_PRECISION
+    if (backend == "kiss")
+        return true;
+    #endif
+
+    #ifdef ENABLE_FFTW
+    if (backend == "fftw")
+        return true;
+    #endif
+
+    return false;
+    }
+
+std::unique_ptr<MeshFFT> MeshFFT::create(const std::string& backend,
+    uint3 dim, unsigned int num_threads, const std::string& wisdom_file, bool allow_real)
+    {
+    #ifdef ENABLE_FFTW
+    if (backend == "auto" || backend == "fftw")
+        return std::unique_ptr<MeshFFT>(new FFTWMeshFFT(dim, num_threads, wisdom_file, allow_real));
+    #endif
+
+    #ifndef MESH_MIXED_PRECISION
+    if (backend == "auto" || backend == "kiss")
+        return std::unique_ptr<MeshFFT>(new KissMeshFFT(dim, allow_real));
+    #endif
+
+    return std::unique_ptr<MeshFFT>();
+    }
@@ -0,0 +1,104 @@
+#ifndef __MESH_FFT_H__
+#define __MESH_FFT_H__
+
+/*! \file MeshFFT.h
+    \brief Declares the local FFT backends of OrderParameterMesh
+ */
+
+#include <hoomd/HOOMDMath.h>
+#include <hoomd/extern/kiss_fftnd.h>
+
+#include "kiss_fftndr.h"
+#include "MeshPrecision.h"
+
+#include <memory>
+#include <string>
+
+/*! Local (single-rank) FFT of the density mesh
+
+    The mesh is stored in row-major order with x varying fastest. If the
+    transform is real (isReal() returns true), the real space mesh holds one
+    mesh_scalar per mesh point and the Fourier space mesh holds
+    nz*ny*(nx/2+1) complex values, otherwise both meshes are complex and
+    of equal size. Neither direction is normalized.
+
+    Backends are obtained through MeshFFT::create().
+ */
+class MeshFFT
+    {
+    public:
+        //! Destructor
+        virtual ~MeshFFT() {}
+
+        //! Returns true if this is a real-to-complex transform
+        bool isReal() const
+            {
+            return m_real;
+            }
+
+        //! Returns the number of complex values in Fourier space
+        unsigned int getNumFourierCells() const
+            {
+            unsigned int nx = m_real ? m_dim.x/2+1 : m_dim.x;
+            return nx*m_dim.y*m_dim.z;
+            }
+
+        //! Forward real-to-complex transform
+        virtual void forward(const mesh_scalar *in, mesh_cpx *out) = 0;
+
+        //! Inverse complex-to-real transform
+        virtual void inverse(const mesh_cpx *in, mesh_scalar *out) = 0;
+
+        //! Forward complex-to-complex transform
+        virtual void forward(const mesh_cpx *in, mesh_cpx *out) = 0;
+
+        //! Inverse complex-to-complex transform
+        virtual void inverse(const mesh_cpx *in, mesh_cpx *out) = 0;
+
+        /*! Create a backend
+            \param backend Name of the backend ("auto", "kiss" or "fftw")
+            \param dim Number of mesh points along every axis
+            \param num_threads Number of threads the backend may use
+            \param wisdom_file File to import and export FFTW wisdom from and to (may be empty)
+            \param allow_real If false, always set up a complex-to-complex transform
+
+            A real transform is set up whenever the number of mesh points
+            along x is even, unless disabled. Returns a null pointer if the
+            backend is unknown or not available in this build.
+         */
+        static std::unique_ptr<MeshFFT> create(const std::string& backend,
+            uint3 dim, unsigned int num_threads, const std::string& wisdom_file,
+            bool allow_real = true);
+
+        //! Returns true if the plugin was compiled with the given backend
+        static bool isAvailable(const std::string& backend);
+
+        /*! Compute the dimensions of the transform, slowest varying first
+            \param dim Number of mesh points along every axis
+            \param dims Output dimensions
+            \returns The rank of the transform
+
+            A mesh with a single layer along z (in two dimensions) is transformed
+            as a two-dimensional array.
+         */
+        static int getDimensions(uint3 dim, int *dims)
+            {
+            int ndims = 0;
+            if (dim.z > 1)
+                dims[ndims++] = dim.z;
+            dims[ndims++] = dim.y;
+            dims[ndims++] = dim.x;
+            return ndims;
+            }
+
+    protected:
+        //! Constructor
+        MeshFFT(uint3 dim, bool allow_real)
+            : m_dim(dim), m_real(allow_real && !(dim.x & 1))
+            { }
+
+        uint3 m_dim;        //!< Number of mesh points along every axis
+        bool m_real;        //!< True if this is a real-to-complex transform
+    };
+
+#endif // __MESH_FFT_H__
@@ -0,0 +1,71 @@
+#ifndef __MESH_PRECISION_H__
+#define __MESH_PRECISION_H__
+
+/*! \file MeshPrecision.h
+    \brief Defines the storage precision of the meshes of OrderParameterMesh
+
+    By default, the meshes are stored in the precision of HOOMD (Scalar). With
+    ENABLE_MESH_SINGLE_PRECISION in a double precision build, the real and Fourier
+    space meshes are stored in single precision instead, which halves their memory
+    footprint and the bandwidth of the FFTs. All arithmetic on the mesh values and
+    all sums over the mesh are still carried out in Scalar precision.
+
+    The local FFTs then require FFTW in single precision, since the bundled kissfft
+    is only available in Scalar precision.
+ */
+
+#include <hoomd/HOOMDMath.h>
+#include <hoomd/extern/kiss_fft.h>
+
+#if defined(ENABLE_MESH_SINGLE_PRECISION) && !defined(SINGLE_PRECISION)
+//! Defined if the meshes are stored in a lower precision than Scalar
+#define MESH_MIXED_PRECISION
+
+#ifndef ENABLE_FFTW
+#error "ENABLE_MESH_SINGLE_PRECISION requires FFTW in single precision (fftw3f)"
+#endif
+
+//! Real mesh value
+typedef float mesh_scalar;
+
+//! Complex mesh value
+struct mesh_cpx
+    {
+    float r;    //!< Real part
+    float i;    //!< Imaginary part
+    };
+#else
+typedef kiss_fft_scalar mesh_scalar;
+typedef kiss_fft_cpx mesh_cpx;
+#endif
+
+//! Convert a complex mesh value to Scalar precision
+inline kiss_fft_cpx make_kiss_cpx(const mesh_cpx& a)
+    {
+    kiss_fft_cpx b;
+    b.r = a.r;
+    b.i = a.i;
+    return b;
+    }
+
+//! Convert a complex value to the storage precision of the mesh
+inline mesh_cpx make_mesh_cpx(const kiss_fft_cpx& a)
+    {
+    mesh_cpx b;
+    b.r = a.r;
+    b.i = a.i;
+    return b;
+    }
+
+//! Copy a mesh between storage precisions
+template<typename In, typename Out>
+inline void convertMesh(const In *in, Out *out, unsigned int n)
+    {
+    for (unsigned int i = 0; i < n; ++i)
+        {
+        out[i].r = in[i].r;
+        out[i].i = in[i].i;
+        }
+    }
+
+#endif // __MESH_PRECISION_H__
@@ -1,5 +1,11 @@
 #include "OrderParameterMesh.h"
 
+#include <hoomd/ClockSource.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
 namespace py = pybind11;
 
 bool is_pow2(unsigned int n)
@@ -14,31 +20,60 @@ bool is_pow2(unsigned int n)
     \param ny Number of cells along second axis
     \param nz Number of cells along third axis
     \param mode Per-type modes to multiply density
+    \param zero_modes Fourier modes that should be zeroed
+    \param fft_backend Local FFT backend ("auto", "kiss" or "fftw")
  */
 OrderParameterMesh::OrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
                                             const unsigned int nx,
                                             const unsigned int ny,
                                             const unsigned int nz,
                                             std::vector<Scalar> mode,
-                                            std::vector<int3> zero_modes)
+                                            std::vector<int3> zero_modes,
+                                            const std::string& fft_backend)
     : CollectiveVariable(sysdef, "mesh"),
       m_n_ghost_cells(make_uint3(0,0,0)),
       m_grid_dim(make_uint3(0,0,0)),
       m_ghost_width(make_scalar3(0,0,0)),
       m_n_cells(0),
+      m_order(3),
       m_radius(1),
+      m_interlace(false),
+      m_deconvolve(false),
+      m_2d(false),
       m_n_inner_cells(0),
+      m_n_fourier_cells(0),
       m_is_first_step(true),
       m_cv_last_updated(0),
       m_box_changed(false),
+      m_kernel_changed(false),
       m_cv(Scalar(0.0)),
       m_q_max_last_computed(0),
+      m_q_max(make_scalar3(0.0,0.0,0.0)),
+      m_sq_max(0.0),
+      m_num_peaks(1),
+      m_peak_shell_width(0.0),
       m_k_min(0.0),
       m_k_max(0.0),
       m_delta_k(0.0),
       m_use_table(false),
-      m_kiss_fft_initialized(false),
-      m_dfft_initialized(false)
+      m_num_threads(1),
+      m_sort_period(0),
+      m_sort_age(0),
+      m_sort_valid(false),
+      m_allow_real_fft(true),
+      m_real_fft(false),
+      m_fft_backend(fft_backend),
+      m_distributed_fft("auto"),
+      m_dfft_initialized(false),
+      m_n_boundary(0),
+      m_cv_sum(0.0),
+      m_virial_valid(false),
+      m_local_peaks_valid(false),
+      m_q_max_requested(false),
+      m_global_mesh_points(make_uint3(0,0,0)),
+      m_sk_n_bins(0),
+      m_sk_k_max(0.0),
+      m_sk_bin_valid(false)
     {
 
     if (mode.size() != m_pdata->getNTypes())
@@ -48,6 +83,12 @@ OrderParameterMesh::OrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
         throw std::runtime_error("Error setting up cv.mesh");
         }
 
+    if (! MeshFFT::isAvailable(m_fft_backend))
+        {
+        m_exec_conf->msg->error() << "cv.mesh: FFT backend " << m_fft_backend << " not available." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+
     GlobalArray<Scalar> mode_array(m_pdata->getNTypes(), m_exec_conf);
     m_mode.swap(mode_array);
 
@@ -63,9 +104,27 @@ OrderParameterMesh::OrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
     std::copy(zero_modes.begin(), zero_modes.end(), h_zero_modes.data);
 
     m_pdata->getBoxChangeSignal().connect<OrderParameterMesh, &OrderParameterMesh::setBoxChange>(this);
+    m_pdata->getParticleSortSignal().connect<OrderParameterMesh, &OrderParameterMesh::setParticlesSorted>(this);
+
+    for (unsigned int i = 0; i < 6; ++i)
+        m_virial_sum[i] = Scalar(0.0);
 
     m_mesh_points = make_uint3(nx, ny, nz);
 
+    // in two dimensions, the density does not vary along z, and a single mesh layer suffices
+    if (m_sysdef->getNDimensions() == 2)
+        {
+        if (nz != 1)
+            m_exec_conf->msg->notice(2) << "cv.mesh: Using a single mesh layer along z in two dimensions." << std::endl;
+
+        m_mesh_points.z = 1;
+        m_2d = true;
+        }
+
+    #ifdef _OPENMP
+    m_num_threads = omp_get_max_threads();
+    #endif
+
     #ifdef ENABLE_MPI
     if (m_pdata->getDomainDecomposition())
         {
@@ -115,21 +174,13 @@ OrderParameterMesh::OrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
     ArrayHandle<Scalar> h_virial(m_virial, access_location::host, access_mode::overwrite);
     memset(h_virial.data, 0, sizeof(Scalar)*m_virial.getNumElements());
 
-    m_log_names.push_back("cv_mesh");
-    m_log_names.push_back("qx_max");
-    m_log_names.push_back("qy_max");
-    m_log_names.push_back("qz_max");
-    m_log_names.push_back("sq_max");
+    m_peaks.resize(m_num_peaks, make_scalar4(0.0,0.0,0.0,0.0));
+    m_peak_shell.resize(m_num_peaks, Scalar(0.0));
+    updateLogNames();
     }
 
 OrderParameterMesh::~OrderParameterMesh()
     {
-    if (m_kiss_fft_initialized)
-        {
-        free(m_kiss_fft);
-        free(m_kiss_ifft);
-        kiss_fft_cleanup();
-        }
     #ifdef ENABLE_MPI
     if (m_dfft_initialized)
         {
@@ -139,6 +190,171 @@ OrderParameterMesh::~OrderParameterMesh()
     #endif
 
     m_pdata->getBoxChangeSignal().disconnect<OrderParameterMesh, &OrderParameterMesh::setBoxChange>(this);
+    m_pdata->getParticleSortSignal().disconnect<OrderParameterMesh, &OrderParameterMesh::setParticlesSorted>(this);
+    }
+
+/*! \param num_threads Number of host threads for the mesh operations
+
+    Without OpenMP support, only a single thread is used.
+ */
+void OrderParameterMesh::setNumThreads(unsigned int num_threads)
+    {
+    if (num_threads == 0)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: Number of threads has to be positive." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+
+    #ifdef _OPENMP
+    m_num_threads = num_threads;
+    #else
+    if (num_threads > 1)
+        m_exec_conf->msg->warning() << "cv.mesh: Plugin compiled without OpenMP support, ignoring number of threads." << std::endl;
+    #endif
+    }
+
+/*! \param order Order of the assignment function
+
+    The P3M assignment functions of order P are the cardinal B-splines of degree
+    P-1, assigning every particle to P mesh points along each axis. A higher order
+    suppresses aliasing and allows for a coarser mesh at the same accuracy.
+ */
+void OrderParameterMesh::setOrder(unsigned int order)
+    {
+    if (order < 2 || order > max_order)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: Order of the assignment function has to be between 2 and "
+            << max_order << "." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+
+    m_order = order;
+    m_radius = order/2;
+
+    // the ghost layer, the mesh and the influence function depend on the order
+    m_is_first_step = true;
+    }
+
+/*! \param interlace True if interlacing should be used
+
+    With interlacing, the density is assigned to a second mesh shifted by half
+    a cell along every axis. The transforms of both meshes are averaged with the
+    phase factor of the shift, which cancels the leading aliasing contributions,
+    at the cost of a second forward and inverse transform.
+ */
+void OrderParameterMesh::setInterlace(bool interlace)
+    {
+    m_interlace = interlace;
+
+    // the shifted meshes are allocated during setup
+    m_is_first_step = true;
+    }
+
+/*! \param deconvolve True if the assignment function should be deconvolved
+
+    The transform of the mesh density is the transform of the particle density
+    times the transform W(k) of the assignment function, up to aliasing. With
+    deconvolution, the transformed density is divided by W(k), which removes the
+    attenuation of the modes at large wave numbers, and the self term no longer
+    contains W(k)^2.
+ */
+void OrderParameterMesh::setDeconvolve(bool deconvolve)
+    {
+    m_deconvolve = deconvolve;
+
+    // the collective variable has to be recomputed
+    m_is_first_step = true;
+    }
+
+/*! \param method Name of the distributed FFT ("auto", "dfft" or "gather")
+ */
+void OrderParameterMesh::setDistributedFFT(const std::string& method)
+    {
+    if (method != "auto" && method != "dfft" && method != "gather")
+        {
+        m_exec_conf->msg->error() << "cv.mesh: Unknown distributed FFT " << method << "." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+
+    m_distributed_fft = method;
+
+    // the FFT is set up with the mesh
+    m_is_first_step = true;
+    }
+
+#ifdef ENABLE_MPI
+/*! The distributed FFT library exchanges the mesh in several rounds of messages per
+    transform, whose latency dominates if every rank only holds a few mesh points. Then,
+    a gather and a scatter of the whole mesh and a local FFT on the root rank are
+    cheaper, as long as the global mesh is small enough to be transformed by one rank.
+ */
+bool OrderParameterMesh::useGatherFFT() const
+    {
+    if (m_distributed_fft != "auto")
+        return m_distributed_fft == "gather";
+
+    //! Largest number of inner mesh points per rank for which the mesh is gathered
+    const unsigned int max_gather_local_cells = 4096;
+
+    //! Largest number of global mesh points for which the mesh is gathered
+    const unsigned int max_gather_global_cells = 262144;
+
+    unsigned int n_local = m_mesh_points.x*m_mesh_points.y*m_mesh_points.z;
+    unsigned int n_global = n_local*m_exec_conf->getNRanks();
+
+    return n_local <= max_gather_local_cells && n_global <= max_gather_global_cells;
+    }
+#endif
+
+void OrderParameterMesh::setNumPeaks(unsigned int num_peaks)
+    {
+    if (num_peaks == 0)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: At least one peak has to be tracked." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+
+    m_num_peaks = num_peaks;
+    m_peaks.assign(m_num_peaks, make_scalar4(0.0,0.0,0.0,0.0));
+    m_peak_shell.assign(m_num_peaks, Scalar(0.0));
+    m_local_peaks_valid = false;
+    m_q_max_last_computed = 0;
+
+    updateLogNames();
+    }
+
+void OrderParameterMesh::setPeakShellWidth(Scalar width)
+    {
+    if (width < Scalar(0.0))
+        {
+        m_exec_conf->msg->error() << "cv.mesh: The width of the peak shell cannot be negative." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+
+    m_peak_shell_width = width;
+    m_q_max_last_computed = 0;
+    }
+
+void OrderParameterMesh::updateLogNames()
+    {
+    m_log_names.clear();
+    m_log_names.push_back("cv_mesh");
+    m_log_names.push_back("qx_max");
+    m_log_names.push_back("qy_max");
+    m_log_names.push_back("qz_max");
+    m_log_names.push_back("sq_max");
+
+    for (unsigned int i = 0; i < m_num_peaks; ++i)
+        {
+        std::ostringstream suffix;
+        suffix << "_" << i;
+        m_log_names.push_back("q_max" + suffix.str());
+        m_log_names.push_back("qx_max" + suffix.str());
+        m_log_names.push_back("qy_max" + suffix.str());
+        m_log_names.push_back("qz_max" + suffix.str());
+        m_log_names.push_back("sq_max" + suffix.str());
+        m_log_names.push_back("sq_shell" + suffix.str());
+        }
     }
 
 /*! \param K Table for the convolution kernel
@@ -186,6 +402,8 @@ void OrderParameterMesh::setTable(const std::vector<Scalar> &K,
         h_table.data[i] = K[i];
         h_table_d.data[i] = d_K[i];
         }
+
+    m_kernel_changed = true;
     }
 
 void OrderParameterMesh::setupMesh()
@@ -211,21 +429,33 @@ void OrderParameterMesh::setupMesh()
     m_n_cells = m_grid_dim.x*m_grid_dim.y*m_grid_dim.z;
     m_n_inner_cells = m_mesh_points.x * m_mesh_points.y * m_mesh_points.z;
 
+    // by default, the full spectrum is stored, initializeFFT() may choose a more compact layout
+    m_n_fourier_cells = m_n_inner_cells;
+
+    initializeFFT();
+
     // allocate memory for influence function and k values
-    GlobalArray<Scalar> inf_f(m_n_inner_cells, m_exec_conf);
+    GlobalArray<Scalar> inf_f(m_n_fourier_cells, m_exec_conf);
     m_inf_f.swap(inf_f);
 
     // allocate memory for interpolationluence function and k values
-    GlobalArray<Scalar> interpolation_f(m_n_inner_cells, m_exec_conf);
+    GlobalArray<Scalar> interpolation_f(m_n_fourier_cells, m_exec_conf);
     m_interpolation_f.swap(interpolation_f);
 
-    GlobalArray<Scalar3> k(m_n_inner_cells, m_exec_conf);
+    GlobalArray<Scalar3> k(m_n_fourier_cells, m_exec_conf);
     m_k.swap(k);
 
-    GlobalArray<Scalar> virial_mesh(6*m_n_inner_cells, m_exec_conf);
-    m_virial_mesh.swap(virial_mesh);
+    GlobalArray<int3> miller(m_n_fourier_cells, m_exec_conf);
+    m_miller.swap(miller);
 
-    initializeFFT();
+    GlobalArray<Scalar> knorm(m_n_fourier_cells, m_exec_conf);
+    m_knorm.swap(knorm);
+
+    GlobalArray<Scalar> virial_kfac(m_n_fourier_cells, m_exec_conf);
+    m_virial_kfac.swap(virial_kfac);
+
+    GlobalArray<mesh_cpx> interlace_phase(m_interlace ? m_n_fourier_cells : 0, m_exec_conf);
+    m_interlace_phase.swap(interlace_phase);
     }
 
 uint3 OrderParameterMesh::computeGhostCellNum()
@@ -270,110 +500,223 @@ void OrderParameterMesh::initializeFFT()
     if (! local_fft)
         {
         // ghost cell communicator for charge interpolation
-        m_grid_comm_forward = std::unique_ptr<CommunicatorGrid<kiss_fft_cpx> >(
-            new CommunicatorGrid<kiss_fft_cpx>(m_sysdef,
+        m_grid_comm_forward = std::unique_ptr<CommunicatorGridAsync<mesh_cpx> >(
+            new CommunicatorGridAsync<mesh_cpx>(m_sysdef,
                make_uint3(m_mesh_points.x, m_mesh_points.y, m_mesh_points.z),
                make_uint3(m_grid_dim.x, m_grid_dim.y, m_grid_dim.z),
                m_n_ghost_cells,
                true));
         // ghost cell communicator for force mesh
-        m_grid_comm_reverse = std::unique_ptr<CommunicatorGrid<kiss_fft_cpx> >(
-            new CommunicatorGrid<kiss_fft_cpx>(m_sysdef,
+        m_grid_comm_reverse = std::unique_ptr<CommunicatorGridAsync<mesh_cpx> >(
+            new CommunicatorGridAsync<mesh_cpx>(m_sysdef,
                make_uint3(m_mesh_points.x, m_mesh_points.y, m_mesh_points.z),
                make_uint3(m_grid_dim.x, m_grid_dim.y, m_grid_dim.z),
                m_n_ghost_cells,
                false));
-        // set up distributed FFTs
-        int gdim[3];
-        int pdim[3];
+        // the shifted force mesh is exchanged at the same time
+        m_shifted_grid_comm_reverse.reset();
+        if (m_interlace)
+            m_shifted_grid_comm_reverse = std::unique_ptr<CommunicatorGridAsync<mesh_cpx> >(
+                new CommunicatorGridAsync<mesh_cpx>(m_sysdef,
+                   make_uint3(m_mesh_points.x, m_mesh_points.y, m_mesh_points.z),
+                   make_uint3(m_grid_dim.x, m_grid_dim.y, m_grid_dim.z),
+                   m_n_ghost_cells,
+                   false));
         Index3D decomp_idx = m_pdata->getDomainDecomposition()->getDomainIndexer();
-        pdim[0] = decomp_idx.getD();
-        pdim[1] = decomp_idx.getH();
-        pdim[2] = decomp_idx.getW();
-        gdim[0] = m_mesh_points.z*pdim[0];
-        gdim[1] = m_mesh_points.y*pdim[1];
-        gdim[2] = m_mesh_points.x*pdim[2];
         int embed[3];
         embed[0] = m_mesh_points.z+2*m_n_ghost_cells.z;
         embed[1] = m_mesh_points.y+2*m_n_ghost_cells.y;
         embed[2] = m_mesh_points.x+2*m_n_ghost_cells.x;
         m_ghost_offset = (m_n_ghost_cells.z*embed[1]+m_n_ghost_cells.y)*embed[2]+m_n_ghost_cells.x;
-        uint3 pcoord = m_pdata->getDomainDecomposition()->getGridPos();
-        int pidx[3];
-        pidx[0] = pcoord.z;
-        pidx[1] = pcoord.y;
-        pidx[2] = pcoord.x;
-        int row_m = 0; /* both local grid and proc grid are row major, no transposition necessary */
-        ArrayHandle<unsigned int> h_cart_ranks(m_pdata->getDomainDecomposition()->getCartRanks(),
-            access_location::host, access_mode::read);
-        dfft_create_plan(&m_dfft_plan_forward, 3, gdim, embed, NULL, pdim, pidx,
-            row_m, 0, 1, m_exec_conf->getMPICommunicator(), (int *)h_cart_ranks.data);
-        dfft_create_plan(&m_dfft_plan_inverse, 3, gdim, NULL, embed, pdim, pidx,
-            row_m, 0, 1, m_exec_conf->getMPICommunicator(), (int *)h_cart_ranks.data);
-        m_dfft_initialized = true;
+
+        m_gather_fft.reset();
+        if (m_dfft_initialized)
+            {
+            dfft_destroy_plan(m_dfft_plan_forward);
+            dfft_destroy_plan(m_dfft_plan_inverse);
+            m_dfft_initialized = false;
+            }
+
+        if (useGatherFFT())
+            {
+            m_exec_conf->msg->notice(3) << "cv.mesh: Transforming the mesh on the root rank" << std::endl;
+            m_gather_fft = std::unique_ptr<GatherMeshFFT>(new GatherMeshFFT(m_sysdef, m_mesh_points,
+                make_uint3(embed[2], embed[1], embed[0]), m_fft_backend, m_num_threads, m_fft_wisdom_file));
+            }
+        else
+            {
+            // set up distributed FFTs
+            int gdim[3];
+            int pdim[3];
+            pdim[0] = decomp_idx.getD();
+            pdim[1] = decomp_idx.getH();
+            pdim[2] = decomp_idx.getW();
+            gdim[0] = m_mesh_points.z*pdim[0];
+            gdim[1] = m_mesh_points.y*pdim[1];
+            gdim[2] = m_mesh_points.x*pdim[2];
+            uint3 pcoord = m_pdata->getDomainDecomposition()->getGridPos();
+            int pidx[3];
+            pidx[0] = pcoord.z;
+            pidx[1] = pcoord.y;
+            pidx[2] = pcoord.x;
+            int row_m = 0; /* both local grid and proc grid are row major, no transposition necessary */
+            ArrayHandle<unsigned int> h_cart_ranks(m_pdata->getDomainDecomposition()->getCartRanks(),
+                access_location::host, access_mode::read);
+            dfft_create_plan(&m_dfft_plan_forward, 3, gdim, embed, NULL, pdim, pidx,
+                row_m, 0, 1, m_exec_conf->getMPICommunicator(), (int *)h_cart_ranks.data);
+            dfft_create_plan(&m_dfft_plan_inverse, 3, gdim, NULL, embed, pdim, pidx,
+                row_m, 0, 1, m_exec_conf->getMPICommunicator(), (int *)h_cart_ranks.data);
+            m_dfft_initialized = true;
+            }
+
+        #ifdef MESH_MIXED_PRECISION
+        // the distributed FFT library is only available in Scalar precision
+        unsigned int n_dfft_cells = m_gather_fft ? 0 : std::max(m_n_cells, m_mesh_points.x*m_mesh_points.y*m_mesh_points.z);
+        GlobalArray<kiss_fft_cpx> dfft_in(n_dfft_cells, m_exec_conf);
+        m_dfft_in.swap(dfft_in);
+        GlobalArray<kiss_fft_cpx> dfft_out(n_dfft_cells, m_exec_conf);
+        m_dfft_out.swap(dfft_out);
+        #endif
         }
     #endif // ENABLE_MPI
 
     if (local_fft)
         {
-        int dims[3];
-        dims[0] = m_mesh_points.z;
-        dims[1] = m_mesh_points.y;
-        dims[2] = m_mesh_points.x;
+        // keep the FFT plans next to the influence function cache, unless a wisdom file is given
+        std::string wisdom_file = m_fft_wisdom_file;
+        if (wisdom_file.empty() && m_influence_cache_file.size())
+            wisdom_file = m_influence_cache_file + ".wisdom";
 
-        m_kiss_fft = kiss_fftnd_alloc(dims, 3, 0, NULL, NULL);
-        m_kiss_ifft = kiss_fftnd_alloc(dims, 3, 1, NULL, NULL);
+        m_local_fft = MeshFFT::create(m_fft_backend, m_mesh_points, m_num_threads, wisdom_file, m_allow_real_fft);
 
-        m_kiss_fft_initialized = true;
+        // the density is real, so for an even number of mesh points along x
+        // we only need to store and transform half of the Fourier space
+        m_real_fft = m_local_fft->isReal();
+        m_n_fourier_cells = m_local_fft->getNumFourierCells();
         }
 
     // allocate mesh and transformed mesh
-    GlobalArray<kiss_fft_cpx> mesh(m_n_cells,m_exec_conf);
-    m_mesh.swap(mesh);
+    if (m_real_fft)
+        {
+        GlobalArray<mesh_scalar> mesh(m_n_cells,m_exec_conf);
+        m_real_mesh.swap(mesh);
+
+        GlobalArray<mesh_scalar> inv_fourier_mesh(m_n_cells, m_exec_conf);
+        m_real_inv_fourier_mesh.swap(inv_fourier_mesh);
+        }
+    else
+        {
+        GlobalArray<mesh_cpx> mesh(m_n_cells,m_exec_conf);
+        m_mesh.swap(mesh);
+
+        GlobalArray<mesh_cpx> inv_fourier_mesh(m_n_cells, m_exec_conf);
+        m_inv_fourier_mesh.swap(inv_fourier_mesh);
+        }
 
-    GlobalArray<kiss_fft_cpx> fourier_mesh(m_n_inner_cells, m_exec_conf);
+    GlobalArray<mesh_cpx> fourier_mesh(m_n_fourier_cells, m_exec_conf);
     m_fourier_mesh.swap(fourier_mesh);
 
-    GlobalArray<kiss_fft_cpx> fourier_mesh_G(m_n_inner_cells, m_exec_conf);
+    GlobalArray<mesh_cpx> fourier_mesh_G(m_n_fourier_cells, m_exec_conf);
     m_fourier_mesh_G.swap(fourier_mesh_G);
 
-    GlobalArray<kiss_fft_cpx> inv_fourier_mesh(m_n_cells, m_exec_conf);
-    m_inv_fourier_mesh.swap(inv_fourier_mesh);
-    }
-
-void OrderParameterMesh::computeInfluenceFunction()
-    {
-    if (m_prof) m_prof->push("influence function");
+    // the shifted mesh has the same layout as the unshifted one
+    unsigned int n_shifted_cells = m_interlace ? m_n_cells : 0;
+    if (m_real_fft)
+        {
+        GlobalArray<mesh_scalar> shifted_mesh(n_shifted_cells, m_exec_conf);
+        m_real_shifted_mesh.swap(shifted_mesh);
 
-    ArrayHandle<Scalar> h_inf_f(m_inf_f,access_location::host, access_mode::overwrite);
-    ArrayHandle<Scalar> h_interpolation_f(m_interpolation_f,access_location::host, access_mode::overwrite);
-    ArrayHandle<Scalar3> h_k(m_k,access_location::host, access_mode::overwrite);
+        GlobalArray<mesh_scalar> shifted_inv_mesh(n_shifted_cells, m_exec_conf);
+        m_real_shifted_inv_mesh.swap(shifted_inv_mesh);
+        }
+    else
+        {
+        GlobalArray<mesh_cpx> shifted_mesh(n_shifted_cells, m_exec_conf);
+        m_shifted_mesh.swap(shifted_mesh);
 
-    ArrayHandle<Scalar> h_table(m_table, access_location::host, access_mode::read);
+        GlobalArray<mesh_cpx> shifted_inv_mesh(n_shifted_cells, m_exec_conf);
+        m_shifted_inv_mesh.swap(shifted_inv_mesh);
+        }
 
-    // reset arrays
-    memset(h_inf_f.data, 0, sizeof(Scalar)*m_inf_f.getNumElements());
-    memset(h_interpolation_f.data, 0, sizeof(Scalar)*m_interpolation_f.getNumElements());
-    memset(h_k.data, 0, sizeof(Scalar3)*m_k.getNumElements());
+    GlobalArray<mesh_cpx> shifted_fourier_mesh(m_interlace ? m_n_fourier_cells : 0, m_exec_conf);
+    m_shifted_fourier_mesh.swap(shifted_fourier_mesh);
+    }
 
+/*! \param b1 Output first reciprocal lattice vector
+    \param b2 Output second reciprocal lattice vector
+    \param b3 Output third reciprocal lattice vector
+ */
+void OrderParameterMesh::computeReciprocalVectors(Scalar3& b1, Scalar3& b2, Scalar3& b3) const
+    {
     const BoxDim& global_box = m_pdata->getGlobalBox();
 
-    // compute reciprocal lattice vectors
     Scalar3 a1 = global_box.getLatticeVector(0);
     Scalar3 a2 = global_box.getLatticeVector(1);
     Scalar3 a3 = global_box.getLatticeVector(2);
 
     Scalar V_box = global_box.getVolume();
-    Scalar3 b1 = Scalar(2.0*M_PI)*make_scalar3(a2.y*a3.z-a2.z*a3.y, a2.z*a3.x-a2.x*a3.z, a2.x*a3.y-a2.y*a3.x)/V_box;
-    Scalar3 b2 = Scalar(2.0*M_PI)*make_scalar3(a3.y*a1.z-a3.z*a1.y, a3.z*a1.x-a3.x*a1.z, a3.x*a1.y-a3.y*a1.x)/V_box;
-    Scalar3 b3 = Scalar(2.0*M_PI)*make_scalar3(a1.y*a2.z-a1.z*a2.y, a1.z*a2.x-a1.x*a2.z, a1.x*a2.y-a1.y*a2.x)/V_box;
+    b1 = Scalar(2.0*M_PI)*make_scalar3(a2.y*a3.z-a2.z*a3.y, a2.z*a3.x-a2.x*a3.z, a2.x*a3.y-a2.y*a3.x)/V_box;
+    b2 = Scalar(2.0*M_PI)*make_scalar3(a3.y*a1.z-a3.z*a1.y, a3.z*a1.x-a3.x*a1.z, a3.x*a1.y-a3.y*a1.x)/V_box;
+    b3 = Scalar(2.0*M_PI)*make_scalar3(a1.y*a2.z-a1.z*a2.y, a1.z*a2.x-a1.x*a2.z, a1.x*a2.y-a1.y*a2.x)/V_box;
+    }
+
+/*! The Miller indices of the wave vectors and the Fourier transform of the assignment
+    function do not depend on the box shape, so after a box change only the wave vectors
+    and the convolution kernel need to be re-evaluated. The mesh layout and the FFT
+    plans are left untouched.
+
+    The kernel, its derivative and |k| are cached per wave vector, so that the
+    k-space passes do not need to look up the tables every step.
+ */
+void OrderParameterMesh::rescaleInfluenceFunction()
+    {
+    if (m_prof) m_prof->push("rescale influence function");
+
+    ArrayHandle<Scalar> h_inf_f(m_inf_f,access_location::host, access_mode::overwrite);
+    ArrayHandle<Scalar3> h_k(m_k,access_location::host, access_mode::overwrite);
+    ArrayHandle<Scalar> h_knorm(m_knorm,access_location::host, access_mode::overwrite);
+    ArrayHandle<Scalar> h_virial_kfac(m_virial_kfac,access_location::host, access_mode::overwrite);
+    ArrayHandle<int3> h_miller(m_miller,access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_table(m_table, access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_table_d(m_table_d, access_location::host, access_mode::read);
+
+    Scalar3 b1, b2, b3;
+    computeReciprocalVectors(b1, b2, b3);
+
+    #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+    for (int cell_idx = 0; cell_idx < (int) m_n_fourier_cells; ++cell_idx)
+        {
+        int3 n = h_miller.data[cell_idx];
+        Scalar3 k = (Scalar)n.x*b1+(Scalar)n.y*b2+(Scalar)n.z*b3;
+        Scalar knorm = fast::sqrt(dot(k,k));
+
+        h_k.data[cell_idx] = k;
+        h_knorm.data[cell_idx] = knorm;
+        h_inf_f.data[cell_idx] = evaluateTable(h_table.data, knorm, Scalar(1.0));
+
+        // the DC bin does not contribute to the virial
+        h_virial_kfac.data[cell_idx] = (knorm > Scalar(0.0)) ?
+            evaluateTable(h_table_d.data, knorm, Scalar(0.0))/(Scalar(2.0)*knorm) : Scalar(0.0);
+        }
+
+    // the structure factor shells depend on |k|
+    m_sk_bin_valid = false;
 
-    bool local_fft = m_kiss_fft_initialized;
+    if (m_prof) m_prof->pop();
+    }
+
+/*! The Miller indices and the Fourier transform of the assignment function factorize
+    into per-axis contributions, which are tabulated first. The cells are then filled in
+    parallel, one row along x at a time.
+ */
+void OrderParameterMesh::computeInfluenceFunction()
+    {
+    if (m_prof) m_prof->push("influence function");
 
     uint3 global_dim = m_mesh_points;
+    uint3 pdim = make_uint3(1,1,1);
+    uint3 pidx = make_uint3(0,0,0);
     #ifdef ENABLE_MPI
-    uint3 pdim=make_uint3(0,0,0);
-    uint3 pidx=make_uint3(0,0,0);
     if (m_pdata->getDomainDecomposition())
         {
         const Index3D &didx = m_pdata->getDomainDecomposition()->getDomainIndexer();
@@ -384,107 +727,248 @@ void OrderParameterMesh::computeInfluenceFunction()
         pdim = make_uint3(didx.getW(), didx.getH(), didx.getD());
         }
     #endif
+    m_global_mesh_points = global_dim;
 
-    for (unsigned int cell_idx = 0; cell_idx < m_n_inner_cells; ++cell_idx)
+    std::string cache_key;
+    if (m_influence_cache_file.size())
         {
-        uint3 wave_idx;
-        #ifdef ENABLE_MPI
-        if (! local_fft)
-           {
-           // local layout: row major
-           int ny = m_mesh_points.y;
-           int nx = m_mesh_points.x;
-           int n_local = cell_idx/ny/nx;
-           int m_local = (cell_idx-n_local*ny*nx)/nx;
-           int l_local = cell_idx % nx;
-           // cyclic distribution
-           wave_idx.x = l_local*pdim.x + pidx.x;
-           wave_idx.y = m_local*pdim.y + pidx.y;
-           wave_idx.z = n_local*pdim.z + pidx.z;
-           }
-        else
-        #endif
+        cache_key = getInfluenceCacheKey();
+        if (readInfluenceCache(cache_key))
             {
-            // kiss FFT expects data in row major format
-            wave_idx.z = cell_idx / (m_mesh_points.y * m_mesh_points.x);
-            wave_idx.y = (cell_idx - wave_idx.z * m_mesh_points.x * m_mesh_points.y)/ m_mesh_points.x;
-            wave_idx.x = cell_idx % m_mesh_points.x;
+            m_sk_bin_valid = false;
+            if (m_prof) m_prof->pop();
+            return;
             }
+        }
+
+        {
+        ArrayHandle<Scalar> h_interpolation_f(m_interpolation_f,access_location::host, access_mode::overwrite);
+        ArrayHandle<int3> h_miller(m_miller,access_location::host, access_mode::overwrite);
+        ArrayHandle<mesh_cpx> h_interlace_phase(m_interlace_phase, access_location::host, access_mode::overwrite);
+
+        // number of wave vectors stored along x
+        unsigned int n_kx = m_real_fft ? m_mesh_points.x/2+1 : m_mesh_points.x;
+        unsigned int local_dim[3] = {n_kx, m_mesh_points.y, m_mesh_points.z};
+        unsigned int proc_dim[3] = {pdim.x, pdim.y, pdim.z};
+        unsigned int proc_idx[3] = {pidx.x, pidx.y, pidx.z};
+        unsigned int mesh_dim[3] = {global_dim.x, global_dim.y, global_dim.z};
+
+        // Miller index, transform of the assignment function and interlacing phase along every axis
+        std::vector<int> miller[3];
+        std::vector<Scalar> assign_f[3];
+        std::vector<Scalar> shift_arg[3];
+        for (unsigned int axis = 0; axis < 3; ++axis)
+            {
+            miller[axis].resize(local_dim[axis]);
+            assign_f[axis].resize(local_dim[axis]);
+            shift_arg[axis].resize(local_dim[axis]);
 
-        int3 n = make_int3(wave_idx.x,wave_idx.y,wave_idx.z);
+            for (unsigned int i = 0; i < local_dim[axis]; ++i)
+                {
+                // the distributed FFT leaves the wave vectors in a cyclic distribution
+                int n = i*proc_dim[axis] + proc_idx[axis];
 
-        // compute Miller indices
-        if (n.x >= (int)(global_dim.x/2 + global_dim.x%2))
-            n.x -= (int) global_dim.x;
-        if (n.y >= (int)(global_dim.y/2 + global_dim.y%2))
-            n.y -= (int) global_dim.y;
-        if (n.z >= (int)(global_dim.z/2 + global_dim.z%2))
-            n.z -= (int) global_dim.z;
+                // compute Miller indices
+                if (n >= (int)(mesh_dim[axis]/2 + mesh_dim[axis]%2))
+                    n -= (int) mesh_dim[axis];
 
-        Scalar3 k = (Scalar)n.x*b1+(Scalar)n.y*b2+(Scalar)n.z*b3;
-        Scalar ksq = dot(k,k);
+                Scalar kH = Scalar(M_PI*2.0)*((Scalar)n/(Scalar)mesh_dim[axis]);
+                miller[axis][i] = n;
 
-        Scalar knorm = fast::sqrt(ksq);
+                // the transform of the B-spline is sinc(k h/2)^P
+                assign_f[axis][i] = assignFourier(Scalar(0.5)*kH);
+
+                // phase of a shift by half a cell, exp(-i k.h/2), which is ambiguous at the
+                // Nyquist frequency, where it is replaced by one to keep the transform hermitian
+                shift_arg[axis][i] = (2*abs(n) == (int)mesh_dim[axis]) ? Scalar(0.0) : Scalar(0.5)*kH;
+                }
+            }
 
-        Scalar val(1.0);
+        unsigned int n_rows = m_mesh_points.y*m_mesh_points.z;
 
-        if (m_use_table && knorm >= m_k_min && knorm < m_k_max)
+        #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+        for (int row = 0; row < (int) n_rows; ++row)
             {
-            Scalar value_f = (knorm - m_k_min) / m_delta_k;
+            // row major layout
+            unsigned int j = row % m_mesh_points.y;
+            unsigned int k = row / m_mesh_points.y;
 
-            unsigned int value_i = (unsigned int) value_f;
-            Scalar K0 = h_table.data[value_i];
-            Scalar K1 = h_table.data[value_i+1];
+            for (unsigned int i = 0; i < n_kx; ++i)
+                {
+                unsigned int cell_idx = row*n_kx + i;
 
-            // interpolate
-            Scalar f = value_f - Scalar(value_i);
+                h_miller.data[cell_idx] = make_int3(miller[0][i], miller[1][j], miller[2][k]);
+                h_interpolation_f.data[cell_idx] = assign_f[0][i]*assign_f[1][j]*assign_f[2][k];
 
-            val = K0 + f * (K1-K0);
+                if (m_interlace)
+                    {
+                    Scalar phase = shift_arg[0][i] + shift_arg[1][j] + shift_arg[2][k];
+                    h_interlace_phase.data[cell_idx].r = cos(phase);
+                    h_interlace_phase.data[cell_idx].i = -sin(phase);
+                    }
+                }
             }
+        }
 
-        h_inf_f.data[cell_idx] = val;
-        h_k.data[cell_idx] = k;
+    // evaluate the wave vectors and kernel for the current box
+    rescaleInfluenceFunction();
 
-        Scalar3 kH = Scalar(M_PI*2.0)*make_scalar3(n.x/global_dim.x, n.y/global_dim.y, n.z/global_dim.z);
-        h_interpolation_f.data[cell_idx] = assignTSCfourier(kH.x)*assignTSCfourier(kH.y)*assignTSCfourier(kH.z);
-        }
+    if (m_influence_cache_file.size())
+        writeInfluenceCache(cache_key);
 
     if (m_prof) m_prof->pop();
     }
 
-/*! \param x Distance on mesh in units of the mesh size
+//! Append the binary representation of a value to a string
+template<class T>
+static void appendBytes(std::string& s, const T& val)
+    {
+    s.append((const char *) &val, sizeof(T));
+    }
+
+//! Write the contents of an array to a stream
+template<class T>
+static void writeCacheArray(std::ostream& out, const GlobalArray<T>& array)
+    {
+    ArrayHandle<T> h_array(array, access_location::host, access_mode::read);
+    out.write((const char *) h_array.data, sizeof(T)*array.getNumElements());
+    }
+
+//! Read the contents of an array from a stream
+template<class T>
+static void readCacheArray(std::istream& in, const GlobalArray<T>& array)
+    {
+    ArrayHandle<T> h_array(array, access_location::host, access_mode::overwrite);
+    in.read((char *) h_array.data, sizeof(T)*array.getNumElements());
+    }
+
+/*! The key consists of everything the cached arrays depend on, in binary form. The
+    convolution kernel enters through a hash of its tables.
  */
-Scalar OrderParameterMesh::assignTSC(Scalar x)
+std::string OrderParameterMesh::getInfluenceCacheKey()
     {
-    Scalar xsq = x*x;
-    Scalar xabs = sqrt(xsq);
+    std::string key("OrderParameterMesh influence cache v2");
+    appendBytes(key, (unsigned int) sizeof(Scalar));
+    appendBytes(key, (unsigned int) sizeof(mesh_cpx));
+    appendBytes(key, m_mesh_points);
+    appendBytes(key, m_global_mesh_points);
+    appendBytes(key, m_n_fourier_cells);
+    appendBytes(key, m_real_fft);
+    appendBytes(key, m_order);
+    appendBytes(key, m_interlace);
 
-    if (xsq <= Scalar(1.0/4.0))
-        return Scalar(3.0/4.0) - xsq;
-    else if (xsq <= Scalar(9.0/4.0))
-        return Scalar(1.0/2.0)*(Scalar(3.0/2.0)-xabs)*(Scalar(3.0/2.0)-xabs);
-    else
-        return Scalar(0.0);
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        appendBytes(key, m_pdata->getDomainDecomposition()->getGridPos());
+    #endif
+
+    const BoxDim& global_box = m_pdata->getGlobalBox();
+    for (unsigned int i = 0; i < 3; ++i)
+        appendBytes(key, global_box.getLatticeVector(i));
+
+    appendBytes(key, m_use_table);
+    if (m_use_table)
+        {
+        // FNV-1a hash of the kernel tables
+        uint64_t hash = 14695981039346656037ULL;
+        ArrayHandle<Scalar> h_table(m_table, access_location::host, access_mode::read);
+        ArrayHandle<Scalar> h_table_d(m_table_d, access_location::host, access_mode::read);
+        const unsigned char *bytes[2] = {(const unsigned char *) h_table.data, (const unsigned char *) h_table_d.data};
+        size_t n_bytes[2] = {sizeof(Scalar)*m_table.getNumElements(), sizeof(Scalar)*m_table_d.getNumElements()};
+        for (unsigned int t = 0; t < 2; ++t)
+            for (size_t i = 0; i < n_bytes[t]; ++i)
+                {
+                hash ^= bytes[t][i];
+                hash *= 1099511628211ULL;
+                }
+
+        appendBytes(key, hash);
+        appendBytes(key, m_k_min);
+        appendBytes(key, m_k_max);
+        }
+
+    return key;
+    }
+
+//! Name of the influence function cache file of this rank
+static std::string getCacheFileName(const std::string& cache_file, std::shared_ptr<const ExecutionConfiguration> exec_conf)
+    {
+    std::ostringstream fname;
+    fname << cache_file;
+    #ifdef ENABLE_MPI
+    if (exec_conf->getNRanks() > 1)
+        fname << "." << exec_conf->getRank();
+    #endif
+    return fname.str();
     }
 
-Scalar OrderParameterMesh::assignTSCderiv(Scalar x)
+/*! \param key Key of the current configuration
+ */
+bool OrderParameterMesh::readInfluenceCache(const std::string& key)
     {
-    Scalar xsq = x*x;
-    Scalar xabs = copysignf(x,Scalar(1.0));
-    Scalar fac =(Scalar(3.0/2.0)-xabs);
+    std::string fname = getCacheFileName(m_influence_cache_file, m_exec_conf);
+    std::ifstream in(fname.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (! in.good())
+        return false;
+
+    unsigned int key_size = 0;
+    in.read((char *) &key_size, sizeof(unsigned int));
+    std::string file_key(key_size, '\0');
+    if (in.good() && key_size == key.size())
+        in.read(&file_key[0], key_size);
+
+    if (! in.good() || file_key != key)
+        {
+        m_exec_conf->msg->notice(3) << "cv.mesh: Influence function cache " << fname
+            << " does not match the current mesh, box or kernel" << std::endl;
+        return false;
+        }
 
-    Scalar ret(0.0);
-    if (xsq <= Scalar(1.0/4.0))
-        ret = -Scalar(2.0)*x;
-    else if (xsq <= Scalar(9.0/4.0))
-        ret = -fac*x/xabs;
+    readCacheArray(in, m_miller);
+    readCacheArray(in, m_interpolation_f);
+    readCacheArray(in, m_interlace_phase);
+    readCacheArray(in, m_k);
+    readCacheArray(in, m_knorm);
+    readCacheArray(in, m_inf_f);
+    readCacheArray(in, m_virial_kfac);
 
-    return ret;
+    if (! in.good())
+        {
+        m_exec_conf->msg->warning() << "cv.mesh: Influence function cache " << fname
+            << " is truncated, recomputing" << std::endl;
+        return false;
+        }
+
+    m_exec_conf->msg->notice(3) << "cv.mesh: Read influence function from " << fname << std::endl;
+    return true;
+    }
+
+/*! \param key Key of the current configuration
+ */
+void OrderParameterMesh::writeInfluenceCache(const std::string& key)
+    {
+    std::string fname = getCacheFileName(m_influence_cache_file, m_exec_conf);
+    std::ofstream out(fname.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+
+    unsigned int key_size = key.size();
+    out.write((const char *) &key_size, sizeof(unsigned int));
+    out.write(key.c_str(), key_size);
+
+    writeCacheArray(out, m_miller);
+    writeCacheArray(out, m_interpolation_f);
+    writeCacheArray(out, m_interlace_phase);
+    writeCacheArray(out, m_k);
+    writeCacheArray(out, m_knorm);
+    writeCacheArray(out, m_inf_f);
+    writeCacheArray(out, m_virial_kfac);
+
+    if (! out.good())
+        m_exec_conf->msg->warning() << "cv.mesh: Error writing influence function cache " << fname << std::endl;
     }
 
-/*! \param k Wave number, times mesh size
+/*! \param x Wave number times half the mesh size, k h/2
  */
-Scalar OrderParameterMesh::assignTSCfourier(Scalar x)
+Scalar OrderParameterMesh::assignFourier(Scalar x)
     {
     //! Coefficients of a power expansion of sin(x)/x
     const Scalar cpu_sinc_coeff[] = {Scalar(1.0), Scalar(-1.0/6.0), Scalar(1.0/120.0),
@@ -506,256 +990,758 @@ Scalar OrderParameterMesh::assignTSCfourier(Scalar x)
         sinc = sin(x)/x;
         }
 
-    // third order assigment function
-    return sinc*sinc*sinc;
+    // the B-spline of order m_order is the m_order-fold convolution of the nearest grid point function
+    Scalar ret(1.0);
+    for (unsigned int i = 0; i < m_order; ++i)
+        ret *= sinc;
+
+    return ret;
     }
 
 
-//! Assignment of particles to mesh using three-point scheme (triangular shaped cloud)
-/*! This is a second order accurate scheme with continuous value and continuous derivative
+/*! \param box The local box
+    \param pos The particle position
+    \param cell Output index of the cell the particle is in, including the ghost cell offset
+    \param shift Output distance of the particle from the cell center, in units of the mesh size
  */
-void OrderParameterMesh::assignParticles()
+void OrderParameterMesh::computeParticleCell(const BoxDim& box, const Scalar3& pos, int3& cell, Scalar3& shift) const
     {
-    if (m_prof) m_prof->push("assign");
+    // compute coordinates in units of the mesh size
+    Scalar3 f = box.makeFraction(pos);
+    Scalar3 reduced_pos = make_scalar3(f.x * (Scalar) m_mesh_points.x,
+                                       f.y * (Scalar) m_mesh_points.y,
+                                       f.z * (Scalar) m_mesh_points.z);
+
+    reduced_pos += make_scalar3(m_n_ghost_cells.x, m_n_ghost_cells.y, m_n_ghost_cells.z);
+
+    // find cell the particle is in (rounding downwards)
+    int ix = reduced_pos.x;
+    int iy = reduced_pos.y;
+    int iz = reduced_pos.z;
+
+    // handle particles on the boundary
+    if (ix == (int)m_grid_dim.x && !m_n_ghost_cells.x)
+        ix = 0;
+    if (iy == (int)m_grid_dim.y && !m_n_ghost_cells.y)
+        iy = 0;
+    if (iz == (int)m_grid_dim.z && !m_n_ghost_cells.z)
+        iz = 0;
+
+    cell = make_int3(ix, iy, iz);
+
+    // compute distance between particle and cell center
+    // in fractional coordinates
+    Scalar3 cell_center = make_scalar3((Scalar)(ix-(int)m_n_ghost_cells.x)+Scalar(0.5),
+                         (Scalar)(iy-(int)m_n_ghost_cells.y)+Scalar(0.5),
+                         (Scalar)(iz-(int)m_n_ghost_cells.z)+Scalar(0.5));
+
+    // compute minimum image separation to center
+    Scalar3 c_cart = box.makeCoordinates(cell_center/make_scalar3(m_mesh_points.x,m_mesh_points.y,m_mesh_points.z));
+    Scalar3 shift_cart = box.minImage(pos-c_cart);
+    Scalar3 shift_f = box.makeFraction(shift_cart+box.getLo());
+    shift = shift_f*make_scalar3(m_mesh_points.x,m_mesh_points.y,m_mesh_points.z);
+    }
 
-    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
-    ArrayHandle<kiss_fft_cpx> h_mesh(m_mesh, access_location::host, access_mode::overwrite);
-    ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
+void OrderParameterMesh::computeParticleCells()
+    {
+    unsigned int nparticles = m_pdata->getN();
 
-    const BoxDim& box = m_pdata->getBox();
+    if (m_particle_cell.getNumElements() < nparticles)
+        {
+        GlobalArray<int3> particle_cell(nparticles, m_exec_conf);
+        m_particle_cell.swap(particle_cell);
 
-    // set mesh to zero
-    memset(h_mesh.data, 0, sizeof(kiss_fft_cpx)*m_mesh.getNumElements());
+        GlobalArray<Scalar3> particle_shift(nparticles, m_exec_conf);
+        m_particle_shift.swap(particle_shift);
+        }
 
-    unsigned int nparticles = m_pdata->getN();
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::overwrite);
+    ArrayHandle<Scalar3> h_particle_shift(m_particle_shift, access_location::host, access_mode::overwrite);
 
-    m_mode_sq = 0.0;
+    const BoxDim& box = m_pdata->getBox();
 
-    // loop over local particles
-    for (unsigned int idx = 0; idx < nparticles; ++idx)
+    #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+    for (int idx = 0; idx < (int) nparticles; ++idx)
         {
         Scalar4 postype = h_postype.data[idx];
-
         Scalar3 pos = make_scalar3(postype.x, postype.y, postype.z);
-        unsigned int type = __scalar_as_int(postype.w);
+        computeParticleCell(box, pos, h_particle_cell.data[idx], h_particle_shift.data[idx]);
+        }
+    }
 
-        // compute coordinates in units of the mesh size
-        Scalar3 f = box.makeFraction(pos);
-        Scalar3 reduced_pos = make_scalar3(f.x * (Scalar) m_mesh_points.x,
-                                           f.y * (Scalar) m_mesh_points.y,
-                                           f.z * (Scalar) m_mesh_points.z);
-
-        reduced_pos += make_scalar3(m_n_ghost_cells.x, m_n_ghost_cells.y, m_n_ghost_cells.z);
-
-        // find cell the particle is in (rounding downwards)
-        int ix = reduced_pos.x;
-        int iy = reduced_pos.y;
-        int iz = reduced_pos.z;
-
-        // handle particles on the boundary
-        if (ix == (int)m_grid_dim.x && !m_n_ghost_cells.x)
-            ix = 0;
-        if (iy == (int)m_grid_dim.y && !m_n_ghost_cells.y)
-            iy = 0;
-        if (iz == (int)m_grid_dim.z && !m_n_ghost_cells.z)
-            iz = 0;
-
-        // compute distance between particle and cell center
-        // in fractional coordinates
-        Scalar3 cell_center = make_scalar3((Scalar)(ix-(int)m_n_ghost_cells.x)+Scalar(0.5),
-                             (Scalar)(iy-(int)m_n_ghost_cells.y)+Scalar(0.5),
-                             (Scalar)(iz-(int)m_n_ghost_cells.z)+Scalar(0.5));
-
-        // compute minimum image separation to center
-        Scalar3 c_cart = box.makeCoordinates(cell_center/make_scalar3(m_mesh_points.x,m_mesh_points.y,m_mesh_points.z));
-        Scalar3 shift_cart = box.minImage(pos-c_cart);
-        Scalar3 shift_f = box.makeFraction(shift_cart+box.getLo());
-        Scalar3 shift = shift_f*make_scalar3(m_mesh_points.x,m_mesh_points.y,m_mesh_points.z);
-
-        // assign particle to cell and next neighbors
-        for (int i = -1; i <= 1 ; ++i)
-            for (int j = -1; j <= 1; ++j)
-                for (int k = -1; k <= 1; ++k)
-                    {
-                    int neighi = (int)ix + i;
-                    int neighj = (int)iy + j;
-                    int neighk = (int)iz + k;
-
-                    if (! m_n_ghost_cells.x)
-                        {
-                        if (neighi == (int) m_grid_dim.x)
-                            neighi = 0;
-                        else if (neighi < 0)
-                            neighi += m_grid_dim.x;
-                        }
-                    assert(neighi >= 0 && neighi < (int) m_grid_dim.x);
-
-                    if (! m_n_ghost_cells.y)
-                        {
-                        if (neighj == (int) m_grid_dim.y)
-                            neighj = 0;
-                        else if (neighj < 0)
-                            neighj += m_grid_dim.y;
-                        }
-                    assert(neighj >= 0 && neighj < (int) m_grid_dim.y);
-
-                    if (! m_n_ghost_cells.z)
-                        {
-                        if (neighk == (int) m_grid_dim.z)
-                            neighk = 0;
-                        else if (neighk < 0)
-                            neighk += m_grid_dim.z;
-                        }
-                    assert(neighk >= 0 && neighk < (int) m_grid_dim.z);
-
-                    Scalar3 dx_frac = shift - make_scalar3(i,j,k);
-
-                    // compute fraction of particle density assigned to cell
-                    Scalar density_fraction = assignTSC(dx_frac.x)*assignTSC(dx_frac.y)*assignTSC(dx_frac.z);
-                    unsigned int neigh_idx;
-
-                    // store in row major order
-                    neigh_idx = neighi + m_grid_dim.x * (neighj + m_grid_dim.y*neighk);
-
-                    h_mesh.data[neigh_idx].r += h_mode.data[type]*density_fraction;
-                    }
+/*! Computes a permutation of the local particles in the order of their mesh
+    cells with a counting sort, so that the scattered accesses to the mesh during
+    assignment and interpolation are close in memory. The particle data itself is
+    left untouched.
 
-        m_mode_sq += h_mode.data[type]*h_mode.data[type];
-        }  // end of loop over particles
+    Between sorts, the previous permutation is reused as long as the particles have
+    not been reordered, since it only affects the order of traversal.
+ */
+void OrderParameterMesh::updateSortOrder()
+    {
+    unsigned int nparticles = m_pdata->getN();
 
-    #ifdef ENABLE_MPI
-    if (m_pdata->getDomainDecomposition())
+    if (m_sort_order.getNumElements() != nparticles)
         {
-        // reduce sum
-        MPI_Allreduce(MPI_IN_PLACE,
-                      &m_mode_sq,
-                      1,
-                      MPI_HOOMD_SCALAR,
-                      MPI_SUM,
-                      m_exec_conf->getMPICommunicator());
+        GlobalArray<unsigned int> sort_order(nparticles, m_exec_conf);
+        m_sort_order.swap(sort_order);
+        m_sort_valid = false;
         }
-    #endif
+
+    if (m_sort_valid && ++m_sort_age < m_sort_period)
+        return;
+
+    if (m_prof) m_prof->push("sort");
+
+    if (m_sort_cell_offsets.getNumElements() != m_n_cells+1)
+        {
+        GlobalArray<unsigned int> sort_cell_offsets(m_n_cells+1, m_exec_conf);
+        m_sort_cell_offsets.swap(sort_cell_offsets);
+        }
+
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+    ArrayHandle<unsigned int> h_sort_order(m_sort_order, access_location::host, access_mode::overwrite);
+    ArrayHandle<unsigned int> h_sort_cell_offsets(m_sort_cell_offsets, access_location::host, access_mode::overwrite);
+
+    // histogram of particles per cell
+    memset(h_sort_cell_offsets.data, 0, sizeof(unsigned int)*(m_n_cells+1));
+    for (unsigned int idx = 0; idx < nparticles; ++idx)
+        {
+        int3 cell = h_particle_cell.data[idx];
+        unsigned int cell_idx = cell.x + m_grid_dim.x*(cell.y + m_grid_dim.y*cell.z);
+        h_sort_cell_offsets.data[cell_idx+1]++;
+        }
+
+    // exclusive prefix sum
+    for (unsigned int cell_idx = 0; cell_idx < m_n_cells; ++cell_idx)
+        h_sort_cell_offsets.data[cell_idx+1] += h_sort_cell_offsets.data[cell_idx];
+
+    // scatter particle indices
+    for (unsigned int idx = 0; idx < nparticles; ++idx)
+        {
+        int3 cell = h_particle_cell.data[idx];
+        unsigned int cell_idx = cell.x + m_grid_dim.x*(cell.y + m_grid_dim.y*cell.z);
+        h_sort_order.data[h_sort_cell_offsets.data[cell_idx]++] = idx;
+        }
+
+    m_sort_valid = true;
+    m_sort_age = 0;
 
     if (m_prof) m_prof->pop();
     }
 
-void OrderParameterMesh::updateMeshes()
+#ifdef ENABLE_MPI
+/*! \param order Local particle indices in the order of traversal (NULL for index order)
+
+    The particles are partitioned into m_overlap_order, preserving their order within
+    both parts, so that the ghost cell exchange of the mesh can be overlapped with the
+    particles that do not contribute to the ghost layer.
+ */
+unsigned int OrderParameterMesh::computeOverlapOrder(const unsigned int *order)
     {
+    unsigned int nparticles = m_pdata->getN();
 
-    ArrayHandle<Scalar> h_inf_f(m_inf_f, access_location::host, access_mode::read);
-    ArrayHandle<Scalar3> h_k(m_k, access_location::host, access_mode::read);
+    if (m_overlap_order.getNumElements() < nparticles)
+        {
+        GlobalArray<unsigned int> overlap_order(nparticles, m_exec_conf);
+        m_overlap_order.swap(overlap_order);
+        }
 
-    if (m_kiss_fft_initialized)
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+    ArrayHandle<unsigned int> h_overlap_order(m_overlap_order, access_location::host, access_mode::overwrite);
+
+    unsigned int n_boundary = 0;
+    for (unsigned int i = 0; i < nparticles; ++i)
         {
-        if (m_prof) m_prof->push("FFT");
-        // transform the particle mesh locally (forward transform)
-        ArrayHandle<kiss_fft_cpx> h_mesh(m_mesh, access_location::host, access_mode::read);
-        ArrayHandle<kiss_fft_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::overwrite);
+        unsigned int idx = order ? order[i] : i;
+        if (isBoundaryCell(h_particle_cell.data[idx]))
+            h_overlap_order.data[n_boundary++] = idx;
+        }
 
-        kiss_fftnd(m_kiss_fft, h_mesh.data, h_fourier_mesh.data);
-        if (m_prof) m_prof->pop();
+    unsigned int n = n_boundary;
+    for (unsigned int i = 0; i < nparticles; ++i)
+        {
+        unsigned int idx = order ? order[i] : i;
+        if (! isBoundaryCell(h_particle_cell.data[idx]))
+            h_overlap_order.data[n++] = idx;
         }
 
-    #ifdef ENABLE_MPI
-    if (m_pdata->getDomainDecomposition())
+    m_n_boundary = n_boundary;
+    return n_boundary;
+    }
+#endif
+
+/*! \param mesh The mesh to accumulate into
+    \param stride Distance between consecutive mesh points in units of mesh_scalar
+    \param cell Index of the cell the particle is in
+    \param shift Distance of the particle from the cell center
+    \param mode Mode amplitude of the particle
+ */
+void OrderParameterMesh::assignParticle(mesh_scalar *mesh, unsigned int stride,
+    const int3& cell, const Scalar3& shift, Scalar mode) const
+    {
+    // per-axis weights of the m_order nearest mesh points
+    Scalar wx[max_order], wy[max_order], wz[max_order];
+    int ox = computeAssignmentWeights(shift.x, wx, NULL);
+    int oy = computeAssignmentWeights(shift.y, wy, NULL);
+
+    // wrapped mesh indices along every axis
+    int ni[max_order], nj[max_order], nk[max_order];
+    computeStencilIndices(cell.x+ox, m_grid_dim.x, !m_n_ghost_cells.x, ni);
+    computeStencilIndices(cell.y+oy, m_grid_dim.y, !m_n_ghost_cells.y, nj);
+    int order_z = computeStencilZ(cell, shift.z, wz, NULL, nk);
+
+    // assign particle to cell and next neighbors, as a tensor product of the weights
+    int order = m_order;
+    for (int k = 0; k < order_z; ++k)
         {
-        // update inner cells of particle mesh
-        if (m_prof) m_prof->push("ghost cell update");
-        m_exec_conf->msg->notice(8) << "cv.mesh: Ghost cell update" << std::endl;
-        m_grid_comm_forward->communicate(m_mesh);
-        if (m_prof) m_prof->pop();
+        mesh_scalar wk = mode*wz[k];
+        for (int j = 0; j < order; ++j)
+            {
+            mesh_scalar wjk = wk*wy[j];
 
-        // perform a distributed FFT
-        m_exec_conf->msg->notice(8) << "cv.mesh: Distributed FFT mesh" << std::endl;
+            // store in row major order
+            unsigned int row = m_grid_dim.x * (nj[j] + m_grid_dim.y*nk[k]);
 
-        if (m_prof) m_prof->push("FFT");
-        ArrayHandle<kiss_fft_cpx> h_mesh(m_mesh, access_location::host, access_mode::read);
-        ArrayHandle<kiss_fft_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::overwrite);
+            for (int i = 0; i < order; ++i)
+                mesh[stride*(row + ni[i])] += wjk*(mesh_scalar)wx[i];
+            }
+        }
+    }
 
-        dfft_execute((cpx_t *)(h_mesh.data+m_ghost_offset), (cpx_t *)h_fourier_mesh.data, 0,m_dfft_plan_forward);
-        if (m_prof) m_prof->pop();
+/*! The mesh is cut into an even number of chunks along z, each at least as wide
+    as the assignment stencil.
+    The local particles are sorted by chunk into m_slab_particles, preserving the
+    cell order within every chunk, and m_slab_offsets holds the start of every chunk.
+ */
+unsigned int OrderParameterMesh::computeSlabChunks()
+    {
+    ArrayHandle<unsigned int> h_sort_order(m_sort_order, access_location::host, access_mode::read);
+    const unsigned int *order = m_sort_period > 0 ? h_sort_order.data : NULL;
+
+    return computeSlabChunks(order, m_pdata->getN());
+    }
+
+unsigned int OrderParameterMesh::computeSlabChunks(const unsigned int *order, unsigned int nparticles)
+    {
+    unsigned int n_chunks = 2*m_num_threads;
+    unsigned int chunk_width = m_grid_dim.z/n_chunks;
+
+    if (m_slab_offsets.getNumElements() < n_chunks+1)
+        {
+        GlobalArray<unsigned int> slab_offsets(n_chunks+1, m_exec_conf);
+        m_slab_offsets.swap(slab_offsets);
         }
-    #endif
 
-    ArrayHandle<kiss_fft_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::readwrite);
+    if (m_slab_particles.getNumElements() < nparticles)
+        {
+        GlobalArray<unsigned int> slab_particles(nparticles, m_exec_conf);
+        m_slab_particles.swap(slab_particles);
+        }
 
-    unsigned int N_global = m_pdata->getNGlobal();
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+    ArrayHandle<unsigned int> h_slab_offsets(m_slab_offsets, access_location::host, access_mode::overwrite);
+    ArrayHandle<unsigned int> h_slab_particles(m_slab_particles, access_location::host, access_mode::overwrite);
+
+    // stable counting sort of the particles by chunk
+    memset(h_slab_offsets.data, 0, sizeof(unsigned int)*(n_chunks+1));
+    for (unsigned int i = 0; i < nparticles; ++i)
+        {
+        // the last chunk takes up the remaining slabs
+        unsigned int idx = order ? order[i] : i;
+        unsigned int chunk = std::min(h_particle_cell.data[idx].z/chunk_width, n_chunks-1);
+        h_slab_offsets.data[chunk+1]++;
+        }
+
+    for (unsigned int chunk = 0; chunk < n_chunks; ++chunk)
+        h_slab_offsets.data[chunk+1] += h_slab_offsets.data[chunk];
 
+    for (unsigned int i = 0; i < nparticles; ++i)
         {
-        ArrayHandle<kiss_fft_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::overwrite);
-        ArrayHandle<Scalar> h_interpolation_f(m_interpolation_f, access_location::host, access_mode::read);
+        // preserve the cell order within every chunk
+        unsigned int idx = order ? order[i] : i;
+        unsigned int chunk = std::min(h_particle_cell.data[idx].z/chunk_width, n_chunks-1);
+        h_slab_particles.data[h_slab_offsets.data[chunk]++] = idx;
+        }
+
+    // restore the chunk offsets
+    for (unsigned int chunk = n_chunks; chunk > 0; --chunk)
+        h_slab_offsets.data[chunk] = h_slab_offsets.data[chunk-1];
+    h_slab_offsets.data[0] = 0;
+
+    return n_chunks;
+    }
+
+/*! Since a particle only touches the slabs next to its own, no two chunks
+    of equal parity write to the same mesh points and can be processed concurrently.
+
+    Every chunk is processed by a single thread in the order of the particle indices.
+    Since there are 2*m_num_threads chunks, the order of the summation and hence the
+    result are bitwise reproducible for a fixed number of threads. On the shifted mesh,
+    a particle reaches at most one slab further down, which the chunk width allows for.
+ */
+void OrderParameterMesh::assignParticlesSlabs(mesh_scalar *mesh, unsigned int stride, bool shifted,
+    const unsigned int *order, unsigned int n)
+    {
+    unsigned int n_chunks = computeSlabChunks(order, n);
 
-        // multiply with influence function
-        for (unsigned int k = 0; k < m_n_inner_cells; ++k)
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+    ArrayHandle<Scalar3> h_particle_shift(m_particle_shift, access_location::host, access_mode::read);
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
+    ArrayHandle<unsigned int> h_slab_offsets(m_slab_offsets, access_location::host, access_mode::read);
+    ArrayHandle<unsigned int> h_slab_particles(m_slab_particles, access_location::host, access_mode::read);
+
+    // process even, then odd chunks
+    for (unsigned int parity = 0; parity < 2; ++parity)
+        {
+        #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+        for (int chunk = parity; chunk < (int) n_chunks; chunk += 2)
             {
-            kiss_fft_cpx f = h_fourier_mesh.data[k];
+            for (unsigned int i = h_slab_offsets.data[chunk]; i < h_slab_offsets.data[chunk+1]; ++i)
+                {
+                unsigned int idx = h_slab_particles.data[i];
+                unsigned int type = __scalar_as_int(h_postype.data[idx].w);
 
-            // normalization
-            f.r /= (Scalar) N_global;
-            f.i /= (Scalar) N_global;
+                int3 cell = h_particle_cell.data[idx];
+                Scalar3 shift = h_particle_shift.data[idx];
+                if (shifted)
+                    computeShiftedCell(cell, shift);
 
-            Scalar val = f.r*f.r+f.i*f.i;
+                assignParticle(mesh, stride, cell, shift, h_mode.data[type]);
+                }
+            }
+        }
+    }
 
-            h_fourier_mesh_G.data[k].r = f.r * val;
-            h_fourier_mesh_G.data[k].i = f.i * val;
+/*! Every thread assigns a contiguous range of particles to its own mesh. The
+    meshes are summed up afterwards in the order of the threads, which makes
+    the result reproducible for a given number of threads.
+ */
+void OrderParameterMesh::assignParticlesPrivate(mesh_scalar *mesh, unsigned int stride, bool shifted,
+    const unsigned int *order, unsigned int nparticles)
+    {
 
-            Scalar diagonal_term = Scalar(0.5)*h_interpolation_f.data[k]*h_interpolation_f.data[k]*m_mode_sq/(Scalar)N_global/(Scalar)N_global;
+    // the first thread accumulates directly into the mesh
+    unsigned int n_private = m_num_threads-1;
+    if (m_thread_mesh.getNumElements() < n_private*m_n_cells)
+        {
+        GlobalArray<mesh_scalar> thread_mesh(n_private*m_n_cells, m_exec_conf);
+        m_thread_mesh.swap(thread_mesh);
+        }
 
-            h_fourier_mesh_G.data[k].r -= f.r * diagonal_term;
-            h_fourier_mesh_G.data[k].i -= f.i * diagonal_term;
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+    ArrayHandle<Scalar3> h_particle_shift(m_particle_shift, access_location::host, access_mode::read);
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
+    ArrayHandle<mesh_scalar> h_thread_mesh(m_thread_mesh, access_location::host, access_mode::overwrite);
 
-            h_fourier_mesh.data[k] = f;
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
+        {
+        mesh_scalar *thread_mesh = mesh;
+        unsigned int thread_stride = stride;
+        if (thread > 0)
+            {
+            thread_mesh = h_thread_mesh.data + (thread-1)*m_n_cells;
+            thread_stride = 1;
+            memset(thread_mesh, 0, sizeof(mesh_scalar)*m_n_cells);
             }
+
+        unsigned int start = (unsigned long)nparticles*thread/m_num_threads;
+        unsigned int end = (unsigned long)nparticles*(thread+1)/m_num_threads;
+        for (unsigned int i = start; i < end; ++i)
+            {
+            unsigned int idx = order ? order[i] : i;
+            unsigned int type = __scalar_as_int(h_postype.data[idx].w);
+
+            int3 cell = h_particle_cell.data[idx];
+            Scalar3 shift = h_particle_shift.data[idx];
+            if (shifted)
+                computeShiftedCell(cell, shift);
+
+            assignParticle(thread_mesh, thread_stride, cell, shift, h_mode.data[type]);
+            }
+        }
+
+    // reduce the private meshes
+    #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+    for (int cell_idx = 0; cell_idx < (int) m_n_cells; ++cell_idx)
+        {
+        Scalar sum = mesh[stride*cell_idx];
+        for (unsigned int thread = 0; thread < n_private; ++thread)
+            sum += h_thread_mesh.data[thread*m_n_cells + cell_idx];
+        mesh[stride*cell_idx] = sum;
+        }
+    }
+
+/*! \param mesh The mesh to accumulate into
+    \param stride Distance between consecutive mesh points in units of mesh_scalar
+    \param shifted True if the particles are assigned to the mesh shifted by half a cell
+    \param order Local particle indices in the order of traversal (NULL for all particles in index order)
+    \param n Number of particles to assign
+
+    With more than one host thread, threads either work on non-adjacent slabs of the mesh,
+    if there are enough of them, or on private copies of the mesh.
+    The particles are added to the current contents of the mesh.
+ */
+void OrderParameterMesh::assignParticlesMesh(mesh_scalar *mesh, unsigned int stride, bool shifted,
+    const unsigned int *order, unsigned int n)
+    {
+    if (canAssignSlabs())
+        {
+        assignParticlesSlabs(mesh, stride, shifted, order, n);
+        }
+    else if (m_num_threads > 1)
+        {
+        assignParticlesPrivate(mesh, stride, shifted, order, n);
         }
+    else
+        {
+        ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+        ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
+        ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+        ArrayHandle<Scalar3> h_particle_shift(m_particle_shift, access_location::host, access_mode::read);
+
+        // loop over local particles
+        for (unsigned int i = 0; i < n; ++i)
+            {
+            unsigned int idx = order ? order[i] : i;
+            unsigned int type = __scalar_as_int(h_postype.data[idx].w);
+
+            int3 cell = h_particle_cell.data[idx];
+            Scalar3 shift = h_particle_shift.data[idx];
+            if (shifted)
+                computeShiftedCell(cell, shift);
+
+            assignParticle(mesh, stride, cell, shift, h_mode.data[type]);
+            }  // end of loop over particles
+        }
+    }
+
+//! Assignment of particles to mesh using B-splines (the triangular shaped cloud by default)
+/*! The TSC scheme is second order accurate with continuous value and continuous derivative
+
+    With a decomposed mesh, the particles whose stencil reaches into the ghost layer are
+    assigned first. The ghost cells are then sent to the neighboring ranks while the
+    remaining particles are assigned, and the contributions of the neighbors are added
+    to the inner cells afterwards.
+ */
+void OrderParameterMesh::assignParticles()
+    {
+    if (m_prof) m_prof->push("assign");
+
+    computeParticleCells();
+
+    if (m_sort_period)
+        updateSortOrder();
+
+    unsigned int nparticles = m_pdata->getN();
+
+        {
+        ArrayHandle<unsigned int> h_sort_order(m_sort_order, access_location::host, access_mode::read);
+        const unsigned int *order = m_sort_period ? h_sort_order.data : NULL;
+
+        // number of particles to assign before the ghost cells are sent
+        unsigned int n_boundary = nparticles;
+
+        #ifdef ENABLE_MPI
+        bool overlap = m_pdata->getDomainDecomposition() != nullptr;
+        if (overlap)
+            n_boundary = computeOverlapOrder(order);
+        ArrayHandle<unsigned int> h_overlap_order(m_overlap_order, access_location::host, access_mode::read);
+        if (overlap)
+            order = h_overlap_order.data;
+        #endif
+
+        unsigned int n_meshes = m_interlace ? 2 : 1;
+        for (unsigned int i = 0; i < n_meshes; ++i)
+            {
+            bool shifted = i > 0;
+            ArrayHandle<mesh_cpx> h_mesh(shifted ? m_shifted_mesh : m_mesh, access_location::host, access_mode::overwrite);
+            ArrayHandle<mesh_scalar> h_real_mesh(shifted ? m_real_shifted_mesh : m_real_mesh,
+                access_location::host, access_mode::overwrite);
+
+            // the density is accumulated into the real part of the mesh
+            mesh_scalar *mesh = m_real_fft ? h_real_mesh.data : &h_mesh.data[0].r;
+            unsigned int stride = m_real_fft ? 1 : 2;
+
+            // set mesh to zero
+            memset(mesh, 0, sizeof(mesh_scalar)*stride*m_n_cells);
+
+            assignParticlesMesh(mesh, stride, shifted, order, n_boundary);
+
+            #ifdef ENABLE_MPI
+            if (overlap)
+                {
+                // update inner cells of particle mesh while the interior particles are assigned
+                m_exec_conf->msg->notice(8) << "cv.mesh: Ghost cell update" << std::endl;
+                m_grid_comm_forward->begin(h_mesh.data);
+
+                assignParticlesMesh(mesh, stride, shifted, order + n_boundary, nparticles - n_boundary);
+
+                if (m_prof) m_prof->push("ghost cell update");
+                m_grid_comm_forward->finish(h_mesh.data);
+                if (m_prof) m_prof->pop();
+                }
+            #endif
+            }
+        }
+
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
+
+    m_mode_sq = 0.0;
+    for (unsigned int idx = 0; idx < nparticles; ++idx)
+        {
+        unsigned int type = __scalar_as_int(h_postype.data[idx].w);
+        m_mode_sq += h_mode.data[type]*h_mode.data[type];
+        }
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        // reduce sum
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &m_mode_sq,
+                      1,
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
+        }
+    #endif
 
     if (m_prof) m_prof->pop();
+    }
 
-    if (m_kiss_fft_initialized)
+/*! \param mesh The density mesh (complex FFT)
+    \param real_mesh The density mesh (real-to-complex FFT)
+    \param fourier_mesh Output transformed mesh
+ */
+void OrderParameterMesh::forwardTransform(const GlobalArray<mesh_cpx>& mesh, const GlobalArray<mesh_scalar>& real_mesh,
+    const GlobalArray<mesh_cpx>& fourier_mesh)
+    {
+    if (m_local_fft)
         {
         if (m_prof) m_prof->push("FFT");
-        // do a local inverse transform of the force mesh
-        ArrayHandle<kiss_fft_cpx> h_inv_fourier_mesh(m_inv_fourier_mesh, access_location::host, access_mode::overwrite);
-        ArrayHandle<kiss_fft_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::read);
-        kiss_fftnd(m_kiss_ifft, h_fourier_mesh_G.data, h_inv_fourier_mesh.data);
+        // transform the particle mesh locally (forward transform)
+        ArrayHandle<mesh_cpx> h_fourier_mesh(fourier_mesh, access_location::host, access_mode::overwrite);
+
+        if (m_real_fft)
+            {
+            ArrayHandle<mesh_scalar> h_real_mesh(real_mesh, access_location::host, access_mode::read);
+            m_local_fft->forward(h_real_mesh.data, h_fourier_mesh.data);
+            }
+        else
+            {
+            ArrayHandle<mesh_cpx> h_mesh(mesh, access_location::host, access_mode::read);
+            m_local_fft->forward(h_mesh.data, h_fourier_mesh.data);
+            }
         if (m_prof) m_prof->pop();
         }
 
     #ifdef ENABLE_MPI
     if (m_pdata->getDomainDecomposition())
         {
+        // the inner cells have been updated with the ghost cells of the neighbors during assignment
+
+        // perform a distributed FFT
+        m_exec_conf->msg->notice(8) << "cv.mesh: Distributed FFT mesh" << std::endl;
+
         if (m_prof) m_prof->push("FFT");
-        // Distributed inverse transform force on mesh points
-        m_exec_conf->msg->notice(8) << "cv.mesh: Distributed iFFT" << std::endl;
+        ArrayHandle<mesh_cpx> h_mesh(mesh, access_location::host, access_mode::read);
+        ArrayHandle<mesh_cpx> h_fourier_mesh(fourier_mesh, access_location::host, access_mode::overwrite);
 
-        ArrayHandle<kiss_fft_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::read);
-        ArrayHandle<kiss_fft_cpx> h_inv_fourier_mesh(m_inv_fourier_mesh, access_location::host, access_mode::overwrite);
-        dfft_execute((cpx_t *)h_fourier_mesh_G.data, (cpx_t *)(h_inv_fourier_mesh.data+m_ghost_offset), 1,m_dfft_plan_inverse);
+        executeDistributedFFT(h_mesh.data, h_fourier_mesh.data, false);
         if (m_prof) m_prof->pop();
         }
     #endif
+    }
+
+/*! \param fourier_mesh The transformed force mesh
+    \param inv_mesh Output force mesh (complex FFT)
+    \param real_inv_mesh Output force mesh (complex-to-real FFT)
+    \param shifted True for the force mesh on the shifted mesh points
+
+    With a decomposed mesh, the update of the ghost cells is only started here
+    and completed by interpolateForces().
+ */
+void OrderParameterMesh::inverseTransform(const GlobalArray<mesh_cpx>& fourier_mesh, const GlobalArray<mesh_cpx>& inv_mesh,
+    const GlobalArray<mesh_scalar>& real_inv_mesh, bool shifted)
+    {
+    if (m_local_fft)
+        {
+        if (m_prof) m_prof->push("FFT");
+        // do a local inverse transform of the force mesh
+        ArrayHandle<mesh_cpx> h_fourier_mesh(fourier_mesh, access_location::host, access_mode::read);
+
+        if (m_real_fft)
+            {
+            ArrayHandle<mesh_scalar> h_real_inv_mesh(real_inv_mesh, access_location::host, access_mode::overwrite);
+            m_local_fft->inverse(h_fourier_mesh.data, h_real_inv_mesh.data);
+            }
+        else
+            {
+            ArrayHandle<mesh_cpx> h_inv_mesh(inv_mesh, access_location::host, access_mode::overwrite);
+            m_local_fft->inverse(h_fourier_mesh.data, h_inv_mesh.data);
+            }
+        if (m_prof) m_prof->pop();
+        }
 
     #ifdef ENABLE_MPI
     if (m_pdata->getDomainDecomposition())
         {
-        // update outer cells of force mesh using ghost cells from neighboring processors
-        if (m_prof) m_prof->push("ghost cell update");
-        m_exec_conf->msg->notice(8) << "cv.mesh: Ghost cell update" << std::endl;
-        m_grid_comm_reverse->communicate(m_inv_fourier_mesh);
+        CommunicatorGridAsync<mesh_cpx> *comm = shifted ? m_shifted_grid_comm_reverse.get() : m_grid_comm_reverse.get();
+
+        ArrayHandle<mesh_cpx> h_fourier_mesh(fourier_mesh, access_location::host, access_mode::read);
+        ArrayHandle<mesh_cpx> h_inv_mesh(inv_mesh, access_location::host, access_mode::readwrite);
+
+        // complete the exchange of a previous step whose forces were not needed
+        comm->finish(h_inv_mesh.data);
+
+        if (m_prof) m_prof->push("FFT");
+        // Distributed inverse transform force on mesh points
+        m_exec_conf->msg->notice(8) << "cv.mesh: Distributed iFFT" << std::endl;
+        executeDistributedFFT(h_fourier_mesh.data, h_inv_mesh.data, true);
         if (m_prof) m_prof->pop();
+
+        // start updating the outer cells of the force mesh using ghost cells from neighboring processors,
+        // the update is completed when the forces are interpolated
+        m_exec_conf->msg->notice(8) << "cv.mesh: Ghost cell update" << std::endl;
+        comm->begin(h_inv_mesh.data);
         }
     #endif
     }
 
+#ifdef ENABLE_MPI
+/*! The real space mesh is the local mesh including the ghost layer, of which
+    only the inner cells are transformed.
+
+    In mixed precision, the meshes are converted to and from Scalar precision,
+    in which the distributed FFT operates.
+ */
+void OrderParameterMesh::executeDistributedFFT(const mesh_cpx *in, mesh_cpx *out, bool inverse)
+    {
+    if (m_gather_fft)
+        {
+        if (inverse)
+            m_gather_fft->inverse(in, out+m_ghost_offset);
+        else
+            m_gather_fft->forward(in+m_ghost_offset, out);
+        return;
+        }
+
+    #ifdef MESH_MIXED_PRECISION
+    ArrayHandle<kiss_fft_cpx> h_dfft_in(m_dfft_in, access_location::host, access_mode::overwrite);
+    ArrayHandle<kiss_fft_cpx> h_dfft_out(m_dfft_out, access_location::host, access_mode::overwrite);
+
+    unsigned int n_inner_cells = m_mesh_points.x*m_mesh_points.y*m_mesh_points.z;
+    convertMesh(in, h_dfft_in.data, inverse ? n_inner_cells : m_n_cells);
+
+    if (inverse)
+        dfft_execute((cpx_t *)h_dfft_in.data, (cpx_t *)(h_dfft_out.data+m_ghost_offset), 1, m_dfft_plan_inverse);
+    else
+        dfft_execute((cpx_t *)(h_dfft_in.data+m_ghost_offset), (cpx_t *)h_dfft_out.data, 0, m_dfft_plan_forward);
+
+    // the ghost layer of the inverse transform is filled by the ghost cell exchange
+    convertMesh(h_dfft_out.data, out, inverse ? m_n_cells : n_inner_cells);
+    #else
+    if (inverse)
+        dfft_execute((cpx_t *)in, (cpx_t *)(out+m_ghost_offset), 1, m_dfft_plan_inverse);
+    else
+        dfft_execute((cpx_t *)(in+m_ghost_offset), (cpx_t *)out, 0, m_dfft_plan_forward);
+    #endif
+    }
+#endif
+
+void OrderParameterMesh::updateMeshes()
+    {
+    forwardTransform(m_mesh, m_real_mesh, m_fourier_mesh);
+
+    if (m_interlace)
+        forwardTransform(m_shifted_mesh, m_real_shifted_mesh, m_shifted_fourier_mesh);
+
+    PDataFlags flags = m_pdata->getFlags();
+    computeForceMesh(flags[pdata_flag::pressure_tensor] || flags[pdata_flag::isotropic_virial]);
+
+    inverseTransform(m_fourier_mesh_G, m_inv_fourier_mesh, m_real_inv_fourier_mesh, false);
+
+    if (m_interlace)
+        inverseTransform(m_shifted_fourier_mesh, m_shifted_inv_mesh, m_real_shifted_inv_mesh, true);
+    }
+
+/*! The force mesh and everything else needed in k-space this step are computed in a single pass
+ */
+void OrderParameterMesh::computeForceMesh(bool compute_virial)
+    {
+    sweepFourierMesh(true, compute_virial, m_q_max_requested);
+    }
+
+/*! With a decomposed mesh, the forces on the particles whose stencil does not reach
+    into the ghost layer are interpolated while the ghost cells are being updated.
+ */
 void OrderParameterMesh::interpolateForces()
     {
     if (m_prof) m_prof->push("interpolate");
 
-    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
-    ArrayHandle<kiss_fft_cpx> h_inv_fourier_mesh(m_inv_fourier_mesh, access_location::host, access_mode::read);
+    ArrayHandle<mesh_cpx> h_inv_fourier_mesh(m_inv_fourier_mesh, access_location::host, access_mode::readwrite);
+    ArrayHandle<mesh_scalar> h_real_inv_fourier_mesh(m_real_inv_fourier_mesh, access_location::host, access_mode::read);
+    ArrayHandle<mesh_cpx> h_shifted_inv_mesh(m_shifted_inv_mesh, access_location::host, access_mode::readwrite);
+    ArrayHandle<mesh_scalar> h_real_shifted_inv_mesh(m_real_shifted_inv_mesh, access_location::host, access_mode::read);
     ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
 
     ArrayHandle<Scalar4> h_force(m_force, access_location::host, access_mode::overwrite);
 
+    // only the real part of the inverse transform is needed
+    const mesh_scalar *inv_mesh = m_real_fft ? h_real_inv_fourier_mesh.data : &h_inv_fourier_mesh.data[0].r;
+    unsigned int stride = m_real_fft ? 1 : 2;
+
+    const mesh_scalar *shifted_inv_mesh = NULL;
+    if (m_interlace)
+        shifted_inv_mesh = m_real_fft ? h_real_shifted_inv_mesh.data : &h_shifted_inv_mesh.data[0].r;
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        ArrayHandle<unsigned int> h_overlap_order(m_overlap_order, access_location::host, access_mode::read);
+        unsigned int nparticles = m_pdata->getN();
+
+        // interior particles
+        interpolateMesh(inv_mesh, shifted_inv_mesh, stride, h_mode.data, m_bias, h_force.data,
+            h_overlap_order.data + m_n_boundary, nparticles - m_n_boundary);
+
+        if (m_prof) m_prof->push("ghost cell update");
+        m_grid_comm_reverse->finish(h_inv_fourier_mesh.data);
+        if (m_interlace)
+            m_shifted_grid_comm_reverse->finish(h_shifted_inv_mesh.data);
+        if (m_prof) m_prof->pop();
+
+        // particles near the ghost layer
+        interpolateMesh(inv_mesh, shifted_inv_mesh, stride, h_mode.data, m_bias, h_force.data,
+            h_overlap_order.data, m_n_boundary);
+        }
+    else
+    #endif
+        {
+        interpolateMesh(inv_mesh, shifted_inv_mesh, stride, h_mode.data, m_bias, h_force.data);
+        }
+
+    if (m_prof) m_prof->pop();
+    }
+
+/*! With interlacing, the density is the average of the unshifted and the shifted
+    mesh, and the gradient is averaged accordingly.
+
+    Without an explicit list of particles, all local particles are visited in the order
+    of their cells, if they were sorted during assignment.
+ */
+void OrderParameterMesh::interpolateMesh(const mesh_scalar *inv_mesh, const mesh_scalar *shifted_inv_mesh,
+    unsigned int stride, const Scalar *mode_data, Scalar bias, Scalar4 *force_data,
+    const unsigned int *order, unsigned int n)
+    {
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+
     const BoxDim& box = m_pdata->getBox();
 
     Scalar3 a1 = box.getLatticeVector(0);
@@ -771,107 +1757,109 @@ void OrderParameterMesh::interpolateForces()
     // particle number
     unsigned int n_global = m_pdata->getNGlobal();
 
-    for (unsigned int idx = 0; idx < m_pdata->getN(); ++idx)
+    ArrayHandle<unsigned int> h_sort_order(m_sort_order, access_location::host, access_mode::read);
+    if (! order)
+        {
+        bool sorted = m_sort_period > 0 && m_sort_order.getNumElements() == m_pdata->getN();
+        order = sorted ? h_sort_order.data : NULL;
+        n = m_pdata->getN();
+        }
+
+    #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+    for (int i = 0; i < (int) n; ++i)
         {
+        unsigned int idx = order ? order[i] : i;
         Scalar4 postype = h_postype.data[idx];
 
         Scalar3 pos = make_scalar3(postype.x, postype.y, postype.z);
         unsigned int type = __scalar_as_int(postype.w);
-        Scalar mode = h_mode.data[type];
-
-        // compute coordinates in units of the mesh size
-        Scalar3 f = box.makeFraction(pos);
-        Scalar3 reduced_pos = make_scalar3(f.x * (Scalar) m_mesh_points.x,
-                                           f.y * (Scalar) m_mesh_points.y,
-                                           f.z * (Scalar) m_mesh_points.z);
+        Scalar mode = mode_data[type];
 
         // find cell of the force mesh the particle is in
-        unsigned int ix = (reduced_pos.x + (Scalar)m_n_ghost_cells.x);
-        unsigned int iy = (reduced_pos.y + (Scalar)m_n_ghost_cells.y);
-        unsigned int iz = (reduced_pos.z + (Scalar)m_n_ghost_cells.z);
-
-        // handle particles on the boundary
-        if (ix == m_grid_dim.x && !m_n_ghost_cells.x)
-            ix = 0;
-        if (iy == m_grid_dim.y && !m_n_ghost_cells.y)
-            iy = 0;
-        if (iz == m_grid_dim.z && !m_n_ghost_cells.z)
-            iz = 0;
-
-        // center of cell (in units of the mesh size)
-        Scalar3 cell_center = make_scalar3((Scalar)ix - (Scalar)(m_n_ghost_cells.x) + Scalar(0.5),
-                                           (Scalar)iy - (Scalar)(m_n_ghost_cells.y) + Scalar(0.5),
-                                           (Scalar)iz - (Scalar)(m_n_ghost_cells.z) + Scalar(0.5));
-
-        // compute minimum image separation to center
-        Scalar3 c_cart = box.makeCoordinates(cell_center/make_scalar3(m_mesh_points.x,m_mesh_points.y,m_mesh_points.z));
-        Scalar3 shift_cart = box.minImage(pos-c_cart);
-        Scalar3 shift_f = box.makeFraction(shift_cart+box.getLo());
-        Scalar3 shift = shift_f*make_scalar3(m_mesh_points.x,m_mesh_points.y,m_mesh_points.z);
-
-        Scalar3 force = make_scalar3(0.0,0.0,0.0);
-
-        for (int i = -1; i <= 1 ; ++i)
-            for (int j = -1; j <= 1; ++j)
-                for (int k = -1; k <= 1; ++k)
-                    {
-                    int neighi = (int)ix + i;
-                    int neighj = (int)iy + j;
-                    int neighk = (int)iz + k;
-
-                    if (! m_n_ghost_cells.x)
-                        {
-                        if (neighi == (int)m_grid_dim.x)
-                            neighi = 0;
-                        else if (neighi < 0)
-                            neighi += m_grid_dim.x;
-                        }
-
-                    if (! m_n_ghost_cells.y)
-                        {
-                        if (neighj == (int)m_grid_dim.y)
-                            neighj = 0;
-                        else if (neighj < 0)
-                            neighj += m_grid_dim.y;
-                        }
-
-                    if (! m_n_ghost_cells.z)
-                        {
-                        if (neighk == (int)m_grid_dim.z)
-                            neighk = 0;
-                        else if (neighk < 0)
-                            neighk += m_grid_dim.z;
-                        }
-
-                    Scalar3 dx_frac = shift - make_scalar3(i,j,k);
-
-                    unsigned int neigh_idx;
-                    neigh_idx = neighi + m_grid_dim.x * (neighj + m_grid_dim.y*neighk);
-
-                    kiss_fft_cpx inv_mesh = h_inv_fourier_mesh.data[neigh_idx];
-                    force += -(Scalar)m_mesh_points.x*b1*mode*assignTSCderiv(dx_frac.x)*assignTSC(dx_frac.y)*assignTSC(dx_frac.z)*inv_mesh.r;
-                    force += -(Scalar)m_mesh_points.y*b2*mode*assignTSC(dx_frac.x)*assignTSCderiv(dx_frac.y)*assignTSC(dx_frac.z)*inv_mesh.r;
-                    force += -(Scalar)m_mesh_points.z*b3*mode*assignTSC(dx_frac.x)*assignTSC(dx_frac.y)*assignTSCderiv(dx_frac.z)*inv_mesh.r;
-                   }
+        int3 cell;
+        Scalar3 shift;
+        computeParticleCell(box, pos, cell, shift);
+
+        // gradient of the interpolated potential in fractional mesh coordinates
+        Scalar3 grad = interpolateGradient(inv_mesh, stride, cell, shift);
+
+        if (shifted_inv_mesh)
+            {
+            computeShiftedCell(cell, shift);
+            grad += interpolateGradient(shifted_inv_mesh, stride, cell, shift);
+            grad *= Scalar(0.5);
+            }
+
+        Scalar3 force = -mode*((Scalar)m_mesh_points.x*grad.x*b1
+                             + (Scalar)m_mesh_points.y*grad.y*b2
+                             + (Scalar)m_mesh_points.z*grad.z*b3);
 
         // Multiply with bias potential derivative
-        force *= Scalar(2.0)/(Scalar)n_global*m_bias;
+        force *= Scalar(2.0)/(Scalar)n_global*bias;
 
-        h_force.data[idx] = make_scalar4(force.x,force.y,force.z,0.0);
+        force_data[idx] = make_scalar4(force.x,force.y,force.z,0.0);
         }  // end of loop over particles
+    }
 
-    if (m_prof) m_prof->pop();
+Scalar3 OrderParameterMesh::interpolateGradient(const mesh_scalar *inv_mesh, unsigned int stride,
+    const int3& cell, const Scalar3& shift) const
+    {
+    // per-axis weights and derivatives of the m_order nearest mesh points
+    Scalar wx[max_order], wy[max_order], wz[max_order];
+    Scalar dwx[max_order], dwy[max_order], dwz[max_order];
+    int ox = computeAssignmentWeights(shift.x, wx, dwx);
+    int oy = computeAssignmentWeights(shift.y, wy, dwy);
+
+    // wrapped mesh indices along every axis
+    int ni[max_order], nj[max_order], nk[max_order];
+    computeStencilIndices(cell.x+ox, m_grid_dim.x, !m_n_ghost_cells.x, ni);
+    computeStencilIndices(cell.y+oy, m_grid_dim.y, !m_n_ghost_cells.y, nj);
+    int order_z = computeStencilZ(cell, shift.z, wz, dwz, nk);
+
+    Scalar3 grad = make_scalar3(0.0,0.0,0.0);
+
+    int order = m_order;
+    for (int k = 0; k < order_z; ++k)
+        for (int j = 0; j < order; ++j)
+            {
+            unsigned int row = m_grid_dim.x * (nj[j] + m_grid_dim.y*nk[k]);
+
+            // contract the contiguous x-row with the x weights first
+            Scalar row_w(0.0), row_dw(0.0);
+            for (int i = 0; i < order; ++i)
+                {
+                Scalar inv_mesh_r = inv_mesh[stride*(row + ni[i])];
+                row_w += wx[i]*inv_mesh_r;
+                row_dw += dwx[i]*inv_mesh_r;
+                }
+
+            grad.x += wy[j]*wz[k]*row_dw;
+            grad.y += dwy[j]*wz[k]*row_w;
+            grad.z += wy[j]*dwz[k]*row_w;
+            }
+
+    return grad;
     }
 
-Scalar OrderParameterMesh::computeCV()
+/*! \param build_G If true, normalize the Fourier mesh and compute the force mesh
+    \param compute_virial If true, also sum up the virial
+    \param compute_q_max If true, also find the local peaks with the highest amplitude
+
+    The sum of the collective variable is always computed. All quantities are
+    accumulated over contiguous blocks of wave vectors per thread, and the
+    partial results are combined in a fixed order.
+ */
+void OrderParameterMesh::sweepFourierMesh(bool build_G, bool compute_virial, bool compute_q_max)
     {
-    if (m_prof) m_prof->push("sum");
+    if (m_prof) m_prof->push("k-space");
 
-    ArrayHandle<kiss_fft_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::read);
-    ArrayHandle<kiss_fft_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::read);
+    ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::readwrite);
+    ArrayHandle<mesh_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::readwrite);
     ArrayHandle<Scalar> h_interpolation_f(m_interpolation_f, access_location::host, access_mode::read);
-
-    Scalar sum(0.0);
+    ArrayHandle<Scalar3> h_k(m_k, access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_virial_kfac(m_virial_kfac, access_location::host, access_mode::read);
+    ArrayHandle<mesh_cpx> h_shifted_fourier_mesh(m_shifted_fourier_mesh, access_location::host, access_mode::readwrite);
+    ArrayHandle<mesh_cpx> h_interlace_phase(m_interlace_phase, access_location::host, access_mode::read);
 
     bool exclude_dc = true;
     #ifdef ENABLE_MPI
@@ -882,26 +1870,167 @@ Scalar OrderParameterMesh::computeCV()
         }
     #endif
 
-    unsigned int N_global = m_pdata->getNGlobal();
+    unsigned int N_global = m_pdata->getNGlobal();
+    Scalar diag_fac = Scalar(0.5)*m_mode_sq/(Scalar)N_global/(Scalar)N_global;
+
+    ArrayHandle<int3> h_miller(m_miller, access_location::host, access_mode::read);
+
+    // per-thread partial results: CV sum, six virial components, and the highest peaks
+    std::vector<Scalar> thread_sum(7*m_num_threads, Scalar(0.0));
+    unsigned int n_peaks = m_num_peaks;
+    std::vector<Scalar4> thread_peaks(n_peaks*m_num_threads, make_scalar4(0.0,0.0,0.0,-1.0));
+
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
+        {
+        unsigned int start = (unsigned long)m_n_fourier_cells*thread/m_num_threads;
+        unsigned int end = (unsigned long)m_n_fourier_cells*(thread+1)/m_num_threads;
+
+        Scalar cv_sum(0.0);
+        Scalar virial[6];
+        for (unsigned int i = 0; i < 6; ++i)
+            virial[i] = Scalar(0.0);
+        Scalar4 *peaks = &thread_peaks[n_peaks*thread];
+
+        for (unsigned int k = start; k < end; ++k)
+            {
+            kiss_fft_cpx f = make_kiss_cpx(h_fourier_mesh.data[k]);
+
+            // transform of the assignment function, which is part of the self term unless it is deconvolved
+            Scalar W = h_interpolation_f.data[k];
+            Scalar diagonal_term = m_deconvolve ? diag_fac : diag_fac*W*W;
+
+            if (build_G)
+                {
+                if (m_interlace)
+                    {
+                    // average with the shifted mesh, moved back by half a cell
+                    kiss_fft_cpx f_shifted = make_kiss_cpx(h_shifted_fourier_mesh.data[k]);
+                    kiss_fft_cpx phase = make_kiss_cpx(h_interlace_phase.data[k]);
+                    f.r = Scalar(0.5)*(f.r + phase.r*f_shifted.r - phase.i*f_shifted.i);
+                    f.i = Scalar(0.5)*(f.i + phase.r*f_shifted.i + phase.i*f_shifted.r);
+                    }
+
+                // normalization
+                Scalar norm = m_deconvolve ? (Scalar) N_global*W : (Scalar) N_global;
+                f.r /= norm;
+                f.i /= norm;
+
+                Scalar val = f.r*f.r+f.i*f.i;
+
+                kiss_fft_cpx G;
+                G.r = f.r * val - f.r * diagonal_term;
+                G.i = f.i * val - f.i * diagonal_term;
+
+                // the mesh density enters the deconvolved mode divided by W
+                if (m_deconvolve)
+                    {
+                    G.r /= W;
+                    G.i /= W;
+                    }
+
+                h_fourier_mesh_G.data[k] = make_mesh_cpx(G);
+                h_fourier_mesh.data[k] = make_mesh_cpx(f);
+
+                if (m_interlace)
+                    {
+                    // force mesh of the shifted mesh points, with the conjugate phase
+                    kiss_fft_cpx phase = make_kiss_cpx(h_interlace_phase.data[k]);
+                    h_shifted_fourier_mesh.data[k].r = phase.r*G.r + phase.i*G.i;
+                    h_shifted_fourier_mesh.data[k].i = phase.r*G.i - phase.i*G.r;
+                    }
+                }
+
+            Scalar norm2 = f.r*f.r + f.i*f.i;
+
+            // exclude DC bin
+            if (exclude_dc && k == 0)
+                continue;
+
+            if (compute_q_max && norm2 >= peaks[n_peaks-1].w && isPeakCandidate(h_miller.data[k]))
+                {
+                Scalar3 kvec = h_k.data[k];
+                Scalar4 peak = make_scalar4(kvec.x, kvec.y, kvec.z, norm2);
+
+                // insert into the ordered list
+                if (isHigherPeak(peak, peaks[n_peaks-1]))
+                    {
+                    unsigned int l = n_peaks-1;
+                    for (; l > 0 && isHigherPeak(peak, peaks[l-1]); --l)
+                        peaks[l] = peaks[l-1];
+                    peaks[l] = peak;
+                    }
+                }
+
+            // account for the conjugate partner in the half spectrum
+            Scalar weight = getConjugateWeight(k);
+
+            // |f|^4 - 2 diag |f|^2, which does not depend on the scaling of the force mesh
+            cv_sum += weight*norm2*(norm2 - Scalar(2.0)*diagonal_term);
+
+            if (compute_virial)
+                {
+                Scalar3 kvec = h_k.data[k];
+                Scalar rhog = weight*norm2*norm2/(Scalar)N_global/(Scalar)N_global*h_virial_kfac.data[k];
+
+                virial[0] += rhog*kvec.x*kvec.x; // xx
+                virial[1] += rhog*kvec.x*kvec.y; // xy
+                virial[2] += rhog*kvec.x*kvec.z; // xz
+                virial[3] += rhog*kvec.y*kvec.y; // yy
+                virial[4] += rhog*kvec.y*kvec.z; // yz
+                virial[5] += rhog*kvec.z*kvec.z; // zz
+                }
+            }
+
+        thread_sum[7*thread] = cv_sum;
+        for (unsigned int i = 0; i < 6; ++i)
+            thread_sum[7*thread+1+i] = virial[i];
+        }
+
+    // combine partial results in the order of the wave vectors
+    m_cv_sum = Scalar(0.0);
+    for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+        m_cv_sum += thread_sum[7*thread];
 
-    for (unsigned int k = 0; k < m_n_inner_cells; ++k)
+    if (build_G)
         {
-        bool exclude = false;
-        if (exclude_dc)
-            // exclude DC bin
-            exclude = (k == 0);
+        m_virial_valid = false;
+        m_local_peaks_valid = false;
+        }
 
-        if (! exclude)
+    if (compute_virial)
+        {
+        for (unsigned int i = 0; i < 6; ++i)
             {
-            sum += h_fourier_mesh_G.data[k].r * h_fourier_mesh.data[k].r
-                + h_fourier_mesh_G.data[k].i * h_fourier_mesh.data[k].i;
+            m_virial_sum[i] = Scalar(0.0);
+            for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+                m_virial_sum[i] += thread_sum[7*thread+1+i];
+            }
+        m_virial_valid = true;
+        }
 
-            Scalar norm2 = h_fourier_mesh.data[k].r*h_fourier_mesh.data[k].r + h_fourier_mesh.data[k].i*h_fourier_mesh.data[k].i;
-            Scalar diagonal_term = Scalar(0.5)*norm2*h_interpolation_f.data[k]*h_interpolation_f.data[k]*m_mode_sq/(Scalar)N_global/(Scalar)N_global;
-            sum -= diagonal_term;
+    if (compute_q_max)
+        {
+        m_local_peaks.assign(thread_peaks.begin(), thread_peaks.begin() + n_peaks);
+        std::vector<Scalar4> merged(n_peaks);
+        for (unsigned int thread = 1; thread < m_num_threads; ++thread)
+            {
+            mergePeaks(&m_local_peaks.front(), &thread_peaks[n_peaks*thread], &merged.front(), n_peaks);
+            m_local_peaks.swap(merged);
             }
+        m_local_peaks_valid = true;
         }
 
+    if (m_prof) m_prof->pop();
+    }
+
+Scalar OrderParameterMesh::computeCV()
+    {
+    if (m_prof) m_prof->push("sum");
+
+    // the local sum has been computed in the k-space pass of updateMeshes()
+    Scalar sum = m_cv_sum;
+
     sum *= Scalar(1.0/2.0);
 
     #ifdef ENABLE_MPI
@@ -936,6 +2065,8 @@ Scalar OrderParameterMesh::getCurrentValue(unsigned int timestep)
 
         computeInfluenceFunction();
         m_is_first_step = false;
+        m_box_changed = false;
+        m_kernel_changed = false;
         }
 
     bool ghost_cell_num_changed = false;
@@ -952,6 +2083,14 @@ Scalar OrderParameterMesh::getCurrentValue(unsigned int timestep)
         if (ghost_cell_num_changed) setupMesh();
         computeInfluenceFunction();
         m_box_changed = false;
+        m_kernel_changed = false;
+        }
+    else if (m_box_changed || m_kernel_changed)
+        {
+        // the mesh layout is unchanged, only update the wave vectors
+        rescaleInfluenceFunction();
+        m_box_changed = false;
+        m_kernel_changed = false;
         }
 
     assignParticles();
@@ -971,80 +2110,13 @@ void OrderParameterMesh::computeVirial()
     {
     if (m_prof) m_prof->push("virial");
 
-    ArrayHandle<kiss_fft_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::overwrite);
-    ArrayHandle<kiss_fft_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::overwrite);
-
-    ArrayHandle<Scalar> h_inf_f(m_inf_f, access_location::host, access_mode::read);
-    ArrayHandle<Scalar3> h_k(m_k, access_location::host, access_mode::read);
-
-    ArrayHandle<Scalar> h_table_d(m_table_d, access_location::host, access_mode::read);
-
-    Scalar virial[6];
-    for (unsigned int i = 0; i < 6; ++i)
-        virial[i] = Scalar(0.0);
-
-    bool exclude_dc = true;
-    #ifdef ENABLE_MPI
-    if (m_pdata->getDomainDecomposition())
-        {
-        uint3 my_pos = m_pdata->getDomainDecomposition()->getGridPos();
-        exclude_dc = !my_pos.x && !my_pos.y && !my_pos.z;
-        }
-    #endif
-
-    unsigned int Nglobal = m_pdata->getNGlobal();
-
-    for (unsigned int kidx = 0; kidx < m_n_inner_cells; ++kidx)
-        {
-        bool exclude = false;
-        if (exclude_dc)
-            // exclude DC bin
-            exclude = (kidx == 0);
-
-        if (! exclude)
-            {
-            // non-zero wave vector
-            kiss_fft_cpx fourier = h_fourier_mesh.data[kidx];
-
-            Scalar3 k = h_k.data[kidx];
-            Scalar ksq = dot(k,k);
-            Scalar knorm = sqrt(ksq);
-
-            Scalar kfac = Scalar(1.0)/Scalar(2.0)/knorm;
-
-            // derivative of convolution kernel
-            Scalar val_D(0.0);
-
-            if (m_use_table && knorm >= m_k_min && knorm < m_k_max)
-                {
-                Scalar value_f = (knorm - m_k_min) / m_delta_k;
-
-                unsigned int value_i = (unsigned int) value_f;
-                Scalar dK0 = h_table_d.data[value_i];
-                Scalar dK1 = h_table_d.data[value_i+1];
-
-                // interpolate
-                Scalar f = value_f - Scalar(value_i);
-
-                val_D = dK0 + f * (dK1-dK0);
-                }
-
-            kfac *= val_D;
-
-            Scalar val = (fourier.r*fourier.r+fourier.i*fourier.i)/(Scalar)Nglobal;
-            Scalar rhog = (fourier.r * fourier.r + fourier.i * fourier.i)*val/(Scalar)Nglobal;
-
-            virial[0] += rhog*kfac*k.x*k.x; // xx
-            virial[1] += rhog*kfac*k.x*k.y; // xy
-            virial[2] += rhog*kfac*k.x*k.z; // xz
-            virial[3] += rhog*kfac*k.y*k.y; // yy
-            virial[4] += rhog*kfac*k.y*k.z; // yz
-            virial[5] += rhog*kfac*k.z*k.z; // zz
-            }
-        }
+    // the virial is usually computed in the k-space pass of updateMeshes(),
+    // unless the pressure was not requested at that time
+    if (! m_virial_valid)
+        sweepFourierMesh(false, true, false);
 
     for (unsigned int i = 0; i < 6; ++i)
-        m_external_virial[i] = m_bias*virial[i];
+        m_external_virial[i] = m_bias*m_virial_sum[i];
 
     if (m_prof) m_prof->pop();
     }
@@ -1101,10 +2173,38 @@ Scalar OrderParameterMesh::getLogValue(const std::string& quantity, unsigned int
         return m_sq_max;
         }
 
+    // quantities of the individual peaks, in groups of six
+    std::vector<std::string>::const_iterator it = std::find(m_log_names.begin()+5, m_log_names.end(), quantity);
+    if (it != m_log_names.end())
+        {
+        computeQmax(timestep);
+
+        unsigned int idx = (it - m_log_names.begin()) - 5;
+        const Scalar4& peak = m_peaks[idx/6];
+        switch (idx % 6)
+            {
+            case 0:
+                return sqrt(peak.x*peak.x + peak.y*peak.y + peak.z*peak.z);
+            case 1:
+                return peak.x;
+            case 2:
+                return peak.y;
+            case 3:
+                return peak.z;
+            case 4:
+                return peak.w;
+            default:
+                return m_peak_shell[idx/6];
+            }
+        }
+
     // nothing found? return base class value
     return CollectiveVariable::getLogValue(quantity, timestep);
     }
 
+/*! Every rank selects its highest peaks during the k-space pass, and the
+    peaks of all ranks are combined in a single reduction.
+ */
 void OrderParameterMesh::computeQmax(unsigned int timestep)
     {
     // compute Fourier grid
@@ -1113,70 +2213,452 @@ void OrderParameterMesh::computeQmax(unsigned int timestep)
     if (timestep && m_q_max_last_computed == timestep) return;
     m_q_max_last_computed = timestep;
 
+    // from now on, find the peaks during the k-space pass of every step
+    m_q_max_requested = true;
+
     if (m_prof) m_prof->push("max q");
 
-    ArrayHandle<kiss_fft_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::read);
-    ArrayHandle<Scalar3> h_k(m_k, access_location::host, access_mode::read);
+    if (! m_local_peaks_valid)
+        sweepFourierMesh(false, false, true);
+
+    m_peaks = m_local_peaks;
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        reducePeaks(m_peaks);
+    #endif
+
+    // normalize with 1/V
+    unsigned int n_global = m_pdata->getNGlobal();
+    for (unsigned int i = 0; i < m_num_peaks; ++i)
+        {
+        // there may be fewer wave vectors than peaks
+        if (m_peaks[i].w < Scalar(0.0))
+            m_peaks[i] = make_scalar4(0.0,0.0,0.0,0.0);
+        m_peaks[i].w *= (Scalar)n_global;
+        }
+
+    m_q_max = make_scalar3(m_peaks[0].x, m_peaks[0].y, m_peaks[0].z);
+    m_sq_max = m_peaks[0].w;
+
+    if (m_peak_shell_width > Scalar(0.0))
+        computePeakShells();
+    else
+        for (unsigned int i = 0; i < m_num_peaks; ++i)
+            m_peak_shell[i] = m_peaks[i].w;
+
+    if (m_prof) m_prof->pop();
+    }
+
+/*! The shell of a peak contains all wave vectors whose length differs from that
+    of the peak by at most half the shell width.
+ */
+void OrderParameterMesh::computePeakShells()
+    {
+    ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_knorm(m_knorm, access_location::host, access_mode::read);
+
+    bool exclude_dc = true;
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        uint3 my_pos = m_pdata->getDomainDecomposition()->getGridPos();
+        exclude_dc = !my_pos.x && !my_pos.y && !my_pos.z;
+        }
+    #endif
+
+    unsigned int n_peaks = m_num_peaks;
+    std::vector<Scalar> peak_q(n_peaks);
+    for (unsigned int i = 0; i < n_peaks; ++i)
+        peak_q[i] = sqrt(m_peaks[i].x*m_peaks[i].x + m_peaks[i].y*m_peaks[i].y + m_peaks[i].z*m_peaks[i].z);
+    Scalar half_width = Scalar(0.5)*m_peak_shell_width;
+
+    // per-thread sums of the amplitudes and of the number of modes in every shell
+    std::vector<Scalar> thread_sum(2*n_peaks*m_num_threads, Scalar(0.0));
+
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
+        {
+        unsigned int start = (unsigned long)m_n_fourier_cells*thread/m_num_threads;
+        unsigned int end = (unsigned long)m_n_fourier_cells*(thread+1)/m_num_threads;
+        Scalar *sum = &thread_sum[2*n_peaks*thread];
+
+        for (unsigned int k = start; k < end; ++k)
+            {
+            if (exclude_dc && k == 0)
+                continue;
+
+            kiss_fft_cpx f = make_kiss_cpx(h_fourier_mesh.data[k]);
+            Scalar norm2 = f.r*f.r + f.i*f.i;
+            Scalar weight = getConjugateWeight(k);
+            Scalar knorm = h_knorm.data[k];
+
+            for (unsigned int i = 0; i < n_peaks; ++i)
+                if (fabs(knorm - peak_q[i]) <= half_width)
+                    {
+                    sum[2*i] += weight*norm2;
+                    sum[2*i+1] += weight;
+                    }
+            }
+        }
+
+    std::vector<Scalar> shell_sum(2*n_peaks, Scalar(0.0));
+    for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+        for (unsigned int i = 0; i < 2*n_peaks; ++i)
+            shell_sum[i] += thread_sum[2*n_peaks*thread+i];
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &shell_sum.front(),
+                      2*n_peaks,
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
+        }
+    #endif
+
+    // normalize with 1/V
+    unsigned int n_global = m_pdata->getNGlobal();
+    for (unsigned int i = 0; i < n_peaks; ++i)
+        m_peak_shell[i] = shell_sum[2*i+1] > Scalar(0.0) ? shell_sum[2*i]/shell_sum[2*i+1]*(Scalar)n_global : Scalar(0.0);
+    }
+
+/*! The wave vectors are assigned to the shells once for every box, and every call
+    only sums up the amplitudes of the current density mesh. The DC bin is excluded.
+ */
+void OrderParameterMesh::computeStructureFactor(unsigned int timestep, unsigned int n_bins, Scalar k_max,
+    std::vector<Scalar>& sk, std::vector<Scalar>& n_modes)
+    {
+    // compute Fourier grid
+    getCurrentValue(timestep);
+
+    if (m_prof) m_prof->push("structure factor");
+
+    if (! m_sk_bin_valid || m_sk_n_bins != n_bins || m_sk_k_max != k_max
+        || m_sk_bin.getNumElements() != m_n_fourier_cells)
+        {
+        if (m_sk_bin.getNumElements() != m_n_fourier_cells)
+            {
+            GlobalArray<unsigned int> sk_bin(m_n_fourier_cells, m_exec_conf);
+            m_sk_bin.swap(sk_bin);
+            }
+
+        ArrayHandle<Scalar> h_knorm(m_knorm, access_location::host, access_mode::read);
+        ArrayHandle<unsigned int> h_sk_bin(m_sk_bin, access_location::host, access_mode::overwrite);
+
+        bool exclude_dc = true;
+        #ifdef ENABLE_MPI
+        if (m_pdata->getDomainDecomposition())
+            {
+            uint3 my_pos = m_pdata->getDomainDecomposition()->getGridPos();
+            exclude_dc = !my_pos.x && !my_pos.y && !my_pos.z;
+            }
+        #endif
+
+        Scalar bin_width = k_max/(Scalar)n_bins;
+        for (unsigned int k = 0; k < m_n_fourier_cells; ++k)
+            {
+            Scalar knorm = h_knorm.data[k];
+            bool inside = knorm < k_max && !(exclude_dc && k == 0);
+            h_sk_bin.data[k] = inside ? std::min((unsigned int)(knorm/bin_width), n_bins-1) : n_bins;
+            }
+
+        m_sk_n_bins = n_bins;
+        m_sk_k_max = k_max;
+        m_sk_bin_valid = true;
+        }
+
+    ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::read);
+    ArrayHandle<unsigned int> h_sk_bin(m_sk_bin, access_location::host, access_mode::read);
+
+    // per-thread sums of the amplitudes and of the number of modes in every shell
+    std::vector<Scalar> thread_sum(2*n_bins*m_num_threads, Scalar(0.0));
 
-    Scalar max_amplitude(0.0);
-    Scalar3 q_max(make_scalar3(0.0,0.0,0.0));
-    for (unsigned int kidx = 0; kidx < m_n_inner_cells; ++kidx)
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
         {
-        Scalar a = h_fourier_mesh.data[kidx].r*h_fourier_mesh.data[kidx].r
-                   + h_fourier_mesh.data[kidx].i*h_fourier_mesh.data[kidx].i;
+        unsigned int start = (unsigned long)m_n_fourier_cells*thread/m_num_threads;
+        unsigned int end = (unsigned long)m_n_fourier_cells*(thread+1)/m_num_threads;
+        Scalar *sum = &thread_sum[2*n_bins*thread];
 
-        if (a > max_amplitude)
+        for (unsigned int k = start; k < end; ++k)
             {
-            q_max = h_k.data[kidx];
-            max_amplitude = a;
+            unsigned int bin = h_sk_bin.data[k];
+            if (bin == n_bins)
+                continue;
+
+            kiss_fft_cpx f = make_kiss_cpx(h_fourier_mesh.data[k]);
+            Scalar weight = getConjugateWeight(k);
+            sum[2*bin] += weight*(f.r*f.r + f.i*f.i);
+            sum[2*bin+1] += weight;
             }
         }
 
+    std::vector<Scalar> shell_sum(2*n_bins, Scalar(0.0));
+    for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+        for (unsigned int i = 0; i < 2*n_bins; ++i)
+            shell_sum[i] += thread_sum[2*n_bins*thread+i];
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        MPI_Reduce(m_exec_conf->isRoot() ? MPI_IN_PLACE : &shell_sum.front(),
+                   &shell_sum.front(),
+                   2*n_bins,
+                   MPI_HOOMD_SCALAR,
+                   MPI_SUM,
+                   0,
+                   m_exec_conf->getMPICommunicator());
+        }
+    #endif
+
+    // normalize with 1/V
+    unsigned int n_global = m_pdata->getNGlobal();
+    sk.resize(n_bins);
+    n_modes.resize(n_bins);
+    for (unsigned int i = 0; i < n_bins; ++i)
+        {
+        sk[i] = shell_sum[2*i]*(Scalar)n_global;
+        n_modes[i] = shell_sum[2*i+1];
+        }
+
+    if (m_prof) m_prof->pop();
+    }
+
+/*! The Fourier transform of the density is summed over the particles for every wave
+    vector of the global mesh, without the attenuation by the transform of the assignment
+    function, so that the result is the exact value of the collective variable at these
+    wave vectors. Only half of the wave vectors along x are evaluated, since the density
+    is real.
+
+    The sum is parallelized over rows of constant (ky,kz), so that every thread
+    owns its part of the structure factor and the result does not depend on the
+    number of threads.
+ */
+Scalar OrderParameterMesh::computeDirectValue(unsigned int timestep)
+    {
+    if (m_prof) m_prof->push("direct sum");
+
+    uint3 global_dim = m_mesh_points;
     #ifdef ENABLE_MPI
     if (m_pdata->getDomainDecomposition())
         {
-        // all processes send their results to all other processes
-        // and then they determine the maximum wave vector
-        Scalar *all_amplitudes = new Scalar[m_exec_conf->getNRanks()];
-        Scalar3 *all_q_max = new Scalar3[m_exec_conf->getNRanks()];
-        MPI_Allgather(&max_amplitude,
-                       1,
-                       MPI_HOOMD_SCALAR,
-                       all_amplitudes,
-                       1,
-                       MPI_HOOMD_SCALAR,
-                       m_exec_conf->getMPICommunicator());
-        MPI_Allgather(&q_max,
-                       sizeof(Scalar3),
-                       MPI_BYTE,
-                       all_q_max,
-                       sizeof(Scalar3),
-                       MPI_BYTE,
-                       m_exec_conf->getMPICommunicator());
-
-        for (unsigned int i = 0; i < m_exec_conf->getNRanks();++i)
+        const Index3D &didx = m_pdata->getDomainDecomposition()->getDomainIndexer();
+        global_dim.x *= didx.getW();
+        global_dim.y *= didx.getH();
+        global_dim.z *= didx.getD();
+        }
+    #endif
+
+    unsigned int n_kx = global_dim.x/2 + 1;
+    unsigned int n_rows = global_dim.y*global_dim.z;
+
+    // Miller indices in [-N/2, N/2)
+    std::vector<int> miller_x(n_kx), miller_y(global_dim.y), miller_z(global_dim.z);
+    for (unsigned int i = 0; i < n_kx; ++i)
+        miller_x[i] = i;
+    for (unsigned int j = 0; j < global_dim.y; ++j)
+        miller_y[j] = (j < (global_dim.y+1)/2) ? (int) j : (int) j - (int) global_dim.y;
+    for (unsigned int k = 0; k < global_dim.z; ++k)
+        miller_z[k] = (k < (global_dim.z+1)/2) ? (int) k : (int) k - (int) global_dim.z;
+
+    // real and imaginary parts of the local contribution to the density
+    std::vector<Scalar> rho(2*n_kx*n_rows, Scalar(0.0));
+
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_mode(m_mode, access_location::host, access_mode::read);
+
+    const BoxDim& global_box = m_pdata->getGlobalBox();
+    unsigned int nparticles = m_pdata->getN();
+
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
+        {
+        unsigned int start = (unsigned long)n_rows*thread/m_num_threads;
+        unsigned int end = (unsigned long)n_rows*(thread+1)/m_num_threads;
+        if (start == end)
+            continue;
+
+        std::vector<kiss_fft_cpx> ex(n_kx), ey(global_dim.y), ez(global_dim.z);
+
+        for (unsigned int idx = 0; idx < nparticles; ++idx)
             {
-            if (all_amplitudes[i] > max_amplitude)
+            Scalar4 postype = h_postype.data[idx];
+            Scalar mode = h_mode.data[__scalar_as_int(postype.w)];
+            if (mode == Scalar(0.0))
+                continue;
+
+            Scalar3 f = global_box.makeFraction(make_scalar3(postype.x, postype.y, postype.z));
+
+            for (unsigned int i = 0; i < n_kx; ++i)
+                {
+                Scalar arg = -Scalar(2.0*M_PI)*(Scalar)miller_x[i]*f.x;
+                ex[i].r = mode*cos(arg);
+                ex[i].i = mode*sin(arg);
+                }
+            for (unsigned int j = 0; j < global_dim.y; ++j)
+                {
+                Scalar arg = -Scalar(2.0*M_PI)*(Scalar)miller_y[j]*f.y;
+                ey[j].r = cos(arg);
+                ey[j].i = sin(arg);
+                }
+            for (unsigned int k = 0; k < global_dim.z; ++k)
+                {
+                Scalar arg = -Scalar(2.0*M_PI)*(Scalar)miller_z[k]*f.z;
+                ez[k].r = cos(arg);
+                ez[k].i = sin(arg);
+                }
+
+            for (unsigned int row = start; row < end; ++row)
                 {
-                max_amplitude = all_amplitudes[i];
-                q_max = all_q_max[i];
+                unsigned int j = row % global_dim.y;
+                unsigned int k = row / global_dim.y;
+
+                Scalar yz_r = ey[j].r*ez[k].r - ey[j].i*ez[k].i;
+                Scalar yz_i = ey[j].r*ez[k].i + ey[j].i*ez[k].r;
+
+                Scalar *rho_row = &rho[2*n_kx*row];
+                for (unsigned int i = 0; i < n_kx; ++i)
+                    {
+                    rho_row[2*i] += ex[i].r*yz_r - ex[i].i*yz_i;
+                    rho_row[2*i+1] += ex[i].r*yz_i + ex[i].i*yz_r;
+                    }
                 }
             }
+        }
+
+    Scalar mode_sq(0.0);
+    for (unsigned int idx = 0; idx < nparticles; ++idx)
+        {
+        Scalar mode = h_mode.data[__scalar_as_int(h_postype.data[idx].w)];
+        mode_sq += mode*mode;
+        }
 
-        delete [] all_amplitudes;
-        delete [] all_q_max;
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &rho.front(),
+                      rho.size(),
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &mode_sq,
+                      1,
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
         }
     #endif
 
+    unsigned int N_global = m_pdata->getNGlobal();
+    Scalar diag_fac = Scalar(0.5)*mode_sq/(Scalar)N_global/(Scalar)N_global;
+
+    Scalar cv_sum(0.0);
+    for (unsigned int row = 0; row < n_rows; ++row)
+        {
+        for (unsigned int i = 0; i < n_kx; ++i)
+            {
+            if (i == 0 && row == 0)
+                continue;
+
+            // the modes with kx > 0 also stand for their complex conjugates, except for the Nyquist plane
+            Scalar weight = (i == 0 || 2*i == global_dim.x) ? Scalar(1.0) : Scalar(2.0);
+
+            Scalar re = rho[2*(n_kx*row+i)]/(Scalar)N_global;
+            Scalar im = rho[2*(n_kx*row+i)+1]/(Scalar)N_global;
+            Scalar norm2 = re*re + im*im;
+
+            cv_sum += weight*(norm2*norm2 - Scalar(2.0)*diag_fac*norm2);
+            }
+        }
+
     if (m_prof) m_prof->pop();
 
-    m_q_max = q_max;
-    m_sq_max = max_amplitude;
+    return Scalar(0.5)*cv_sum;
+    }
+
+/*! The mesh is set up with a first evaluation, which is not included in the timing.
+ */
+Scalar OrderParameterMesh::benchmarkMesh(unsigned int timestep, unsigned int num_iters)
+    {
+    getCurrentValue(timestep);
+
+    ClockSource t;
+    int64_t start_time = t.getTime();
 
-    // normalize with 1/V
-    unsigned int n_global = m_pdata->getNGlobal();
-    m_sq_max *= (Scalar)n_global;
+    for (unsigned int i = 0; i < num_iters; ++i)
+        {
+        assignParticles();
+        updateMeshes();
+        m_cv = computeCV();
+        interpolateForces();
+        }
+
+    int64_t total_time_ns = t.getTime() - start_time;
+    Scalar time_ms = Scalar(1e-6)*(Scalar)total_time_ns/(Scalar)num_iters;
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        // the slowest rank determines the time step
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &time_ms,
+                      1,
+                      MPI_HOOMD_SCALAR,
+                      MPI_MAX,
+                      m_exec_conf->getMPICommunicator());
+        }
+    #endif
+
+    return time_ms;
+    }
+
+#ifdef ENABLE_MPI
+/*! The length of the lists is given by the size of the datatype
+ */
+void OrderParameterMesh::mergePeaksOp(void *in, void *inout, int *len, MPI_Datatype *datatype)
+    {
+    int size;
+    MPI_Type_size(*datatype, &size);
+    unsigned int n_peaks = size/sizeof(Scalar4);
+
+    std::vector<Scalar4> merged(n_peaks);
+    for (int i = 0; i < *len; ++i)
+        {
+        Scalar4 *a = (Scalar4 *)in + i*n_peaks;
+        Scalar4 *b = (Scalar4 *)inout + i*n_peaks;
+        mergePeaks(a, b, &merged.front(), n_peaks);
+        std::copy(merged.begin(), merged.end(), b);
+        }
+    }
+
+/*! \param peaks Ordered list of peaks, replaced by the ordered list of the highest peaks over all ranks
+ */
+void OrderParameterMesh::reducePeaks(std::vector<Scalar4>& peaks)
+    {
+    // the whole list is a single element of the reduction
+    MPI_Datatype peak_list;
+    MPI_Type_contiguous(4*peaks.size(), MPI_HOOMD_SCALAR, &peak_list);
+    MPI_Type_commit(&peak_list);
+
+    MPI_Op merge_peaks;
+    MPI_Op_create(mergePeaksOp, 1, &merge_peaks);
+
+    MPI_Allreduce(MPI_IN_PLACE,
+                  &peaks.front(),
+                  1,
+                  peak_list,
+                  merge_peaks,
+                  m_exec_conf->getMPICommunicator());
+
+    MPI_Op_free(&merge_peaks);
+    MPI_Type_free(&peak_list);
     }
+#endif
 
 void export_OrderParameterMesh(py::module& m)
     {
@@ -1186,8 +2668,21 @@ void export_OrderParameterMesh(py::module& m)
                                      const unsigned int,
                                      const unsigned int,
                                      const std::vector<Scalar>,
-                                     const std::vector<int3>
+                                     const std::vector<int3>,
+                                     const std::string&
                                     >())
         .def("setTable", &OrderParameterMesh::setTable)
-        .def("setUseTable", &OrderParameterMesh::setUseTable);
+        .def("setFFTWisdomFile", &OrderParameterMesh::setFFTWisdomFile)
+        .def("setInfluenceCacheFile", &OrderParameterMesh::setInfluenceCacheFile)
+        .def("setDistributedFFT", &OrderParameterMesh::setDistributedFFT)
+        .def("setUseTable", &OrderParameterMesh::setUseTable)
+        .def("setNumThreads", &OrderParameterMesh::setNumThreads)
+        .def("setOrder", &OrderParameterMesh::setOrder)
+        .def("setInterlace", &OrderParameterMesh::setInterlace)
+        .def("setDeconvolve", &OrderParameterMesh::setDeconvolve)
+        .def("setNumPeaks", &OrderParameterMesh::setNumPeaks)
+        .def("setPeakShellWidth", &OrderParameterMesh::setPeakShellWidth)
+        .def("setSortPeriod", &OrderParameterMesh::setSortPeriod)
+        .def("computeDirectValue", &OrderParameterMesh::computeDirectValue)
+        .def("benchmarkMesh", &OrderParameterMesh::benchmarkMesh);
     }
@@ -3,26 +3,36 @@
 
 #include "CollectiveVariable.h"
 
-#include <hoomd/md/CommunicatorGrid.h>
+#include "CommunicatorGridAsync.h"
 
 #ifdef ENABLE_MPI
 #include <hoomd/extern/dfftlib/src/dfft_host.h>
+#include "GatherMeshFFT.h"
 #endif
 
-#include <hoomd/extern/kiss_fftnd.h>
+#include "MeshFFT.h"
+#include "MeshPrecision.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /*! Order parameter evaluated using the particle mesh method
  */
 class OrderParameterMesh : public CollectiveVariable
     {
     public:
+        //! Maximum order of the assignment function
+        static const unsigned int max_order = 7;
+
         //! Constructor
         OrderParameterMesh(std::shared_ptr<SystemDefinition> sysdef,
                            const unsigned int nx,
                            const unsigned int ny,
                            const unsigned int nz,
                            const std::vector<Scalar> mode,
-                           const std::vector<int3> zero_modes = std::vector<int3>());
+                           const std::vector<int3> zero_modes = std::vector<int3>(),
+                           const std::string& fft_backend = std::string("auto"));
         virtual ~OrderParameterMesh();
 
         Scalar getCurrentValue(unsigned int timestep);
@@ -60,6 +70,105 @@ class OrderParameterMesh : public CollectiveVariable
         void setUseTable(bool use_table)
             {
             m_use_table = use_table;
+            m_kernel_changed = true;
+            }
+
+        /*! Set the order of the B-spline assignment function
+            \param order Number of mesh points along every axis a particle is assigned to (2 to 7)
+         */
+        virtual void setOrder(unsigned int order);
+
+        /*! Enable or disable interlacing
+            \param interlace True if the density should also be assigned to a mesh shifted by half a cell
+         */
+        virtual void setInterlace(bool interlace);
+
+        /*! Enable or disable the deconvolution of the assignment function
+            \param deconvolve True if the transformed density should be divided by the transform of the assignment function
+         */
+        virtual void setDeconvolve(bool deconvolve);
+
+        /*! Set the number of structure factor peaks that are tracked
+            \param num_peaks Number of peaks, logged as q_max_i, qx_max_i, qy_max_i, qz_max_i, sq_max_i and sq_shell_i
+         */
+        virtual void setNumPeaks(unsigned int num_peaks);
+
+        /*! Set the width of the shell in k-space around every peak the structure factor is averaged over
+            \param width Width of the shell (0 to disable)
+         */
+        virtual void setPeakShellWidth(Scalar width);
+
+        /*! Bin the structure factor of the density mesh into shells of |k|
+            \param timestep The current value of the time step
+            \param n_bins Number of shells of equal width
+            \param k_max Upper edge of the last shell
+            \param sk Output sum of the structure factor over the modes in every shell
+            \param n_modes Output number of modes in every shell
+
+            With a decomposed mesh, the output is only valid on the root rank.
+         */
+        virtual void computeStructureFactor(unsigned int timestep, unsigned int n_bins, Scalar k_max,
+            std::vector<Scalar>& sk, std::vector<Scalar>& n_modes);
+
+        /*! Compute the collective variable by a direct sum over the particles
+            \param timestep The current value of the time step
+
+            The structure factor is evaluated exactly at the wave vectors of the mesh,
+            without aliasing and without the attenuation by the assignment function, so
+            that the difference to getCurrentValue() measures the discretization error
+            of the mesh. The cost is O(N M) for N particles and M mesh points.
+         */
+        virtual Scalar computeDirectValue(unsigned int timestep);
+
+        /*! Measure the time of a full mesh evaluation
+            \param timestep The current value of the time step
+            \param num_iters Number of evaluations to average over
+            \returns The average wall time per evaluation in milliseconds, maximum over all ranks
+
+            One evaluation consists of particle assignment, the FFTs, the collective
+            variable and the force interpolation. The forces are overwritten.
+         */
+        Scalar benchmarkMesh(unsigned int timestep, unsigned int num_iters);
+
+        /*! Set the number of host threads used for the mesh operations
+            \param num_threads Number of threads
+         */
+        void setNumThreads(unsigned int num_threads);
+
+        /*! Set how often the particles are sorted by mesh cell
+            \param sort_period Number of mesh updates between sorts (0 to disable)
+         */
+        void setSortPeriod(unsigned int sort_period)
+            {
+            m_sort_period = sort_period;
+            m_sort_valid = false;
+            }
+
+        /*! Set the file to load and store FFTW wisdom from and to
+            \param wisdom_file Name of the file (empty to disable)
+         */
+        void setFFTWisdomFile(const std::string& wisdom_file)
+            {
+            m_fft_wisdom_file = wisdom_file;
+            }
+
+        /*! Select the distributed FFT used with domain decomposition
+            \param method "dfft" for the distributed FFT library, "gather" to transform the
+                   whole mesh on the root rank, or "auto" to choose by mesh size and rank count
+         */
+        void setDistributedFFT(const std::string& method);
+
+        /*! Set the file to load and store the influence function and the wave vectors from and to
+            \param cache_file Name of the file (empty to disable)
+
+            The cache is used on the first step and after a reallocation of the mesh, if it
+            matches the mesh layout, the assignment function, the box and the convolution kernel.
+            With domain decomposition, every rank uses its own file, with the rank as suffix.
+            If no FFTW wisdom file is set, the wisdom is stored next to the cache.
+         */
+        void setInfluenceCacheFile(const std::string& cache_file)
+            {
+            m_influence_cache_file = cache_file;
             }
 
     protected:
@@ -78,25 +187,71 @@ class OrderParameterMesh : public CollectiveVariable
         Scalar3 m_ghost_width;              //!< Dimensions of the ghost layer
         unsigned int m_ghost_offset;       //!< Offset in mesh due to ghost cells
         unsigned int m_n_cells;             //!< Total number of inner cells
+        unsigned int m_order;               //!< Order of the assignment function
         unsigned int m_radius;              //!< Stencil radius (in units of mesh size)
+        bool m_interlace;                   //!< True if the density is also assigned to a shifted mesh
+        bool m_deconvolve;                  //!< True if the transformed density is divided by the transform of the assignment function
+        bool m_2d;                          //!< True if the mesh has a single layer along z (two dimensions)
         unsigned int m_n_inner_cells;       //!< Number of inner mesh points (without ghost cells)
+        unsigned int m_n_fourier_cells;     //!< Number of locally stored wave vectors
         GlobalArray<Scalar> m_mode;            //!< Per-type scalar multiplying density ("charges")
         Scalar m_mode_sq;                   //!< Sum of squared mode amplitudes
         GlobalArray<Scalar> m_inf_f;           //!< Fourier representation of the influence function (real part)
         GlobalArray<Scalar> m_interpolation_f; //!< Fourier representation of the interpolation function
         GlobalArray<Scalar3> m_k;              //!< Mesh of k values
+        GlobalArray<int3> m_miller;            //!< Miller indices of the locally stored wave vectors
+        GlobalArray<Scalar> m_knorm;           //!< Length of every locally stored wave vector
+        GlobalArray<Scalar> m_virial_kfac;     //!< Derivative of the convolution kernel divided by 2|k|, per wave vector
         Scalar m_qstarsq;                   //!< Short wave length cut-off squared for density harmonics
         bool m_is_first_step;               //!< True if we have not yet computed the influence function
         unsigned int m_cv_last_updated;     //!< Timestep of last update of collective variable
         bool m_box_changed;                 //!< True if box has changed since last compute
+        bool m_kernel_changed;              //!< True if the convolution kernel has changed since last compute
         Scalar m_cv;                        //!< Current value of collective variable
 
-        GlobalArray<Scalar> m_virial_mesh;     //!< k-space mesh of virial tensor values
-
         unsigned int m_q_max_last_computed;        //!< Last time step at which q max was computed
         Scalar3 m_q_max;                           //!< Current wave vector with maximum amplitude
         Scalar m_sq_max;                           //!< Maximum structure factor
 
+        unsigned int m_num_peaks;                  //!< Number of tracked structure factor peaks
+        Scalar m_peak_shell_width;                 //!< Width of the shell averaged around every peak (0 if disabled)
+        std::vector<Scalar4> m_peaks;              //!< Wave vector (xyz) and structure factor (w) of every peak
+        std::vector<Scalar> m_peak_shell;          //!< Structure factor averaged over the shell around every peak
+
+        /*! Returns true if peak a ranks before peak b
+
+            Peaks are ordered by decreasing amplitude, ties are broken by the wave vector,
+            so that the order does not depend on how the wave vectors are distributed.
+         */
+        static bool isHigherPeak(const Scalar4& a, const Scalar4& b)
+            {
+            if (a.w != b.w) return a.w > b.w;
+            if (a.z != b.z) return a.z > b.z;
+            if (a.y != b.y) return a.y > b.y;
+            return a.x > b.x;
+            }
+
+        /*! Merge two lists of peaks
+            \param a First list, ordered
+            \param b Second list, ordered
+            \param out Output list of the highest peaks of both lists
+            \param n Number of peaks in every list
+         */
+        static void mergePeaks(const Scalar4 *a, const Scalar4 *b, Scalar4 *out, unsigned int n)
+            {
+            unsigned int i = 0, j = 0;
+            for (unsigned int l = 0; l < n; ++l)
+                out[l] = isHigherPeak(b[j], a[i]) ? b[j++] : a[i++];
+            }
+
+        #ifdef ENABLE_MPI
+        //! Replace the local peaks by the highest peaks of all ranks
+        void reducePeaks(std::vector<Scalar4>& peaks);
+
+        //! MPI reduction operator merging lists of peaks
+        static void mergePeaksOp(void *in, void *inout, int *len, MPI_Datatype *datatype);
+        #endif
+
         GlobalArray<int3> m_zero_modes;        //!< Fourier modes that should be zeroed
 
         Scalar m_k_min;                             //!< Minimum k of tabulated convolution kernel
@@ -106,6 +261,25 @@ class OrderParameterMesh : public CollectiveVariable
         GlobalArray<Scalar> m_table_d;                 //!< Tabulated kernel
         bool m_use_table;                           //!< Whether to use the tabulated kernel
 
+        unsigned int m_num_threads;                 //!< Number of host threads for the mesh operations
+        GlobalArray<int3> m_particle_cell;          //!< Mesh cell of every local particle (including ghost offset)
+        GlobalArray<Scalar3> m_particle_shift;      //!< Distance of every local particle from its cell center
+
+        unsigned int m_sort_period;                 //!< Number of mesh updates between sorts by cell (0 if disabled)
+        unsigned int m_sort_age;                    //!< Number of mesh updates since the last sort
+        bool m_sort_valid;                          //!< True if the cell-sorted order is valid
+        GlobalArray<unsigned int> m_sort_order;     //!< Local particle indices, sorted by mesh cell
+        GlobalArray<unsigned int> m_sort_cell_offsets; //!< Scratch space for the counting sort
+
+        //! Helper function to be called when the particles are reordered
+        void setParticlesSorted()
+            {
+            m_sort_valid = false;
+            }
+
+        //! Update the order in which particles are visited on the mesh
+        void updateSortOrder();
+
         //! Helper function to be called when box changes
         void setBoxChange()
             {
@@ -121,14 +295,217 @@ class OrderParameterMesh : public CollectiveVariable
         //! Compute the optimal influence function
         virtual void computeInfluenceFunction();
 
-        //! The TSC (triangular-shaped cloud) charge assignment function
-        Scalar assignTSC(Scalar x);
+        //! Update the wave vectors and the per-mode kernel values for a new box, keeping the Miller indices
+        virtual void rescaleInfluenceFunction();
+
+        //! Key of the influence function cache for the current mesh layout, box and kernel
+        std::string getInfluenceCacheKey();
+
+        /*! Read the influence function and the wave vectors from the cache file
+            \param key Key of the current configuration
+            \returns True if the file exists and matches the key
+
+            Subclasses that derive additional arrays in rescaleInfluenceFunction() must not use the
+            cache, since it is not called if the cache is read.
+         */
+        bool readInfluenceCache(const std::string& key);
+
+        /*! Write the influence function and the wave vectors to the cache file
+            \param key Key of the current configuration
+         */
+        void writeInfluenceCache(const std::string& key);
+
+        /*! Linearly interpolate a tabulated function of |k|
+            \param table The table (K or dK)
+            \param knorm Wave number
+            \param default_val Value returned outside of the tabulated range, or if no table is used
+         */
+        inline Scalar evaluateTable(const Scalar *table, Scalar knorm, Scalar default_val) const
+            {
+            if (! m_use_table || knorm < m_k_min || knorm >= m_k_max)
+                return default_val;
+
+            Scalar value_f = (knorm - m_k_min) / m_delta_k;
+            unsigned int value_i = (unsigned int) value_f;
+            Scalar K0 = table[value_i];
+            Scalar K1 = table[value_i+1];
+
+            // interpolate
+            Scalar f = value_f - Scalar(value_i);
+            return K0 + f * (K1-K0);
+            }
+
+        //! Compute the reciprocal lattice vectors of the global box (including the factor 2 pi)
+        void computeReciprocalVectors(Scalar3& b1, Scalar3& b2, Scalar3& b3) const;
+
+        //! Fourier representation of the assignment function along a single axis
+        Scalar assignFourier(Scalar x);
+
+        /*! Compute the TSC (triangular-shaped cloud) weights of the three mesh points closest to a particle
+            \param s Distance of the particle from the center of its cell (in units of the mesh size, |s| <= 1/2)
+            \param w Output weights of the cells at offsets -1, 0, +1
+
+            The weights are the quadratic B-spline, evaluated at the distances s+1, s and s-1
+            of the particle from the three mesh points.
+         */
+        inline void computeTSCWeights(Scalar s, Scalar *w) const
+            {
+            Scalar sm = Scalar(0.5) - s;
+            Scalar sp = Scalar(0.5) + s;
+            w[0] = Scalar(0.5)*sm*sm;
+            w[1] = Scalar(3.0/4.0) - s*s;
+            w[2] = Scalar(0.5)*sp*sp;
+            }
+
+        /*! Compute the TSC weights and their derivatives along a single axis
+            \param s Distance of the particle from the center of its cell (in units of the mesh size, |s| <= 1/2)
+            \param w Output weights of the cells at offsets -1, 0, +1
+            \param dw Output derivatives of the weights with respect to s
+         */
+        inline void computeTSCWeightsDeriv(Scalar s, Scalar *w, Scalar *dw) const
+            {
+            computeTSCWeights(s, w);
+            dw[0] = s - Scalar(0.5);
+            dw[1] = -Scalar(2.0)*s;
+            dw[2] = s + Scalar(0.5);
+            }
+
+        /*! Compute the B-spline weights of the m_order mesh points closest to a particle along a single axis
+            \param s Distance of the particle from the center of its cell (in units of the mesh size, |s| <= 1/2)
+            \param w Output weights
+            \param dw Output derivatives of the weights with respect to s (NULL if not needed)
+            \returns Offset of the first mesh point from the cell of the particle
+
+            The mesh points are the cell centers. For an odd order, the stencil is centered on
+            the cell of the particle, for an even order on the cell boundary closest to it.
+            The weights are evaluated with the recursion of the cardinal B-splines, and with
+            the closed form for the TSC scheme (order three).
+         */
+        inline int computeAssignmentWeights(Scalar s, Scalar *w, Scalar *dw) const
+            {
+            if (m_order == 3)
+                {
+                if (dw)
+                    computeTSCWeightsDeriv(s, w, dw);
+                else
+                    computeTSCWeights(s, w);
+                return -1;
+                }
+
+            // distance of the particle from the first mesh point of the stencil, minus (order-1)/2
+            int offset;
+            Scalar t;
+            if (m_order & 1)
+                {
+                offset = -(int)(m_order-1)/2;
+                t = s + Scalar(0.5);
+                }
+            else if (s >= Scalar(0.0))
+                {
+                offset = 1-(int)m_order/2;
+                t = s;
+                }
+            else
+                {
+                offset = -(int)m_order/2;
+                t = s + Scalar(1.0);
+                }
+
+            // raise the order of the B-spline one by one, starting from the nearest grid point
+            w[0] = Scalar(1.0);
+            for (unsigned int n = 2; n <= m_order; ++n)
+                {
+                if (n == m_order && dw)
+                    {
+                    // the derivative is the difference of two B-splines of lower order
+                    dw[0] = -w[0];
+                    for (unsigned int j = 1; j < n-1; ++j)
+                        dw[j] = w[j-1] - w[j];
+                    dw[n-1] = w[n-2];
+                    }
+
+                Scalar div = Scalar(1.0)/Scalar(n-1);
+                w[n-1] = div*t*w[n-2];
+                for (unsigned int j = 1; j < n-1; ++j)
+                    w[n-1-j] = div*((t+Scalar(j))*w[n-2-j] + (Scalar(n-j)-t)*w[n-1-j]);
+                w[0] = div*(Scalar(1.0)-t)*w[0];
+                }
 
-        //! Derivative of the TSC (triangular-shaped cloud) charge assignment function
-        Scalar assignTSCderiv(Scalar x);
+            return offset;
+            }
 
-        //! Fourier representation of the TSC (triangular-shaped cloud) charge assignment function
-        Scalar assignTSCfourier(Scalar k);
+        /*! Compute the mesh indices of the m_order cells of the stencil along a single axis
+            \param first Index of the first cell of the stencil
+            \param dim Number of mesh points along this axis, including ghost cells
+            \param periodic True if there are no ghost cells along this axis
+            \param idx Output indices
+         */
+        inline void computeStencilIndices(int first, int dim, bool periodic, int *idx) const
+            {
+            for (int n = 0; n < (int) m_order; ++n)
+                {
+                int neigh = first + n;
+                if (periodic)
+                    {
+                    neigh %= dim;
+                    if (neigh < 0)
+                        neigh += dim;
+                    }
+                assert(neigh >= 0 && neigh < dim);
+                idx[n] = neigh;
+                }
+            }
+
+        /*! Move a particle to the mesh shifted by half a cell along every axis
+            \param cell Index of the cell the particle is in, replaced by that of the shifted mesh
+            \param shift Distance from the cell center, replaced by that from the shifted cell center
+
+            The shifted mesh point with index i is located half a cell above the
+            center of cell i, so a particle can end up one cell further down.
+         */
+        inline void computeShiftedCell(int3& cell, Scalar3& shift) const
+            {
+            shift -= make_scalar3(0.5,0.5,m_2d ? 0.0 : 0.5);
+            if (shift.x < Scalar(-0.5)) { shift.x += Scalar(1.0); cell.x--; }
+            if (shift.y < Scalar(-0.5)) { shift.y += Scalar(1.0); cell.y--; }
+            if (shift.z < Scalar(-0.5)) { shift.z += Scalar(1.0); cell.z--; }
+            }
+
+        /*! Compute the weights and the mesh indices of the stencil along z
+            \param cell Index of the cell the particle is in
+            \param s Distance of the particle from the center of its cell along z
+            \param w Output weights
+            \param dw Output derivatives of the weights (NULL if not needed)
+            \param idx Output indices
+            \returns Number of mesh points of the stencil along z
+
+            In two dimensions, every particle is assigned to the single mesh layer.
+         */
+        inline int computeStencilZ(const int3& cell, Scalar s, Scalar *w, Scalar *dw, int *idx) const
+            {
+            if (m_2d)
+                {
+                w[0] = Scalar(1.0);
+                if (dw)
+                    dw[0] = Scalar(0.0);
+                idx[0] = cell.z;
+                return 1;
+                }
+
+            int oz = computeAssignmentWeights(s, w, dw);
+            computeStencilIndices(cell.z+oz, m_grid_dim.z, !m_n_ghost_cells.z, idx);
+            return m_order;
+            }
+
+        //! Find the mesh cell of a particle and its distance from the cell center
+        void computeParticleCell(const BoxDim& box, const Scalar3& pos, int3& cell, Scalar3& shift) const;
+
+        //! Compute the mesh cells and cell center distances of all local particles
+        void computeParticleCells();
+
+        //! Assign a single particle to the mesh
+        void assignParticle(mesh_scalar *mesh, unsigned int stride,
+            const int3& cell, const Scalar3& shift, Scalar mode) const;
 
         //! Helper function to assign particle coordinates to mesh
         virtual void assignParticles();
@@ -136,6 +513,11 @@ class OrderParameterMesh : public CollectiveVariable
         //! Helper function to update the mesh arrays
         virtual void updateMeshes();
 
+        /*! Compute the force mesh m_fourier_mesh_G from the transformed density mesh
+            \param compute_virial If true, also sum up the virial
+         */
+        virtual void computeForceMesh(bool compute_virial);
+
         //! Helper function to interpolate the forces
         virtual void interpolateForces();
 
@@ -148,33 +530,212 @@ class OrderParameterMesh : public CollectiveVariable
         //! Helper function to compute q vector with maximum amplitude
         virtual void computeQmax(unsigned int timestep);
 
-    private:
-        kiss_fftnd_cfg m_kiss_fft;         //!< The FFT configuration
-        kiss_fftnd_cfg m_kiss_ifft;        //!< Inverse FFT configuration
+        /*! Interpolate the forces from a potential mesh
+            \param inv_mesh Real space potential mesh
+            \param shifted_inv_mesh Potential on the shifted mesh, if interlaced (NULL otherwise)
+            \param stride Distance between consecutive mesh points in units of mesh_scalar
+            \param mode_data Per-type mode amplitudes
+            \param bias Bias factor multiplying the forces
+            \param force_data Output force array
+            \param order Local particle indices to interpolate (NULL for all particles)
+            \param n Number of particles in order
+         */
+        void interpolateMesh(const mesh_scalar *inv_mesh, const mesh_scalar *shifted_inv_mesh,
+            unsigned int stride, const Scalar *mode_data, Scalar bias, Scalar4 *force_data,
+            const unsigned int *order = NULL, unsigned int n = 0);
+
+        /*! Interpolate the gradient of a potential mesh at a particle position
+            \param inv_mesh Real space potential mesh
+            \param stride Distance between consecutive mesh points in units of mesh_scalar
+            \param cell Index of the cell the particle is in
+            \param shift Distance of the particle from the cell center
+            \returns The gradient in fractional mesh coordinates
+         */
+        Scalar3 interpolateGradient(const mesh_scalar *inv_mesh, unsigned int stride,
+            const int3& cell, const Scalar3& shift) const;
+
+        //! Returns true if the particles can be assigned by threads working on slabs of the mesh
+        bool canAssignSlabs() const
+            {
+            return m_num_threads > 1 && m_grid_dim.z >= 2*m_num_threads*(2*m_radius+1);
+            }
+
+        //! Sort the local particles by chunks of slabs along z, returns the number of chunks
+        unsigned int computeSlabChunks();
+
+        /*! Sort a subset of the local particles by chunks of slabs along z
+            \param order Local particle indices in the order of traversal (NULL for all particles in index order)
+            \param n Number of particles
+            \returns The number of chunks
+         */
+        unsigned int computeSlabChunks(const unsigned int *order, unsigned int n);
+
+        std::unique_ptr<MeshFFT> m_local_fft;  //!< The local FFT, if the mesh is not decomposed
+        bool m_allow_real_fft;                 //!< False if the local FFT has to be complex-to-complex
+        bool m_real_fft;                       //!< True if the local FFT only stores the non-redundant half spectrum
 
         #ifdef ENABLE_MPI
         dfft_plan m_dfft_plan_forward;     //!< Distributed FFT for forward transform
         dfft_plan m_dfft_plan_inverse;     //!< Distributed FFT for inverse transform
-        std::unique_ptr<CommunicatorGrid<kiss_fft_cpx> > m_grid_comm_forward; //!< Communicator for charge mesh
-        std::unique_ptr<CommunicatorGrid<kiss_fft_cpx> > m_grid_comm_reverse; //!< Communicator for inv fourier mesh
+        std::unique_ptr<CommunicatorGridAsync<mesh_cpx> > m_grid_comm_forward; //!< Communicator for charge mesh
+        std::unique_ptr<CommunicatorGridAsync<mesh_cpx> > m_grid_comm_reverse; //!< Communicator for inv fourier mesh
+        std::unique_ptr<CommunicatorGridAsync<mesh_cpx> > m_shifted_grid_comm_reverse; //!< Communicator for the shifted force mesh
+        std::unique_ptr<GatherMeshFFT> m_gather_fft;  //!< Distributed FFT on the root rank, if used instead of dfft
+
+        //! Returns true if the mesh should be transformed on the root rank instead of with dfft
+        bool useGatherFFT() const;
+        #ifdef MESH_MIXED_PRECISION
+        GlobalArray<kiss_fft_cpx> m_dfft_in;   //!< Input of the distributed FFT in Scalar precision
+        GlobalArray<kiss_fft_cpx> m_dfft_out;  //!< Output of the distributed FFT in Scalar precision
         #endif
 
-        bool m_kiss_fft_initialized;               //!< True if a local KISS FFT has been set up
+        /*! Distributed FFT of the local part of the mesh
+            \param in Input mesh (including the ghost layer for the forward transform)
+            \param out Output mesh (including the ghost layer for the inverse transform)
+            \param inverse True for the inverse transform
+         */
+        void executeDistributedFFT(const mesh_cpx *in, mesh_cpx *out, bool inverse);
+        #endif
+
+        GlobalArray<mesh_cpx> m_mesh;                 //!< The particle density mesh
+        GlobalArray<mesh_cpx> m_fourier_mesh;         //!< The fourier transformed mesh
+        GlobalArray<mesh_cpx> m_fourier_mesh_G;       //!< Fourier transformed mesh times the influence function
+        GlobalArray<mesh_cpx> m_inv_fourier_mesh;     //!< The inverse-Fourier transformed mesh
+
+        GlobalArray<unsigned int> m_slab_offsets;  //!< Start of every slab chunk in the sorted particle list
+        GlobalArray<unsigned int> m_slab_particles; //!< Local particle indices, sorted by slab chunk
 
-        GlobalArray<kiss_fft_cpx> m_mesh;             //!< The particle density mesh
-        GlobalArray<kiss_fft_cpx> m_fourier_mesh;     //!< The fourier transformed mesh
-        GlobalArray<kiss_fft_cpx> m_fourier_mesh_G;   //!< Fourier transformed mesh times the influence function
-        GlobalArray<kiss_fft_cpx> m_inv_fourier_mesh; //!< The inverse-Fourier transformed mesh
+    private:
+        std::string m_fft_backend;         //!< Name of the local FFT backend
+        std::string m_fft_wisdom_file;     //!< File for FFTW wisdom
+        std::string m_influence_cache_file; //!< File for the cached influence function
+        std::string m_distributed_fft;     //!< Distributed FFT method ("auto", "dfft" or "gather")
+
+        GlobalArray<mesh_scalar> m_real_mesh;                 //!< The particle density mesh (real-to-complex FFT)
+        GlobalArray<mesh_scalar> m_real_inv_fourier_mesh;     //!< The inverse-Fourier transformed mesh (real FFT)
+
+        GlobalArray<mesh_cpx> m_shifted_mesh;                    //!< The density on the shifted mesh
+        GlobalArray<mesh_scalar> m_real_shifted_mesh;            //!< The density on the shifted mesh (real FFT)
+        GlobalArray<mesh_cpx> m_shifted_fourier_mesh;            //!< Transform of the shifted mesh, then of its force mesh
+        GlobalArray<mesh_cpx> m_shifted_inv_mesh;                //!< The force mesh on the shifted mesh points
+        GlobalArray<mesh_scalar> m_real_shifted_inv_mesh;        //!< The force mesh on the shifted mesh points (real FFT)
+        GlobalArray<mesh_cpx> m_interlace_phase;                 //!< Phase factor of the shifted mesh per wave vector
 
         std::vector<std::string> m_log_names;           //!< Name of the log quantity
 
         bool m_dfft_initialized;                   //! True if host dfft has been initialized
 
+        GlobalArray<mesh_scalar> m_thread_mesh;     //!< Private density meshes of the assignment threads
+
+        GlobalArray<unsigned int> m_overlap_order;  //!< Local particles near the ghost layer first, then the others
+        unsigned int m_n_boundary;                 //!< Number of particles near the ghost layer
+
+        //! Assign particles with threads working on non-adjacent slabs of the mesh
+        void assignParticlesSlabs(mesh_scalar *mesh, unsigned int stride, bool shifted,
+            const unsigned int *order, unsigned int n);
+
+        //! Assign particles with threads working on private meshes
+        void assignParticlesPrivate(mesh_scalar *mesh, unsigned int stride, bool shifted,
+            const unsigned int *order, unsigned int n);
+
+        //! Assign a subset of the local particles to the (shifted) mesh
+        void assignParticlesMesh(mesh_scalar *mesh, unsigned int stride, bool shifted,
+            const unsigned int *order, unsigned int n);
+
+        #ifdef ENABLE_MPI
+        //! Returns true if the assignment stencil of a particle in a given cell reaches into the ghost layer
+        bool isBoundaryCell(const int3& cell) const
+            {
+            // the shifted mesh reaches one cell further down
+            int r_lo = m_radius + (m_interlace ? 1 : 0);
+            int r_hi = m_radius;
+            if (m_n_ghost_cells.x && (cell.x - r_lo < (int) m_n_ghost_cells.x || cell.x + r_hi >= (int)(m_n_ghost_cells.x + m_mesh_points.x)))
+                return true;
+            if (m_n_ghost_cells.y && (cell.y - r_lo < (int) m_n_ghost_cells.y || cell.y + r_hi >= (int)(m_n_ghost_cells.y + m_mesh_points.y)))
+                return true;
+            if (m_n_ghost_cells.z && (cell.z - r_lo < (int) m_n_ghost_cells.z || cell.z + r_hi >= (int)(m_n_ghost_cells.z + m_mesh_points.z)))
+                return true;
+            return false;
+            }
+
+        //! Order the local particles with those near the ghost layer first, returns their number
+        unsigned int computeOverlapOrder(const unsigned int *order);
+        #endif
+
+        //! Transform a density mesh to Fourier space
+        void forwardTransform(const GlobalArray<mesh_cpx>& mesh, const GlobalArray<mesh_scalar>& real_mesh,
+            const GlobalArray<mesh_cpx>& fourier_mesh);
+
+        //! Transform a force mesh back to real space
+        void inverseTransform(const GlobalArray<mesh_cpx>& fourier_mesh, const GlobalArray<mesh_cpx>& inv_mesh,
+            const GlobalArray<mesh_scalar>& real_inv_mesh, bool shifted);
+
+        Scalar m_cv_sum;                           //!< Local sum of the collective variable over the Fourier mesh
+        Scalar m_virial_sum[6];                    //!< Local virial sum over the Fourier mesh (without bias)
+        bool m_virial_valid;                       //!< True if m_virial_sum is up to date with the Fourier mesh
+        std::vector<Scalar4> m_local_peaks;        //!< Highest local peaks of the Fourier mesh (amplitude in w)
+        bool m_local_peaks_valid;                  //!< True if the local peaks are up to date with the Fourier mesh
+        bool m_q_max_requested;                    //!< True if q_max has been requested at least once
+        uint3 m_global_mesh_points;                //!< Number of mesh points of the global mesh
+
+        GlobalArray<unsigned int> m_sk_bin;        //!< Structure factor shell of every wave vector (n_bins if outside)
+        unsigned int m_sk_n_bins;                  //!< Number of shells of the cached bin indices
+        Scalar m_sk_k_max;                         //!< Upper edge of the shells of the cached bin indices
+        bool m_sk_bin_valid;                       //!< True if the cached bin indices are up to date with |k|
+
+        //! Update the names of the log quantities for the current number of peaks
+        void updateLogNames();
+
+        /*! Returns true if a locally stored wave vector may be reported as a peak
+            \param n Miller indices of the wave vector
+
+            Of a wave vector and its conjugate partner, which have the same amplitude,
+            only one is a peak. With a real-to-complex FFT, the partner of most wave
+            vectors is not stored, and they are always candidates.
+         */
+        bool isPeakCandidate(const int3& n) const
+            {
+            // Miller indices of the partner, the Nyquist frequency is its own partner
+            int3 m = make_int3(-n.x, -n.y, -n.z);
+            if (2*n.x == -(int)m_global_mesh_points.x) m.x = n.x;
+            if (2*n.y == -(int)m_global_mesh_points.y) m.y = n.y;
+            if (2*n.z == -(int)m_global_mesh_points.z) m.z = n.z;
+
+            if (m_real_fft && n.x != m.x)
+                return true;
+
+            if (n.z != m.z) return n.z > m.z;
+            if (n.y != m.y) return n.y > m.y;
+            return n.x >= m.x;
+            }
+
+        //! Average the structure factor over the shells around the peaks
+        void computePeakShells();
+
+        //! Single pass over the Fourier mesh computing all requested quantities
+        void sweepFourierMesh(bool build_G, bool compute_virial, bool compute_q_max);
+
         //! Compute virial on mesh
         void computeVirialMesh();
 
         //! Compute number of ghost cellso
         uint3 computeGhostCellNum();
+
+        /*! Returns the number of modes represented by a locally stored wave vector
+            \param kidx Index of the wave vector
+
+            With a real-to-complex FFT, every wave vector of the half spectrum
+            except those on the kx=0 and kx=Nx/2 planes stands for itself and its
+            complex conjugate partner -k.
+         */
+        Scalar getConjugateWeight(unsigned int kidx) const
+            {
+            if (! m_real_fft)
+                return Scalar(1.0);
+
+            unsigned int l = kidx % (m_mesh_points.x/2+1);
+            return (l == 0 || 2*l == m_mesh_points.x) ? Scalar(1.0) : Scalar(2.0);
+            }
     };
 
 void export_OrderParameterMesh(pybind11::module& m);
@@ -54,6 +54,58 @@ OrderParameterMeshGPU::~OrderParameterMeshGPU()
     #endif
     }
 
+void OrderParameterMeshGPU::setOrder(unsigned int order)
+    {
+    if (order != 3)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: The GPU implementation only supports assignment order 3." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+    }
+
+void OrderParameterMeshGPU::setInterlace(bool interlace)
+    {
+    if (interlace)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: Interlacing is not supported on the GPU." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+    }
+
+void OrderParameterMeshGPU::setDeconvolve(bool deconvolve)
+    {
+    if (deconvolve)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: Deconvolution of the assignment function is not supported on the GPU." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+    }
+
+void OrderParameterMeshGPU::setNumPeaks(unsigned int num_peaks)
+    {
+    if (num_peaks != 1)
+        {
+        m_exec_conf->msg->error() << "cv.mesh: The GPU implementation only tracks a single peak." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+    }
+
+void OrderParameterMeshGPU::setPeakShellWidth(Scalar width)
+    {
+    if (width != Scalar(0.0))
+        {
+        m_exec_conf->msg->error() << "cv.mesh: Peak shell averaging is not supported on the GPU." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh");
+        }
+    }
+
+void OrderParameterMeshGPU::computeStructureFactor(unsigned int timestep, unsigned int n_bins, Scalar k_max,
+    std::vector<Scalar>& sk, std::vector<Scalar>& n_modes)
+    {
+    m_exec_conf->msg->error() << "analyze.structure_factor: Not supported with the GPU implementation of cv.mesh." << std::endl << std::endl;
+    throw std::runtime_error("Error computing structure factor");
+    }
+
 void OrderParameterMeshGPU::initializeFFT()
     {
     #ifdef ENABLE_MPI
@@ -135,6 +187,9 @@ void OrderParameterMeshGPU::initializeFFT()
     GlobalArray<cufftComplex> inv_fourier_mesh(m_n_cells, m_exec_conf);
     m_inv_fourier_mesh.swap(inv_fourier_mesh);
 
+    GlobalArray<Scalar> virial_mesh(6*m_n_inner_cells, m_exec_conf);
+    m_virial_mesh.swap(virial_mesh);
+
     GlobalArray<Scalar4> particle_bins(m_bin_idx.getNumElements(), m_exec_conf);
     m_particle_bins.swap(particle_bins);
 
@@ -535,26 +590,10 @@ void OrderParameterMeshGPU::computeQmax(unsigned int timestep)
     #ifdef ENABLE_MPI
     if (m_pdata->getDomainDecomposition())
         {
-        // all processes send their results to all other processes
-        // and then they determine the maximum wave vector
-        Scalar4 *all_q_max = new Scalar4[m_exec_conf->getNRanks()];
-        MPI_Allgather(&q_max,
-                     sizeof(Scalar4),
-                     MPI_BYTE,
-                     all_q_max,
-                     sizeof(Scalar4),
-                     MPI_BYTE,
-                     m_exec_conf->getMPICommunicator());
-
-        for (unsigned int i = 0; i < m_exec_conf->getNRanks(); ++i)
-            {
-            if (all_q_max[i].w > q_max.w)
-                {
-                q_max = all_q_max[i];
-                }
-            }
-
-        delete[] all_q_max;
+        // find the maximum wave vector over all processes
+        std::vector<Scalar4> peaks(1, q_max);
+        reducePeaks(peaks);
+        q_max = peaks[0];
         }
     #endif
 
@@ -566,6 +605,9 @@ void OrderParameterMeshGPU::computeQmax(unsigned int timestep)
     // normalize with 1/V
     unsigned int n_global = m_pdata->getNGlobal();
     m_sq_max *= (Scalar)n_global;
+
+    m_peaks[0] = make_scalar4(m_q_max.x, m_q_max.y, m_q_max.z, m_sq_max);
+    m_peak_shell[0] = m_sq_max;
     }
 
 
@@ -19,40 +19,6 @@ __device__ inline void atomicFloatAdd(float* address, float value)
     }
 
 
-/*! \param x Distance on mesh in units of the mesh size
- */
-__device__ inline Scalar assignTSC(Scalar x)
-    {
-    Scalar xsq = x*x;
-    Scalar fac =(Scalar(3.0/2.0)-copysignf(x,Scalar(1.0)));
-
-    Scalar ret(0.0);
-    if (xsq <= Scalar(1.0/4.0))
-        ret = Scalar(3.0/4.0) - xsq;
-    else if (xsq <= Scalar(9.0/4.0))
-        ret = Scalar(1.0/2.0)*fac*fac;
-
-    return ret;
-    }
-
-/*! \param x Distance on mesh in units of the mesh size
- */
-__device__ inline Scalar assignTSCderiv(Scalar x)
-    {
-    Scalar xsq = x*x;
-    Scalar xabs = copysignf(x,Scalar(1.0));
-    Scalar fac =(Scalar(3.0/2.0)-xabs);
-
-    Scalar ret(0.0);
-    if (xsq <= Scalar(1.0/4.0))
-        ret = -Scalar(2.0)*x;
-    else if (xsq <= Scalar(9.0/4.0))
-        ret = -fac*x/xabs;
-
-    return ret;
-    }
-
-
 __device__ int3 find_cell(const Scalar3& pos,
                            const unsigned int& inner_nx,
                            const unsigned int& inner_ny,
@@ -33,6 +33,25 @@ class OrderParameterMeshGPU : public OrderParameterMesh
                            const std::vector<int3> zero_modes = std::vector<int3>());
         virtual ~OrderParameterMeshGPU();
 
+        //! Set the order of the assignment function (only order three is supported)
+        virtual void setOrder(unsigned int order);
+
+        //! Interlacing is not supported on the GPU
+        virtual void setInterlace(bool interlace);
+
+        //! Deconvolution of the assignment function is not supported on the GPU
+        virtual void setDeconvolve(bool deconvolve);
+
+        //! Only the highest peak is tracked on the GPU
+        virtual void setNumPeaks(unsigned int num_peaks);
+
+        //! Peak shell averaging is not supported on the GPU
+        virtual void setPeakShellWidth(Scalar width);
+
+        //! Binning of the structure factor is not supported on the GPU
+        virtual void computeStructureFactor(unsigned int timestep, unsigned int n_bins, Scalar k_max,
+            std::vector<Scalar>& sk, std::vector<Scalar>& n_modes);
+
     protected:
         //! Helper function to setup FFT and allocate the mesh arrays
         virtual void initializeFFT();
@@ -72,6 +91,7 @@ class OrderParameterMeshGPU : public OrderParameterMesh
         GlobalArray<cufftComplex> m_fourier_mesh;         //!< The fourier transformed mesh
         GlobalArray<cufftComplex> m_fourier_mesh_G;       //!< Fourier transformed mesh times the influence function
         GlobalArray<cufftComplex> m_inv_fourier_mesh;     //!< The inverse-fourier transformed force mesh
+        GlobalArray<Scalar> m_virial_mesh;                //!< k-space mesh of virial tensor values
 
         Index2D m_bin_idx;                         //!< Total number of bins
         GlobalArray<Scalar4> m_particle_bins;         //!< Cell list for particle positions and modes
@@ -0,0 +1,736 @@
+/*! \file OrderParameterMeshMulti.cc
+    \brief Implements several mesh order parameters sharing one density mesh
+ */
+
+#include "OrderParameterMeshMulti.h"
+
+namespace py = pybind11;
+
+/*! \param sysdef The system definition
+    \param nx Number of cells along first axis
+    \param ny Number of cells along second axis
+    \param nz Number of cells along third axis
+    \param modes Per-type modes of every channel, channel after channel
+    \param fft_backend Local FFT backend ("auto", "kiss" or "fftw")
+ */
+OrderParameterMeshMulti::OrderParameterMeshMulti(std::shared_ptr<SystemDefinition> sysdef,
+                                                 const unsigned int nx,
+                                                 const unsigned int ny,
+                                                 const unsigned int nz,
+                                                 const std::vector<Scalar>& modes,
+                                                 const std::string& fft_backend)
+    : OrderParameterMesh(sysdef, nx, ny, nz,
+        std::vector<Scalar>(modes.begin(),
+            modes.begin() + std::min((unsigned int) modes.size(), sysdef->getParticleData()->getNTypes())),
+        std::vector<int3>(), fft_backend),
+      m_n_channels(0),
+      m_channels_per_fft(2),
+      m_n_ffts(0),
+      m_channel_virial_valid(false)
+    {
+    unsigned int ntypes = m_pdata->getNTypes();
+
+    if (modes.size() % ntypes)
+        {
+        m_exec_conf->msg->error() << "cv.mesh_multi: Number of modes not a multiple of the number of particle types."
+                                  << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh_multi");
+        }
+
+    m_n_channels = modes.size()/ntypes;
+
+    #ifdef ENABLE_MPI
+    // the conjugate partner of a wave vector is stored on a different rank
+    if (m_pdata->getDomainDecomposition())
+        m_channels_per_fft = 1;
+    #endif
+
+    m_n_ffts = (m_n_channels + m_channels_per_fft - 1)/m_channels_per_fft;
+
+    // the channels are packed into the real and imaginary part of a complex transform
+    m_allow_real_fft = false;
+
+    GlobalArray<Scalar> channel_mode(m_n_channels*ntypes, m_exec_conf);
+    m_channel_mode.swap(channel_mode);
+
+    GlobalArray<mesh_cpx> packed_mode(ntypes*m_n_ffts, m_exec_conf);
+    m_packed_mode.swap(packed_mode);
+
+    ArrayHandle<Scalar> h_channel_mode(m_channel_mode, access_location::host, access_mode::overwrite);
+    ArrayHandle<mesh_cpx> h_packed_mode(m_packed_mode, access_location::host, access_mode::overwrite);
+
+    std::copy(modes.begin(), modes.end(), h_channel_mode.data);
+
+    for (unsigned int type = 0; type < ntypes; ++type)
+        for (unsigned int fft = 0; fft < m_n_ffts; ++fft)
+            {
+            unsigned int channel = fft*m_channels_per_fft;
+            mesh_cpx mode;
+            mode.r = modes[channel*ntypes + type];
+            mode.i = (m_channels_per_fft == 2 && channel+1 < m_n_channels) ? modes[(channel+1)*ntypes + type] : Scalar(0.0);
+            h_packed_mode.data[type*m_n_ffts + fft] = mode;
+            }
+
+    m_channel_mode_sq.resize(m_n_channels, Scalar(0.0));
+    m_channel_k_min.resize(m_n_channels, Scalar(0.0));
+    m_channel_k_max.resize(m_n_channels, Scalar(0.0));
+    m_channel_delta_k.resize(m_n_channels, Scalar(0.0));
+    m_channel_use_table.resize(m_n_channels, false);
+    m_channel_table_d.resize(m_n_channels);
+    m_channel_cv_sum.resize(m_n_channels, Scalar(0.0));
+    m_channel_cv.resize(m_n_channels, Scalar(0.0));
+    m_channel_virial_sum.resize(6*m_n_channels, Scalar(0.0));
+    }
+
+void OrderParameterMeshMulti::setInterlace(bool interlace)
+    {
+    if (interlace)
+        {
+        m_exec_conf->msg->error() << "cv.mesh_multi: Interlacing is not supported." << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh_multi");
+        }
+    }
+
+void OrderParameterMeshMulti::checkChannel(unsigned int channel) const
+    {
+    if (channel >= m_n_channels)
+        {
+        m_exec_conf->msg->error() << "cv.mesh_multi: Invalid channel " << channel << std::endl << std::endl;
+        throw std::runtime_error("Error accessing cv.mesh_multi");
+        }
+    }
+
+/*! Only the derivative of the kernel is stored, since the kernel itself does not
+    enter the value of the order parameter
+ */
+void OrderParameterMeshMulti::setChannelTable(unsigned int channel,
+                                              const std::vector<Scalar> &K,
+                                              const std::vector<Scalar> &d_K,
+                                              Scalar kmin,
+                                              Scalar kmax)
+    {
+    checkChannel(channel);
+
+    // range check on the parameters
+    if (kmin < 0 || kmax < 0 || kmax <= kmin)
+        {
+        m_exec_conf->msg->error() << "cv.mesh_multi kmin, kmax (" << kmin << "," << kmax
+             << ") is invalid" << std::endl;
+        throw std::runtime_error("Error setting up OrderParameterMeshMulti");
+        }
+
+    if (K.size() != d_K.size())
+        {
+        m_exec_conf->msg->error() << "Convolution kernel and derivative have tables of unequal length "
+            << K.size() << " != " << d_K.size() << std::endl;
+        throw std::runtime_error("Error setting up OrderParameterMeshMulti");
+        }
+
+    m_channel_k_min[channel] = kmin;
+    m_channel_k_max[channel] = kmax;
+    m_channel_delta_k[channel] = (kmax - kmin) / Scalar(K.size() - 1);
+    m_channel_table_d[channel] = d_K;
+
+    m_kernel_changed = true;
+    }
+
+void OrderParameterMeshMulti::setChannelUseTable(unsigned int channel, bool use_table)
+    {
+    checkChannel(channel);
+
+    m_channel_use_table[channel] = use_table;
+    m_kernel_changed = true;
+    }
+
+Scalar OrderParameterMeshMulti::evaluateChannelTable(unsigned int channel, Scalar knorm) const
+    {
+    if (! m_channel_use_table[channel] || knorm < m_channel_k_min[channel] || knorm >= m_channel_k_max[channel])
+        return Scalar(0.0);
+
+    const std::vector<Scalar>& table = m_channel_table_d[channel];
+    Scalar value_f = (knorm - m_channel_k_min[channel]) / m_channel_delta_k[channel];
+    unsigned int value_i = (unsigned int) value_f;
+    Scalar K0 = table[value_i];
+    Scalar K1 = table[value_i+1];
+
+    // interpolate
+    Scalar f = value_f - Scalar(value_i);
+    return K0 + f * (K1-K0);
+    }
+
+void OrderParameterMeshMulti::initializeFFT()
+    {
+    OrderParameterMesh::initializeFFT();
+
+    // with a local FFT, the channels are transformed directly from and into the packed meshes
+    if (m_local_fft)
+        {
+        GlobalArray<mesh_cpx> mesh;
+        m_mesh.swap(mesh);
+
+        GlobalArray<mesh_cpx> inv_fourier_mesh;
+        m_inv_fourier_mesh.swap(inv_fourier_mesh);
+        }
+
+    GlobalArray<mesh_cpx> channel_mesh(m_n_ffts*m_n_cells, m_exec_conf);
+    m_channel_mesh.swap(channel_mesh);
+
+    GlobalArray<mesh_cpx> channel_inv_mesh(m_n_ffts*m_n_cells, m_exec_conf);
+    m_channel_inv_mesh.swap(channel_inv_mesh);
+
+    GlobalArray<Scalar> channel_virial_kfac(m_n_channels*m_n_fourier_cells, m_exec_conf);
+    m_channel_virial_kfac.swap(channel_virial_kfac);
+    }
+
+void OrderParameterMeshMulti::rescaleInfluenceFunction()
+    {
+    // shared wave vectors
+    OrderParameterMesh::rescaleInfluenceFunction();
+
+    ArrayHandle<Scalar> h_knorm(m_knorm, access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_channel_virial_kfac(m_channel_virial_kfac, access_location::host, access_mode::overwrite);
+
+    for (unsigned int channel = 0; channel < m_n_channels; ++channel)
+        {
+        Scalar *kfac = h_channel_virial_kfac.data + channel*m_n_fourier_cells;
+
+        #pragma omp parallel for schedule(static) num_threads(m_num_threads)
+        for (int cell_idx = 0; cell_idx < (int) m_n_fourier_cells; ++cell_idx)
+            {
+            Scalar knorm = h_knorm.data[cell_idx];
+
+            // the DC bin does not contribute to the virial
+            kfac[cell_idx] = (knorm > Scalar(0.0)) ?
+                evaluateChannelTable(channel, knorm)/(Scalar(2.0)*knorm) : Scalar(0.0);
+            }
+        }
+    }
+
+/*! \param mesh The packed meshes of all transforms
+    \param cell Index of the cell the particle is in
+    \param shift Distance of the particle from the cell center
+    \param mode Packed mode amplitudes of the particle type, per transform
+ */
+void OrderParameterMeshMulti::assignParticleChannels(mesh_cpx *mesh, const int3& cell, const Scalar3& shift,
+    const mesh_cpx *mode) const
+    {
+    // per-axis weights of the m_order nearest mesh points
+    Scalar wx[max_order], wy[max_order], wz[max_order];
+    int ox = computeAssignmentWeights(shift.x, wx, NULL);
+    int oy = computeAssignmentWeights(shift.y, wy, NULL);
+
+    // wrapped mesh indices along every axis
+    int ni[max_order], nj[max_order], nk[max_order];
+    computeStencilIndices(cell.x+ox, m_grid_dim.x, !m_n_ghost_cells.x, ni);
+    computeStencilIndices(cell.y+oy, m_grid_dim.y, !m_n_ghost_cells.y, nj);
+    int order_z = computeStencilZ(cell, shift.z, wz, NULL, nk);
+
+    int order = m_order;
+    for (int k = 0; k < order_z; ++k)
+        for (int j = 0; j < order; ++j)
+            {
+            mesh_scalar wjk = wz[k]*wy[j];
+
+            // store in row major order
+            unsigned int row = m_grid_dim.x * (nj[j] + m_grid_dim.y*nk[k]);
+
+            for (int i = 0; i < order; ++i)
+                {
+                mesh_scalar w = wjk*(mesh_scalar)wx[i];
+                mesh_cpx *cell_mesh = mesh + row + ni[i];
+
+                // the weights are shared by all channels
+                for (unsigned int fft = 0; fft < m_n_ffts; ++fft)
+                    {
+                    cell_mesh[fft*m_n_cells].r += w*mode[fft].r;
+                    cell_mesh[fft*m_n_cells].i += w*mode[fft].i;
+                    }
+                }
+            }
+    }
+
+void OrderParameterMeshMulti::assignParticles()
+    {
+    if (m_prof) m_prof->push("assign");
+
+    computeParticleCells();
+
+    if (m_sort_period)
+        updateSortOrder();
+
+    unsigned int n_chunks = canAssignSlabs() ? computeSlabChunks() : 0;
+
+    ArrayHandle<mesh_cpx> h_channel_mesh(m_channel_mesh, access_location::host, access_mode::overwrite);
+    ArrayHandle<mesh_cpx> h_packed_mode(m_packed_mode, access_location::host, access_mode::read);
+    ArrayHandle<Scalar4> h_postype(m_pdata->getPositions(), access_location::host, access_mode::read);
+    ArrayHandle<int3> h_particle_cell(m_particle_cell, access_location::host, access_mode::read);
+    ArrayHandle<Scalar3> h_particle_shift(m_particle_shift, access_location::host, access_mode::read);
+
+    // set meshes to zero
+    memset(h_channel_mesh.data, 0, sizeof(mesh_cpx)*m_n_ffts*m_n_cells);
+
+    unsigned int nparticles = m_pdata->getN();
+
+    if (n_chunks)
+        {
+        ArrayHandle<unsigned int> h_slab_offsets(m_slab_offsets, access_location::host, access_mode::read);
+        ArrayHandle<unsigned int> h_slab_particles(m_slab_particles, access_location::host, access_mode::read);
+
+        // process even, then odd chunks
+        for (unsigned int parity = 0; parity < 2; ++parity)
+            {
+            #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+            for (int chunk = parity; chunk < (int) n_chunks; chunk += 2)
+                {
+                for (unsigned int i = h_slab_offsets.data[chunk]; i < h_slab_offsets.data[chunk+1]; ++i)
+                    {
+                    unsigned int idx = h_slab_particles.data[i];
+                    unsigned int type = __scalar_as_int(h_postype.data[idx].w);
+                    assignParticleChannels(h_channel_mesh.data, h_particle_cell.data[idx], h_particle_shift.data[idx],
+                        h_packed_mode.data + type*m_n_ffts);
+                    }
+                }
+            }
+        }
+    else
+        {
+        ArrayHandle<unsigned int> h_sort_order(m_sort_order, access_location::host, access_mode::read);
+        bool sorted = m_sort_period > 0;
+
+        // loop over local particles
+        for (unsigned int i = 0; i < nparticles; ++i)
+            {
+            unsigned int idx = sorted ? h_sort_order.data[i] : i;
+            unsigned int type = __scalar_as_int(h_postype.data[idx].w);
+            assignParticleChannels(h_channel_mesh.data, h_particle_cell.data[idx], h_particle_shift.data[idx],
+                h_packed_mode.data + type*m_n_ffts);
+            }
+        }
+
+    ArrayHandle<Scalar> h_channel_mode(m_channel_mode, access_location::host, access_mode::read);
+    unsigned int ntypes = m_pdata->getNTypes();
+
+    for (unsigned int channel = 0; channel < m_n_channels; ++channel)
+        {
+        const Scalar *mode = h_channel_mode.data + channel*ntypes;
+
+        Scalar mode_sq(0.0);
+        for (unsigned int idx = 0; idx < nparticles; ++idx)
+            {
+            unsigned int type = __scalar_as_int(h_postype.data[idx].w);
+            mode_sq += mode[type]*mode[type];
+            }
+        m_channel_mode_sq[channel] = mode_sq;
+        }
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        // reduce sum
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &m_channel_mode_sq.front(),
+                      m_n_channels,
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
+        }
+    #endif
+
+    if (m_prof) m_prof->pop();
+    }
+
+void OrderParameterMeshMulti::updateMeshes()
+    {
+    PDataFlags flags = m_pdata->getFlags();
+    transformChannels(flags[pdata_flag::pressure_tensor] || flags[pdata_flag::isotropic_virial]);
+    }
+
+/*! \param compute_virial If true, also sum up the virial of every channel
+
+    The transforms are processed one after another, reusing the Fourier space
+    meshes of the base class.
+ */
+void OrderParameterMeshMulti::transformChannels(bool compute_virial)
+    {
+    for (unsigned int fft = 0; fft < m_n_ffts; ++fft)
+        {
+        if (m_local_fft)
+            {
+            if (m_prof) m_prof->push("FFT");
+            ArrayHandle<mesh_cpx> h_channel_mesh(m_channel_mesh, access_location::host, access_mode::read);
+            ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::overwrite);
+            m_local_fft->forward(h_channel_mesh.data + fft*m_n_cells, h_fourier_mesh.data);
+            if (m_prof) m_prof->pop();
+            }
+
+        #ifdef ENABLE_MPI
+        if (m_pdata->getDomainDecomposition())
+            {
+            // the ghost cell communicator and the distributed FFT work on the mesh of the base class
+                {
+                ArrayHandle<mesh_cpx> h_channel_mesh(m_channel_mesh, access_location::host, access_mode::read);
+                ArrayHandle<mesh_cpx> h_mesh(m_mesh, access_location::host, access_mode::overwrite);
+                memcpy(h_mesh.data, h_channel_mesh.data + fft*m_n_cells, sizeof(mesh_cpx)*m_n_cells);
+                }
+
+            // update inner cells of particle mesh
+            if (m_prof) m_prof->push("ghost cell update");
+            m_exec_conf->msg->notice(8) << "cv.mesh_multi: Ghost cell update" << std::endl;
+            m_grid_comm_forward->communicate(m_mesh);
+            if (m_prof) m_prof->pop();
+
+            if (m_prof) m_prof->push("FFT");
+            ArrayHandle<mesh_cpx> h_mesh(m_mesh, access_location::host, access_mode::read);
+            ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::overwrite);
+
+            executeDistributedFFT(h_mesh.data, h_fourier_mesh.data, false);
+            if (m_prof) m_prof->pop();
+            }
+        #endif
+
+        sweepChannels(fft, compute_virial);
+
+        if (m_local_fft)
+            {
+            if (m_prof) m_prof->push("FFT");
+            ArrayHandle<mesh_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::read);
+            ArrayHandle<mesh_cpx> h_channel_inv_mesh(m_channel_inv_mesh, access_location::host, access_mode::readwrite);
+            m_local_fft->inverse(h_fourier_mesh_G.data, h_channel_inv_mesh.data + fft*m_n_cells);
+            if (m_prof) m_prof->pop();
+            }
+
+        #ifdef ENABLE_MPI
+        if (m_pdata->getDomainDecomposition())
+            {
+                {
+                if (m_prof) m_prof->push("FFT");
+                ArrayHandle<mesh_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::read);
+                ArrayHandle<mesh_cpx> h_inv_fourier_mesh(m_inv_fourier_mesh, access_location::host, access_mode::overwrite);
+                executeDistributedFFT(h_fourier_mesh_G.data, h_inv_fourier_mesh.data, true);
+                if (m_prof) m_prof->pop();
+                }
+
+            // update outer cells of force mesh using ghost cells from neighboring processors
+            if (m_prof) m_prof->push("ghost cell update");
+            m_grid_comm_reverse->communicate(m_inv_fourier_mesh);
+            if (m_prof) m_prof->pop();
+
+            ArrayHandle<mesh_cpx> h_inv_fourier_mesh(m_inv_fourier_mesh, access_location::host, access_mode::read);
+            ArrayHandle<mesh_cpx> h_channel_inv_mesh(m_channel_inv_mesh, access_location::host, access_mode::readwrite);
+            memcpy(h_channel_inv_mesh.data + fft*m_n_cells, h_inv_fourier_mesh.data, sizeof(mesh_cpx)*m_n_cells);
+            }
+        #endif
+        }
+
+    m_channel_virial_valid = compute_virial;
+    }
+
+/*! \param fft Index of the transform
+    \param compute_virial If true, also sum up the virial
+
+    If two channels are packed into the transform Z, the transforms of the real and
+    imaginary part are A(k) = (Z(k) + Z(-k)*)/2 and B(k) = (Z(k) - Z(-k)*)/(2i).
+    The force meshes of both channels are Hermitian, and are packed as G_A + i G_B,
+    so that the real and imaginary part of the inverse transform are the potentials
+    of the two channels.
+ */
+void OrderParameterMeshMulti::sweepChannels(unsigned int fft, bool compute_virial)
+    {
+    if (m_prof) m_prof->push("k-space");
+
+    ArrayHandle<mesh_cpx> h_fourier_mesh(m_fourier_mesh, access_location::host, access_mode::read);
+    ArrayHandle<mesh_cpx> h_fourier_mesh_G(m_fourier_mesh_G, access_location::host, access_mode::overwrite);
+    ArrayHandle<Scalar> h_interpolation_f(m_interpolation_f, access_location::host, access_mode::read);
+    ArrayHandle<Scalar3> h_k(m_k, access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_channel_virial_kfac(m_channel_virial_kfac, access_location::host, access_mode::read);
+
+    bool exclude_dc = true;
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        uint3 my_pos = m_pdata->getDomainDecomposition()->getGridPos();
+        exclude_dc = !my_pos.x && !my_pos.y && !my_pos.z;
+        }
+    #endif
+
+    unsigned int first_channel = fft*m_channels_per_fft;
+    unsigned int n_channels = std::min(m_channels_per_fft, m_n_channels - first_channel);
+
+    unsigned int N_global = m_pdata->getNGlobal();
+    Scalar diag_fac[2];
+    const Scalar *kfac[2];
+    for (unsigned int c = 0; c < n_channels; ++c)
+        {
+        diag_fac[c] = Scalar(0.5)*m_channel_mode_sq[first_channel+c]/(Scalar)N_global/(Scalar)N_global;
+        kfac[c] = h_channel_virial_kfac.data + (first_channel+c)*m_n_fourier_cells;
+        }
+
+    uint3 dim = m_mesh_points;
+
+    // per-thread partial results: CV sum and six virial components, per channel
+    std::vector<Scalar> thread_sum(14*m_num_threads, Scalar(0.0));
+
+    #pragma omp parallel for schedule(static,1) num_threads(m_num_threads)
+    for (int thread = 0; thread < (int) m_num_threads; ++thread)
+        {
+        unsigned int start = (unsigned long)m_n_fourier_cells*thread/m_num_threads;
+        unsigned int end = (unsigned long)m_n_fourier_cells*(thread+1)/m_num_threads;
+
+        Scalar *sum = &thread_sum[14*thread];
+
+        for (unsigned int k = start; k < end; ++k)
+            {
+            kiss_fft_cpx z = make_kiss_cpx(h_fourier_mesh.data[k]);
+
+            // transforms of the individual channels
+            kiss_fft_cpx f[2];
+            if (m_channels_per_fft == 2)
+                {
+                unsigned int l = k % dim.x;
+                unsigned int m = (k/dim.x) % dim.y;
+                unsigned int n = k/(dim.x*dim.y);
+                unsigned int k_neg = (dim.x-l)%dim.x + dim.x*((dim.y-m)%dim.y + dim.y*((dim.z-n)%dim.z));
+                kiss_fft_cpx z_neg = make_kiss_cpx(h_fourier_mesh.data[k_neg]);
+
+                f[0].r = Scalar(0.5)*(z.r + z_neg.r);
+                f[0].i = Scalar(0.5)*(z.i - z_neg.i);
+                f[1].r = Scalar(0.5)*(z.i + z_neg.i);
+                f[1].i = Scalar(0.5)*(z_neg.r - z.r);
+                }
+            else
+                {
+                f[0] = z;
+                }
+
+            // transform of the assignment function, which is part of the self term unless it is deconvolved
+            Scalar W = h_interpolation_f.data[k];
+            Scalar interpolation_sq = m_deconvolve ? Scalar(1.0) : W*W;
+            Scalar norm = m_deconvolve ? (Scalar) N_global*W : (Scalar) N_global;
+
+            kiss_fft_cpx G_packed;
+            G_packed.r = G_packed.i = Scalar(0.0);
+
+            for (unsigned int c = 0; c < n_channels; ++c)
+                {
+                // normalization
+                Scalar f_r = f[c].r / norm;
+                Scalar f_i = f[c].i / norm;
+
+                Scalar norm2 = f_r*f_r + f_i*f_i;
+                Scalar diagonal_term = diag_fac[c]*interpolation_sq;
+
+                Scalar G_r = f_r * norm2 - f_r * diagonal_term;
+                Scalar G_i = f_i * norm2 - f_i * diagonal_term;
+
+                // the mesh density enters the deconvolved mode divided by W
+                if (m_deconvolve)
+                    {
+                    G_r /= W;
+                    G_i /= W;
+                    }
+
+                // the second channel is the imaginary part
+                if (c == 0)
+                    {
+                    G_packed.r += G_r;
+                    G_packed.i += G_i;
+                    }
+                else
+                    {
+                    G_packed.r -= G_i;
+                    G_packed.i += G_r;
+                    }
+
+                // exclude DC bin
+                if (exclude_dc && k == 0)
+                    continue;
+
+                sum[7*c] += norm2*(norm2 - Scalar(2.0)*diagonal_term);
+
+                if (compute_virial)
+                    {
+                    Scalar3 kvec = h_k.data[k];
+                    Scalar rhog = norm2*norm2/(Scalar)N_global/(Scalar)N_global*kfac[c][k];
+
+                    sum[7*c+1] += rhog*kvec.x*kvec.x; // xx
+                    sum[7*c+2] += rhog*kvec.x*kvec.y; // xy
+                    sum[7*c+3] += rhog*kvec.x*kvec.z; // xz
+                    sum[7*c+4] += rhog*kvec.y*kvec.y; // yy
+                    sum[7*c+5] += rhog*kvec.y*kvec.z; // yz
+                    sum[7*c+6] += rhog*kvec.z*kvec.z; // zz
+                    }
+                }
+
+            h_fourier_mesh_G.data[k] = make_mesh_cpx(G_packed);
+            }
+        }
+
+    // combine partial results in the order of the wave vectors
+    for (unsigned int c = 0; c < n_channels; ++c)
+        {
+        unsigned int channel = first_channel + c;
+
+        m_channel_cv_sum[channel] = Scalar(0.0);
+        for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+            m_channel_cv_sum[channel] += thread_sum[14*thread+7*c];
+
+        if (compute_virial)
+            {
+            for (unsigned int i = 0; i < 6; ++i)
+                {
+                m_channel_virial_sum[6*channel+i] = Scalar(0.0);
+                for (unsigned int thread = 0; thread < m_num_threads; ++thread)
+                    m_channel_virial_sum[6*channel+i] += thread_sum[14*thread+7*c+1+i];
+                }
+            }
+        }
+
+    if (m_prof) m_prof->pop();
+    }
+
+Scalar OrderParameterMeshMulti::computeCV()
+    {
+    if (m_prof) m_prof->push("sum");
+
+    for (unsigned int channel = 0; channel < m_n_channels; ++channel)
+        m_channel_cv[channel] = Scalar(1.0/2.0)*m_channel_cv_sum[channel];
+
+    #ifdef ENABLE_MPI
+    if (m_pdata->getDomainDecomposition())
+        {
+        // reduce sum
+        MPI_Allreduce(MPI_IN_PLACE,
+                      &m_channel_cv.front(),
+                      m_n_channels,
+                      MPI_HOOMD_SCALAR,
+                      MPI_SUM,
+                      m_exec_conf->getMPICommunicator());
+        }
+    #endif
+
+    if (m_prof) m_prof->pop();
+
+    return m_channel_cv[0];
+    }
+
+Scalar OrderParameterMeshMulti::getChannelValue(unsigned int channel, unsigned int timestep)
+    {
+    checkChannel(channel);
+
+    getCurrentValue(timestep);
+    return m_channel_cv[channel];
+    }
+
+void OrderParameterMeshMulti::computeChannelForces(unsigned int channel, unsigned int timestep, Scalar bias,
+    const GlobalArray<Scalar4>& force, Scalar *external_virial)
+    {
+    checkChannel(channel);
+
+    if (m_is_first_step || m_cv_last_updated != timestep)
+        getCurrentValue(timestep);
+
+    interpolateChannelForces(channel, bias, force);
+
+    PDataFlags flags = m_pdata->getFlags();
+
+    if (flags[pdata_flag::pressure_tensor] || flags[pdata_flag::isotropic_virial])
+        {
+        // the virial is usually computed during the mesh update, unless the pressure was not requested at that time
+        if (! m_channel_virial_valid)
+            transformChannels(true);
+
+        for (unsigned int i = 0; i < 6; ++i)
+            external_virial[i] = bias*m_channel_virial_sum[6*channel+i];
+        }
+    else
+        {
+        for (unsigned int i = 0; i < 6; ++i)
+            external_virial[i] = Scalar(0.0);
+        }
+    }
+
+/*! \param channel Index of the channel
+    \param bias The bias factor
+    \param force Output force array
+ */
+void OrderParameterMeshMulti::interpolateChannelForces(unsigned int channel, Scalar bias, const GlobalArray<Scalar4>& force)
+    {
+    if (m_prof) m_prof->push("interpolate");
+
+    ArrayHandle<mesh_cpx> h_channel_inv_mesh(m_channel_inv_mesh, access_location::host, access_mode::read);
+    ArrayHandle<Scalar> h_channel_mode(m_channel_mode, access_location::host, access_mode::read);
+    ArrayHandle<Scalar4> h_force(force, access_location::host, access_mode::overwrite);
+
+    // the potential of the channel is the real or imaginary part of its transform
+    unsigned int fft = channel/m_channels_per_fft;
+    const mesh_scalar *inv_mesh = &h_channel_inv_mesh.data[fft*m_n_cells].r + channel % m_channels_per_fft;
+
+    interpolateMesh(inv_mesh, NULL, 2, h_channel_mode.data + channel*m_pdata->getNTypes(), bias, h_force.data);
+
+    if (m_prof) m_prof->pop();
+    }
+
+void OrderParameterMeshMulti::interpolateForces()
+    {
+    interpolateChannelForces(0, m_bias, m_force);
+    }
+
+void OrderParameterMeshMulti::computeVirial()
+    {
+    if (! m_channel_virial_valid)
+        transformChannels(true);
+
+    for (unsigned int i = 0; i < 6; ++i)
+        m_external_virial[i] = m_bias*m_channel_virial_sum[i];
+    }
+
+/*! \param sysdef The system definition
+    \param mesh The shared mesh
+    \param channel Index of the channel
+    \param suffix Suffix of the log name
+ */
+OrderParameterMeshChannel::OrderParameterMeshChannel(std::shared_ptr<SystemDefinition> sysdef,
+                                                     std::shared_ptr<OrderParameterMeshMulti> mesh,
+                                                     unsigned int channel,
+                                                     const std::string& suffix)
+    : CollectiveVariable(sysdef, "cv_mesh"+suffix), m_mesh(mesh), m_channel(channel)
+    {
+    if (channel >= m_mesh->getNumChannels())
+        {
+        m_exec_conf->msg->error() << "cv.mesh_multi: Invalid channel " << channel << std::endl << std::endl;
+        throw std::runtime_error("Error setting up cv.mesh_multi");
+        }
+
+    m_log_name = m_cv_name;
+    }
+
+void OrderParameterMeshChannel::computeBiasForces(unsigned int timestep)
+    {
+    if (m_prof) m_prof->push("Mesh channel");
+
+    m_mesh->computeChannelForces(m_channel, timestep, m_bias, m_force, m_external_virial);
+
+    if (m_prof) m_prof->pop();
+    }
+
+void export_OrderParameterMeshMulti(py::module& m)
+    {
+    py::class_<OrderParameterMeshMulti, std::shared_ptr<OrderParameterMeshMulti> >(m,"OrderParameterMeshMulti", py::base<OrderParameterMesh> ())
+        .def(py::init<std::shared_ptr<SystemDefinition>,
+                                     const unsigned int,
+                                     const unsigned int,
+                                     const unsigned int,
+                                     const std::vector<Scalar>&,
+                                     const std::string&
+                                    >())
+        .def("getNumChannels", &OrderParameterMeshMulti::getNumChannels);
+
+    py::class_<OrderParameterMeshChannel, std::shared_ptr<OrderParameterMeshChannel> >(m,"OrderParameterMeshChannel", py::base<CollectiveVariable> ())
+        .def(py::init<std::shared_ptr<SystemDefinition>,
+                                     std::shared_ptr<OrderParameterMeshMulti>,
+                                     unsigned int,
+                                     const std::string&
+                                    >())
+        .def("setTable", &OrderParameterMeshChannel::setTable)
+        .def("setUseTable", &OrderParameterMeshChannel::setUseTable);
+    }
@@ -0,0 +1,242 @@
+#ifndef __ORDER_PARAMETER_MESH_MULTI_H__
+#define __ORDER_PARAMETER_MESH_MULTI_H__
+
+/*! \file OrderParameterMeshMulti.h
+    \brief Declares several mesh order parameters sharing one density mesh
+ */
+
+#include "OrderParameterMesh.h"
+
+/*! Several mesh order parameters evaluated on a shared mesh
+
+    Every channel has its own per-type mode amplitudes and convolution kernel
+    and is biased through an OrderParameterMeshChannel. The particles are
+    assigned to the meshes of all channels in a single sweep, and the wave
+    vectors, the Fourier transform of the assignment function and the
+    ghost cell layout are shared by all channels.
+
+    Since the channel densities are real, two channels are transformed at once
+    as the real and imaginary part of a complex mesh and separated in Fourier
+    space using the symmetry of the transform. With a decomposed mesh, the
+    partner wave vector -k is stored on a different rank, and every channel is
+    transformed on its own.
+
+    The value returned by getCurrentValue() is that of the first channel.
+ */
+class OrderParameterMeshMulti : public OrderParameterMesh
+    {
+    public:
+        //! Constructor
+        OrderParameterMeshMulti(std::shared_ptr<SystemDefinition> sysdef,
+                                const unsigned int nx,
+                                const unsigned int ny,
+                                const unsigned int nz,
+                                const std::vector<Scalar>& modes,
+                                const std::string& fft_backend = std::string("auto"));
+        virtual ~OrderParameterMeshMulti() {}
+
+        //! Interlacing is not supported with several channels
+        virtual void setInterlace(bool interlace);
+
+        //! Returns the number of channels
+        unsigned int getNumChannels() const
+            {
+            return m_n_channels;
+            }
+
+        /*! Returns the current value of a single channel
+            \param channel Index of the channel
+            \param timestep The current value of the time step
+         */
+        Scalar getChannelValue(unsigned int channel, unsigned int timestep);
+
+        /*! Compute the biased forces and the virial of a single channel
+            \param channel Index of the channel
+            \param timestep The current value of the time step
+            \param bias The bias factor
+            \param force Output force array
+            \param external_virial Output virial (six components)
+         */
+        void computeChannelForces(unsigned int channel, unsigned int timestep, Scalar bias,
+            const GlobalArray<Scalar4>& force, Scalar *external_virial);
+
+        /*! Set the convolution kernel table of a single channel
+         * \param channel Index of the channel
+         * \param K convolution kernel as function of k
+         * \param d_K derivative of convolution kernel
+         * \param kmin Minimum wave vector for table
+         * \param kmax Maximum wave vector for table
+         */
+        void setChannelTable(unsigned int channel,
+                             const std::vector<Scalar> &K,
+                             const std::vector<Scalar> &d_K,
+                             Scalar kmin, Scalar kmax);
+
+        /*! Set flag whether to use the convolution kernel table of a single channel
+         */
+        void setChannelUseTable(unsigned int channel, bool use_table);
+
+        /*! Returns the names of provided log quantities.
+
+            The channel values are logged by the OrderParameterMeshChannel objects.
+         */
+        std::vector<std::string> getProvidedLogQuantities()
+            {
+            return CollectiveVariable::getProvidedLogQuantities();
+            }
+
+        /*! Returns the value of a specific log quantity.
+         * \param quantity The name of the quantity to return the value of
+         * \param timestep The current value of the time step
+         */
+        Scalar getLogValue(const std::string& quantity, unsigned int timestep)
+            {
+            return CollectiveVariable::getLogValue(quantity, timestep);
+            }
+
+    protected:
+        //! Helper function to setup FFT and allocate the mesh arrays
+        virtual void initializeFFT();
+
+        //! Update the wave vectors and the per-channel kernel values for a new box
+        virtual void rescaleInfluenceFunction();
+
+        //! Helper function to assign particle coordinates to the meshes of all channels
+        virtual void assignParticles();
+
+        //! Helper function to update the mesh arrays
+        virtual void updateMeshes();
+
+        //! Helper function to calculate the values of all channels
+        virtual Scalar computeCV();
+
+        //! Helper function to interpolate the forces of the first channel
+        virtual void interpolateForces();
+
+        //! Helper function to compute the virial of the first channel
+        virtual void computeVirial();
+
+    private:
+        unsigned int m_n_channels;                  //!< Number of channels
+        unsigned int m_channels_per_fft;            //!< Number of channels packed into one transform (1 or 2)
+        unsigned int m_n_ffts;                      //!< Number of transforms per mesh update
+
+        GlobalArray<Scalar> m_channel_mode;         //!< Per-type mode amplitudes of every channel
+        GlobalArray<mesh_cpx> m_packed_mode;        //!< Per-type mode amplitudes of the channels in every transform
+        std::vector<Scalar> m_channel_mode_sq;      //!< Sum of squared mode amplitudes per channel
+
+        GlobalArray<mesh_cpx> m_channel_mesh;         //!< Packed density meshes of all transforms
+        GlobalArray<mesh_cpx> m_channel_inv_mesh;     //!< Packed inverse-Fourier transformed meshes of all transforms
+
+        std::vector<Scalar> m_channel_k_min;        //!< Minimum k of the tabulated kernel per channel
+        std::vector<Scalar> m_channel_k_max;        //!< Maximum k of the tabulated kernel per channel
+        std::vector<Scalar> m_channel_delta_k;      //!< Spacing of the tabulated kernel per channel
+        std::vector<bool> m_channel_use_table;      //!< Whether to use the tabulated kernel per channel
+        std::vector<std::vector<Scalar> > m_channel_table_d; //!< Tabulated kernel derivative per channel
+        GlobalArray<Scalar> m_channel_virial_kfac;  //!< Kernel derivative divided by 2|k|, per channel and wave vector
+
+        std::vector<Scalar> m_channel_cv_sum;       //!< Local sum of every channel over the Fourier mesh
+        std::vector<Scalar> m_channel_cv;           //!< Current value of every channel
+        std::vector<Scalar> m_channel_virial_sum;   //!< Local virial sum of every channel (without bias)
+        bool m_channel_virial_valid;                //!< True if m_channel_virial_sum is up to date
+
+        //! Check the index of a channel
+        void checkChannel(unsigned int channel) const;
+
+        /*! Linearly interpolate the tabulated kernel derivative of a channel
+            \param channel Index of the channel
+            \param knorm Wave number
+         */
+        Scalar evaluateChannelTable(unsigned int channel, Scalar knorm) const;
+
+        //! Assign a single particle to the meshes of all transforms
+        void assignParticleChannels(mesh_cpx *mesh, const int3& cell, const Scalar3& shift,
+            const mesh_cpx *mode) const;
+
+        //! Interpolate the forces of a single channel
+        void interpolateChannelForces(unsigned int channel, Scalar bias, const GlobalArray<Scalar4>& force);
+
+        //! Transform the meshes of all channels and compute the force meshes
+        void transformChannels(bool compute_virial);
+
+        //! Pass over the Fourier mesh of a single transform
+        void sweepChannels(unsigned int fft, bool compute_virial);
+    };
+
+/*! A single channel of an OrderParameterMeshMulti as a collective variable
+
+    The value, forces and virial are computed by the shared mesh, this class
+    only supplies its own bias factor.
+ */
+class OrderParameterMeshChannel : public CollectiveVariable
+    {
+    public:
+        //! Constructor
+        OrderParameterMeshChannel(std::shared_ptr<SystemDefinition> sysdef,
+                                  std::shared_ptr<OrderParameterMeshMulti> mesh,
+                                  unsigned int channel,
+                                  const std::string& suffix);
+        virtual ~OrderParameterMeshChannel() {}
+
+        virtual Scalar getCurrentValue(unsigned int timestep)
+            {
+            return m_mesh->getChannelValue(m_channel, timestep);
+            }
+
+        /*! Returns the names of provided log quantities.
+         */
+        std::vector<std::string> getProvidedLogQuantities()
+            {
+            std::vector<std::string> list = CollectiveVariable::getProvidedLogQuantities();
+            list.push_back(m_log_name);
+            return list;
+            }
+
+        /*! Returns the value of a specific log quantity.
+         * \param quantity The name of the quantity to return the value of
+         * \param timestep The current value of the time step
+         */
+        Scalar getLogValue(const std::string& quantity, unsigned int timestep)
+            {
+            if (quantity == m_log_name)
+                return getCurrentValue(timestep);
+
+            return CollectiveVariable::getLogValue(quantity, timestep);
+            }
+
+        /*! Set the convolution kernel table of this channel
+         * \param K convolution kernel as function of k
+         * \param d_K derivative of convolution kernel
+         * \param kmin Minimum wave vector for table
+         * \param kmax Maximum wave vector for table
+         */
+        void setTable(const std::vector<Scalar> &K,
+                      const std::vector<Scalar> &d_K,
+                      Scalar kmin, Scalar kmax)
+            {
+            m_mesh->setChannelTable(m_channel, K, d_K, kmin, kmax);
+            }
+
+        /*! Set flag whether to use the convolution kernel table of this channel
+         */
+        void setUseTable(bool use_table)
+            {
+            m_mesh->setChannelUseTable(m_channel, use_table);
+            }
+
+    protected:
+        /*! Compute the biased forces for this collective variable.
+            \param timestep The current value of the time step
+         */
+        virtual void computeBiasForces(unsigned int timestep);
+
+    private:
+        std::shared_ptr<OrderParameterMeshMulti> m_mesh; //!< The shared mesh
+        unsigned int m_channel;                          //!< Index of this channel
+        std::string m_log_name;                          //!< The name of the collective variable
+    };
+
+//! Export OrderParameterMeshMulti and OrderParameterMeshChannel to python
+void export_OrderParameterMeshMulti(pybind11::module& m);
+
+#endif // __ORDER_PARAMETER_MESH_MULTI_H__
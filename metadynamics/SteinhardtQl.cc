@@ -3,7 +3,6 @@
  */
 
 #include "SteinhardtQl.h"
-#include "spherical_harmonics.hpp"
 
 #include <cmath>
 
@@ -31,6 +30,111 @@ SteinhardtQl::SteinhardtQl(std::shared_ptr<SystemDefinition> sysdef,
     m_Ql_ref.resize(Ql_ref.size());
 
     std::copy(Ql_ref.begin(), Ql_ref.end(), m_Ql_ref.begin());
+
+    // coefficients of the recurrence of the normalized Legendre polynomials, see evaluateHarmonics()
+    unsigned int legendre_count = (m_lmax+1)*(m_lmax+2)/2;
+    m_sph_a.resize(legendre_count, Scalar(0.0));
+    m_sph_b.resize(legendre_count, Scalar(0.0));
+    for (unsigned int l = 0; l <= m_lmax; ++l)
+        {
+        for (unsigned int m = 0; m <= l; ++m)
+            {
+            unsigned int idx = l*(l+1)/2 + m;
+            if (l == 0)
+                m_sph_a[idx] = Scalar(1.0/sqrt(4.0*M_PI));
+            else if (m == l)
+                m_sph_a[idx] = sqrt(Scalar(2*m+1)/Scalar(2*m));
+            else
+                {
+                m_sph_a[idx] = sqrt(Scalar(4*l*l-1)/Scalar(l*l-m*m));
+                m_sph_b[idx] = sqrt(Scalar((l-1)*(l-1)-m*m)/Scalar(4*(l-1)*(l-1)-1));
+                }
+            }
+        }
+
+    // buffers for the harmonics of a single bond
+    unsigned int sph_count = (m_lmax+1)*(m_lmax+1);
+    m_legendre.resize(legendre_count);
+    m_dlegendre.resize(legendre_count);
+    m_xy_pow.resize(m_lmax+1);
+    m_Ylm.resize(sph_count);
+    m_dYlm.resize(sph_count);
+    m_Qlm.resize(sph_count);
+    }
+
+/*! \param u The normalized bond vector
+    \param compute_gradient True if the gradients are also computed
+
+    The spherical harmonics (with the Condon-Shortley phase) are evaluated as
+    Cartesian polynomials of the unit vector (x,y,z), with r^l Y_lm = (-1)^m P_lm(z) (x+iy)^m
+    for m >= 0 and Y_l,-m = (-1)^m Y_lm^*. The normalized polynomials P_lm are obtained
+    by the standard recurrence in l, and their derivatives with respect to z by
+    differentiating the same recurrence.
+
+    The gradients of the polynomials are projected onto the tangent plane of the unit
+    sphere, so that the gradient of Y_lm(r/|r|) with respect to r is m_dYlm/|r|.
+ */
+void SteinhardtQl::evaluateHarmonics(const vec3<Scalar>& u, bool compute_gradient)
+    {
+    const unsigned int lmax = m_lmax;
+    const std::complex<Scalar> xy(u.x, u.y);
+
+    m_xy_pow[0] = std::complex<Scalar>(1.0,0.0);
+    for (unsigned int m = 1; m <= lmax; ++m)
+        m_xy_pow[m] = m_xy_pow[m-1]*xy;
+
+    for (unsigned int m = 0; m <= lmax; ++m)
+        {
+        unsigned int diag = m*(m+1)/2 + m;
+        m_legendre[diag] = (m == 0) ? m_sph_a[0] : m_sph_a[diag]*m_legendre[diag-(m+1)];
+        m_dlegendre[diag] = Scalar(0.0);
+
+        for (unsigned int l = m+1; l <= lmax; ++l)
+            {
+            unsigned int idx = l*(l+1)/2 + m;
+            unsigned int idx_1 = idx - l;
+            Scalar P = u.z*m_legendre[idx_1];
+            Scalar dP = m_legendre[idx_1] + u.z*m_dlegendre[idx_1];
+            if (l >= m+2)
+                {
+                unsigned int idx_2 = idx_1 - (l-1);
+                P -= m_sph_b[idx]*m_legendre[idx_2];
+                dP -= m_sph_b[idx]*m_dlegendre[idx_2];
+                }
+            m_legendre[idx] = m_sph_a[idx]*P;
+            m_dlegendre[idx] = m_sph_a[idx]*dP;
+            }
+        }
+
+    for (unsigned int l = 0; l <= lmax; ++l)
+        {
+        unsigned int n = l*l;
+        for (unsigned int m = 0; m <= l; ++m)
+            {
+            unsigned int idx = l*(l+1)/2 + m;
+            Scalar phase = (m % 2) ? Scalar(-1.0) : Scalar(1.0);
+
+            std::complex<Scalar> Y = phase*m_legendre[idx]*m_xy_pow[m];
+            m_Ylm[n+m] = Y;
+            if (m > 0)
+                m_Ylm[n+l+m] = phase*std::conj(Y);
+
+            if (! compute_gradient)
+                continue;
+
+            // gradient of the polynomial, d/dy (x+iy)^m = i d/dx (x+iy)^m
+            std::complex<Scalar> dF_dx = (m > 0) ? phase*m_legendre[idx]*Scalar(m)*m_xy_pow[m-1] : std::complex<Scalar>(0.0,0.0);
+            std::complex<Scalar> dF_dy = std::complex<Scalar>(-dF_dx.imag(), dF_dx.real());
+            std::complex<Scalar> dF_dz = phase*m_dlegendre[idx]*m_xy_pow[m];
+
+            // project onto the tangent plane
+            std::complex<Scalar> radial = u.x*dF_dx + u.y*dF_dy + u.z*dF_dz;
+            vec3<std::complex<Scalar> > dY(dF_dx - u.x*radial, dF_dy - u.y*radial, dF_dz - u.z*radial);
+            m_dYlm[n+m] = dY;
+            if (m > 0)
+                m_dYlm[n+l+m] = vec3<std::complex<Scalar> >(phase*std::conj(dY.x), phase*std::conj(dY.y), phase*std::conj(dY.z));
+            }
+        }
     }
 
 inline Scalar fSmooth(Scalar r_onsq, Scalar r_cutsq, Scalar rsq)
@@ -85,9 +189,6 @@ void SteinhardtQl::computeCV(unsigned int timestep)
 
     const BoxDim& box = m_pdata->getBox();
 
-    unsigned int sph_count = (m_lmax+1)*(m_lmax+1);
-    std::vector<std::complex<Scalar> > Ylm_pp(sph_count,std::complex<Scalar>(0.0,0.0));
-    m_Qlm.resize(sph_count);
     std::fill(m_Qlm.begin(), m_Qlm.end(), std::complex<Scalar>(0.0,0.0));
 
     // for each particle
@@ -134,25 +235,12 @@ void SteinhardtQl::computeCV(unsigned int timestep)
                 {
                 Scalar f = fSmooth(m_ronsq, m_rcutsq, rsq);
 
-                // compute theta, phi
-                Scalar theta = acos(dx.z/sqrt(rsq));
-                Scalar phi = atan2(dx.y, dx.x);
+                Scalar rinv = Scalar(1.0)/sqrt(rsq);
+                evaluateHarmonics(vec3<Scalar>(dx.x*rinv, dx.y*rinv, dx.z*rinv), false);
 
-                bool negative_m = true;
-                // note switching theta and phi due to diffferent convention
-                fsph::evaluate_SPH<Scalar>(&Ylm_pp.front(), m_lmax, &theta, &phi, 1, negative_m);
-
-                int n = 0;
-                for (int l = 0; l <= (int)m_lmax; ++l)
-                    {
-                    for (int p = 0; p < 2*l+1; ++p)
-                        {
-                        int m = (p <= l) ? p : (l-p);
-                        int phase = (m > 0 && m % 2) ? -1 : 1; // Condon-Shortley
-                        m_Qlm[n] += std::complex<Scalar>(phase)*Ylm_pp[n]*f;
-                        n++;
-                        }
-                    }
+                unsigned int sph_count = (m_lmax+1)*(m_lmax+1);
+                for (unsigned int n = 0; n < sph_count; ++n)
+                    m_Qlm[n] += m_Ylm[n]*f;
                 }
             }
 
@@ -226,9 +314,6 @@ void SteinhardtQl::computeBiasForces(unsigned int timestep)
 
     const BoxDim& box = m_pdata->getBox();
 
-    unsigned int sph_count = (m_lmax+1)*(m_lmax+1); //l = 0..lmax
-    std::vector<std::complex<Scalar> > Ylm_pp(sph_count,std::complex<Scalar>(0.0,0.0));
-
     unsigned int Nglobal = m_pdata->getNGlobal();
     unsigned int nc = 1; // for now
 
@@ -279,41 +364,25 @@ void SteinhardtQl::computeBiasForces(unsigned int timestep)
 
             if (rsq <= m_rcutsq)
                 {
-                // compute theta, phi
-                std::complex<Scalar> r(sqrt(rsq));
-                Scalar theta = acos(dx.z/r.real());
-                Scalar phi = atan2(dx.y, dx.x);
-
-                vec3<std::complex<Scalar> > e_theta = vec3<std::complex<Scalar> >(cos(theta)*cos(phi),cos(theta)*sin(phi),-sin(theta));
-                vec3<std::complex<Scalar> > e_phi = vec3<std::complex<Scalar> >(-sin(phi),cos(phi),0.0);
-
-                bool negative_m = true;
-                // note switching theta and phi due to diffferent convention
-                fsph::evaluate_SPH<Scalar>(&Ylm_pp.front(), m_lmax, &theta, &phi, 1, negative_m);
+                Scalar r = sqrt(rsq);
+                Scalar rinv = Scalar(1.0)/r;
+                evaluateHarmonics(vec3<Scalar>(dx.x*rinv, dx.y*rinv, dx.z*rinv), true);
 
-                std::complex<Scalar> fprime_divr(fprimeSmooth_divr(m_ronsq,m_rcutsq, rsq));
-                std::complex<Scalar> f(fSmooth(m_ronsq, m_rcutsq, rsq));
-                int n = 0;
+                Scalar fprime_divr = fprimeSmooth_divr(m_ronsq,m_rcutsq, rsq);
+                Scalar f_divr = fSmooth(m_ronsq, m_rcutsq, rsq)*rinv;
+                unsigned int n = 0;
                 for (int l = 0; l <= (int)m_lmax; ++l)
                     {
                     vec3<Scalar> del_Ql_i(0.0,0.0,0.0);
                     for (int p = 0; p < 2*l+1; ++p)
                         {
-                        int m = (p <= l) ? p : (l-p);
-                        int phase = (m > 0 && m % 2) ? -1 : 1; // Condon-Shortley phase, for derivative formula
-                        std::complex<Scalar> Ylm = std::complex<Scalar>(phase)*Ylm_pp[n];
-                        std::complex<Scalar> dYlm_dtheta = std::complex<Scalar>(m/tan(theta))*Ylm;
-                        if (m < l)
-                            {
-                            unsigned int m_plus_one = (m < 0) ? (m == -1 ? n-p : n-1) : (n+1);
-                            int phase_plus_one = (m + 1 > 0 && (m+1) %2 ) ? -1 : 1;
-                            dYlm_dtheta += std::complex<Scalar>(phase_plus_one*sqrt((l-m)*(l+m+1)))*std::exp(std::complex<Scalar>(0,-phi))*Ylm_pp[m_plus_one];
-                            }
-                        std::complex<Scalar> dYlm_dphi = std::complex<Scalar>(0,m)*Ylm;
-
-                        vec3<std::complex<Scalar> > del_Qlm = vec3<std::complex<Scalar> >(dx)*fprime_divr*Ylm + f/r*e_theta*dYlm_dtheta + f*e_phi/(r*std::complex<Scalar>(sin(theta)))*dYlm_dphi;
-                        del_Qlm *= std::conj(m_Qlm[n]);
-                        del_Ql_i += Scalar(2.0)*vec3<Scalar>(del_Qlm.x.real(),del_Qlm.y.real(), del_Qlm.z.real());
+                        // d|Qlm|^2 = 2 Re(Qlm^* dQlm), with dQlm = f'(r) Ylm dx/r + f(r)/r dYlm
+                        std::complex<Scalar> Qlm_conj = std::conj(m_Qlm[n]);
+                        Scalar radial = fprime_divr*(Qlm_conj*m_Ylm[n]).real();
+                        const vec3<std::complex<Scalar> >& dYlm = m_dYlm[n];
+                        del_Ql_i.x += Scalar(2.0)*(radial*dx.x + f_divr*(Qlm_conj*dYlm.x).real());
+                        del_Ql_i.y += Scalar(2.0)*(radial*dx.y + f_divr*(Qlm_conj*dYlm.y).real());
+                        del_Ql_i.z += Scalar(2.0)*(radial*dx.z + f_divr*(Qlm_conj*dYlm.z).real());
                         n++;
                         }
                     del_Ql_i *= Scalar(4.0*M_PI/(2*l+1))/(Nglobal*Nglobal)/(nc*nc);
@@ -8,7 +8,9 @@
 #include "CollectiveVariable.h"
 
 #include <complex>
+#include <vector>
 
+#include <hoomd/VectorMath.h>
 #include <hoomd/md/NeighborList.h>
 
 class SteinhardtQl : public CollectiveVariable
@@ -93,6 +95,17 @@ class SteinhardtQl : public CollectiveVariable
         std::vector<Scalar> m_Ql_ref; //!< List of reference Ql
         std::string m_prof_name;  //!< Name for profiling
         Scalar m_value;          //!< Value of the collective variable
+
+        std::vector<Scalar> m_sph_a;               //!< First coefficient of the Legendre recurrence, per (l,m)
+        std::vector<Scalar> m_sph_b;               //!< Second coefficient of the Legendre recurrence, per (l,m)
+        std::vector<Scalar> m_legendre;            //!< Normalized Legendre polynomials of the current bond, per (l,m)
+        std::vector<Scalar> m_dlegendre;           //!< Derivatives of the Legendre polynomials with respect to z
+        std::vector<std::complex<Scalar> > m_xy_pow; //!< Powers (x+iy)^m of the current bond
+        std::vector<std::complex<Scalar> > m_Ylm;    //!< Spherical harmonics of the current bond, in the layout of m_Qlm
+        std::vector<vec3<std::complex<Scalar> > > m_dYlm; //!< Tangential gradients of the spherical harmonics on the unit sphere
+
+        //! Evaluate the spherical harmonics of a bond
+        void evaluateHarmonics(const vec3<Scalar>& u, bool compute_gradient);
     };
 
 //! Export the SteinhardtQl class to python
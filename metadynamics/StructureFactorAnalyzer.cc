@@ -0,0 +1,262 @@
+/*! \file StructureFactorAnalyzer.cc
+    \brief Implements the StructureFactorAnalyzer class
+ */
+
+#include "StructureFactorAnalyzer.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace py = pybind11;
+
+using namespace std;
+
+//! Total size of the NumPy header, including the magic string
+/*! A fixed size lets us rewrite the number of rows in place after every row.
+ */
+const unsigned int NUMPY_HEADER_SIZE = 128;
+
+//! NumPy type descriptor of a double in the byte order of the host
+static const char *numpyDoubleDescr()
+    {
+    const unsigned short one = 1;
+    return *(const unsigned char *) &one ? "<f8" : ">f8";
+    }
+
+/*! \param sysdef The system definition
+    \param mesh The mesh order parameter
+    \param filename Name of the output file
+    \param n_bins Number of shells
+    \param k_max Upper edge of the last shell
+    \param window Number of samples averaged in every row
+    \param format Output format, "numpy" or "binary"
+    \param overwrite If false, append to an existing file
+ */
+StructureFactorAnalyzer::StructureFactorAnalyzer(std::shared_ptr<SystemDefinition> sysdef,
+    std::shared_ptr<OrderParameterMesh> mesh,
+    const std::string& filename,
+    unsigned int n_bins,
+    Scalar k_max,
+    unsigned int window,
+    const std::string& format,
+    bool overwrite)
+    : Analyzer(sysdef), m_mesh(mesh), m_filename(filename), m_n_bins(n_bins), m_k_max(k_max),
+      m_window(window), m_numpy(true), m_overwrite(overwrite), m_n_rows(0), m_n_samples(0)
+    {
+    m_exec_conf->msg->notice(5) << "Constructing StructureFactorAnalyzer" << endl;
+
+    if (! n_bins || k_max <= Scalar(0.0) || ! window)
+        {
+        m_exec_conf->msg->error() << "analyze.structure_factor: Number of bins, k_max and window must be positive." << endl << endl;
+        throw runtime_error("Error initializing StructureFactorAnalyzer");
+        }
+
+    if (format == "numpy")
+        m_numpy = true;
+    else if (format == "binary")
+        m_numpy = false;
+    else
+        {
+        m_exec_conf->msg->error() << "analyze.structure_factor: Unknown output format " << format << endl << endl;
+        throw runtime_error("Error initializing StructureFactorAnalyzer");
+        }
+
+    m_sk_sum.resize(m_n_bins, 0.0);
+    m_modes_sum.resize(m_n_bins, 0.0);
+
+    #ifdef ENABLE_MPI
+    if (! m_exec_conf->isRoot())
+        return;
+    #endif
+
+    openOutputFile();
+    }
+
+StructureFactorAnalyzer::~StructureFactorAnalyzer()
+    {
+    m_exec_conf->msg->notice(5) << "Destroying StructureFactorAnalyzer" << endl;
+    }
+
+void StructureFactorAnalyzer::openOutputFile()
+    {
+    struct stat buffer;
+    bool file_exists  = stat(m_filename.c_str(), &buffer) == 0;
+
+    unsigned int row_size = sizeof(double)*(m_n_bins+1);
+
+    if (file_exists && !m_overwrite)
+        {
+        m_exec_conf->msg->notice(3) << "analyze.structure_factor: Appending to existing file \"" << m_filename << "\"" << endl;
+
+        if (m_numpy)
+            {
+            ifstream in(m_filename.c_str(), ios_base::in | ios_base::binary);
+            if (! readNumpyHeader(in, m_n_rows))
+                {
+                m_exec_conf->msg->error() << "analyze.structure_factor: Cannot append to " << m_filename
+                    << ", not a structure factor file with " << m_n_bins << " bins in the byte order of this host." << endl << endl;
+                throw runtime_error("Error initializing StructureFactorAnalyzer");
+                }
+            }
+        else
+            {
+            if (buffer.st_size % row_size)
+                {
+                m_exec_conf->msg->error() << "analyze.structure_factor: Cannot append to " << m_filename
+                    << ", size is not a multiple of the row size for " << m_n_bins << " bins." << endl << endl;
+                throw runtime_error("Error initializing StructureFactorAnalyzer");
+                }
+            m_n_rows = buffer.st_size/row_size;
+            }
+
+        m_file.open(m_filename.c_str(), ios_base::in | ios_base::out | ios_base::binary);
+
+        // continue after the last complete row
+        m_file.seekp((m_numpy ? NUMPY_HEADER_SIZE : 0) + (streamoff) m_n_rows*row_size);
+        }
+    else
+        {
+        m_exec_conf->msg->notice(3) << "analyze.structure_factor: Creating new file \"" << m_filename << "\"" << endl;
+        m_file.open(m_filename.c_str(), ios_base::out | ios_base::trunc | ios_base::binary);
+        m_n_rows = 0;
+
+        if (m_file.good() && m_numpy)
+            writeNumpyHeader();
+        }
+
+    if (! m_file.good())
+        {
+        m_exec_conf->msg->error() << "analyze.structure_factor: Error opening file " << m_filename << endl;
+        throw runtime_error("Error initializing StructureFactorAnalyzer");
+        }
+    }
+
+/*! The header is written at the beginning of the file, and the put position is
+    restored afterwards. The data is stored in the byte order of the host, which the
+    type descriptor records.
+ */
+void StructureFactorAnalyzer::writeNumpyHeader()
+    {
+    char dict[NUMPY_HEADER_SIZE];
+    unsigned int header_len = NUMPY_HEADER_SIZE - 10;
+    snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (%u, %u), }",
+        numpyDoubleDescr(), m_n_rows, m_n_bins+1);
+
+    // pad with spaces and terminate with a newline
+    string header(dict);
+    header.resize(header_len-1, ' ');
+    header += '\n';
+
+    char preamble[10] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0,
+        (char)(header_len & 0xff), (char)(header_len >> 8)};
+
+    streampos pos = m_file.tellp();
+    m_file.seekp(0);
+    m_file.write(preamble, sizeof(preamble));
+    m_file.write(header.c_str(), header.size());
+    if (pos > (streampos) NUMPY_HEADER_SIZE)
+        m_file.seekp(pos);
+    }
+
+/*! \param in The input stream positioned at the beginning of the file
+    \param n_rows Output number of rows in the file
+ */
+bool StructureFactorAnalyzer::readNumpyHeader(std::istream& in, unsigned int& n_rows)
+    {
+    char buf[NUMPY_HEADER_SIZE+1];
+    in.read(buf, NUMPY_HEADER_SIZE);
+    if (! in.good() || memcmp(buf, "\x93NUMPY\x01\x00", 8))
+        return false;
+
+    unsigned int header_len = (unsigned char) buf[8] | ((unsigned char) buf[9] << 8);
+    if (header_len != NUMPY_HEADER_SIZE - 10)
+        return false;
+
+    buf[NUMPY_HEADER_SIZE] = '\0';
+    string header(buf+10);
+    // rows are only appended in the byte order of the file
+    string descr = string("'descr': '") + numpyDoubleDescr() + "'";
+    if (header.find(descr) == string::npos || header.find("'fortran_order': False") == string::npos)
+        return false;
+
+    size_t shape = header.find("'shape': (");
+    unsigned int n_cols = 0;
+    if (shape == string::npos || sscanf(header.c_str()+shape, "'shape': (%u, %u)", &n_rows, &n_cols) != 2)
+        return false;
+
+    return n_cols == m_n_bins+1;
+    }
+
+/*! \param timestep The current value of the time step
+ */
+void StructureFactorAnalyzer::analyze(unsigned int timestep)
+    {
+    if (m_prof) m_prof->push("S(k)");
+
+    // every rank contributes its part of the mesh
+    m_mesh->computeStructureFactor(timestep, m_n_bins, m_k_max, m_sk, m_n_modes);
+
+    for (unsigned int i = 0; i < m_n_bins; ++i)
+        {
+        m_sk_sum[i] += m_sk[i];
+        m_modes_sum[i] += m_n_modes[i];
+        }
+
+    if (++m_n_samples < m_window)
+        {
+        if (m_prof) m_prof->pop();
+        return;
+        }
+
+    #ifdef ENABLE_MPI
+    bool is_root = m_exec_conf->isRoot();
+    #else
+    bool is_root = true;
+    #endif
+
+    if (is_root)
+        {
+        std::vector<double> row(m_n_bins+1);
+        row[0] = (double) timestep;
+        for (unsigned int i = 0; i < m_n_bins; ++i)
+            row[i+1] = m_modes_sum[i] > 0.0 ? m_sk_sum[i]/m_modes_sum[i] : numeric_limits<double>::quiet_NaN();
+
+        m_file.write((const char *) &row.front(), sizeof(double)*row.size());
+        m_n_rows++;
+
+        if (m_numpy)
+            writeNumpyHeader();
+
+        m_file.flush();
+
+        if (! m_file.good())
+            {
+            m_exec_conf->msg->error() << "analyze.structure_factor: Error writing to " << m_filename << endl;
+            throw runtime_error("Error writing structure factor");
+            }
+        }
+
+    // start a new window
+    m_n_samples = 0;
+    std::fill(m_sk_sum.begin(), m_sk_sum.end(), 0.0);
+    std::fill(m_modes_sum.begin(), m_modes_sum.end(), 0.0);
+
+    if (m_prof) m_prof->pop();
+    }
+
+void export_StructureFactorAnalyzer(py::module& m)
+    {
+    py::class_<StructureFactorAnalyzer, std::shared_ptr<StructureFactorAnalyzer> >(m, "StructureFactorAnalyzer", py::base<Analyzer>())
+        .def(py::init< std::shared_ptr<SystemDefinition>,
+                       std::shared_ptr<OrderParameterMesh>,
+                       const std::string&,
+                       unsigned int,
+                       Scalar,
+                       unsigned int,
+                       const std::string&,
+                       bool>());
+    }
@@ -0,0 +1,80 @@
+#ifndef __STRUCTURE_FACTOR_ANALYZER_H__
+#define __STRUCTURE_FACTOR_ANALYZER_H__
+
+/*! \file StructureFactorAnalyzer.h
+    \brief Declares the StructureFactorAnalyzer class
+ */
+
+#include "OrderParameterMesh.h"
+
+#include <hoomd/Analyzer.h>
+
+#include <fstream>
+
+/*! Writes the radially averaged structure factor of a mesh order parameter
+
+    On every call, the structure factor of the density mesh of cv.mesh is binned
+    into shells of equal width in |k| and accumulated. After a window of samples,
+    one row is appended to the output file, consisting of the time step followed by
+    the average structure factor in every shell (NaN for shells without modes).
+
+    The rows are written as double precision numbers, either as raw binary or as a
+    two-dimensional NumPy (.npy) array, whose header is updated with every row.
+ */
+class StructureFactorAnalyzer : public Analyzer
+    {
+    public:
+        /*! Constructor
+            \param sysdef The system definition
+            \param mesh The mesh order parameter
+            \param filename Name of the output file
+            \param n_bins Number of shells
+            \param k_max Upper edge of the last shell
+            \param window Number of samples averaged in every row
+            \param format Output format, "numpy" or "binary"
+            \param overwrite If false, append to an existing file
+         */
+        StructureFactorAnalyzer(std::shared_ptr<SystemDefinition> sysdef,
+            std::shared_ptr<OrderParameterMesh> mesh,
+            const std::string& filename,
+            unsigned int n_bins,
+            Scalar k_max,
+            unsigned int window,
+            const std::string& format,
+            bool overwrite);
+        virtual ~StructureFactorAnalyzer();
+
+        //! Sample the structure factor and write a row at the end of a window
+        virtual void analyze(unsigned int timestep);
+
+    private:
+        std::shared_ptr<OrderParameterMesh> m_mesh; //!< The mesh order parameter
+        std::string m_filename;                  //!< Name of the output file
+        unsigned int m_n_bins;                   //!< Number of shells
+        Scalar m_k_max;                          //!< Upper edge of the last shell
+        unsigned int m_window;                   //!< Number of samples per row
+        bool m_numpy;                            //!< True if writing a NumPy array
+        bool m_overwrite;                        //!< True if an existing file is overwritten
+
+        std::ofstream m_file;                    //!< The output file (root rank only)
+        unsigned int m_n_rows;                   //!< Number of rows in the output file
+        unsigned int m_n_samples;                //!< Number of samples in the current window
+        std::vector<double> m_sk_sum;            //!< Sum of the structure factor per shell
+        std::vector<double> m_modes_sum;         //!< Sum of the number of modes per shell
+        std::vector<Scalar> m_sk;                //!< Structure factor of the current sample
+        std::vector<Scalar> m_n_modes;           //!< Number of modes of the current sample
+
+        //! Open the output file, and determine the number of rows if appending
+        void openOutputFile();
+
+        //! Write the NumPy header for the current number of rows
+        void writeNumpyHeader();
+
+        //! Count the rows of an existing NumPy file, returns false if it does not match our layout
+        bool readNumpyHeader(std::istream& in, unsigned int& n_rows);
+    };
+
+//! Export StructureFactorAnalyzer to Python
+void export_StructureFactorAnalyzer(pybind11::module& m);
+
+#endif // __STRUCTURE_FACTOR_ANALYZER_H__
@@ -1,2 +1,4 @@
 from hoomd.metadynamics import integrate
 from hoomd.metadynamics import cv
+from hoomd.metadynamics import analyze
+from hoomd.metadynamics import tune
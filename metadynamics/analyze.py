@@ -0,0 +1,61 @@
+"""This module defines analyzers for collective variables."""
+from hoomd.metadynamics import _metadynamics
+from hoomd.metadynamics import cv
+import hoomd
+
+
+class structure_factor(hoomd.analyze._analyzer):
+    """Write the radially averaged structure factor of a mesh order parameter.
+
+    The structure factor :math:`S(\\mathbf{k})` of the density mesh of
+    :py:class:`hoomd.metadynamics.cv.mesh` is binned into `n_bins` shells of
+    equal width in :math:`|\\mathbf{k}|` up to `k_max`, using shell indices that
+    are computed once for every box. The shells are sampled every `period` time
+    steps, and the average over `window` samples is appended to the output as
+    one row, consisting of the time step followed by the average structure
+    factor in every shell (NaN for shells without wave vectors). The centre of
+    shell `i` is at :math:`(i+1/2)\\,k_\\mathrm{max}/n_\\mathrm{bins}`.
+
+    :param mesh:
+        The :py:class:`hoomd.metadynamics.cv.mesh` order parameter
+    :param filename:
+        Name of the output file
+    :param n_bins:
+        Number of shells
+    :param k_max:
+        Upper edge of the last shell
+    :param period:
+        Sample the structure factor every this many time steps
+    :param window:
+        Number of samples averaged in every row
+    :param format:
+        'numpy' to write a two-dimensional array of doubles that can be read
+        with :py:func:`numpy.load`, or 'binary' for raw doubles (native byte order)
+    :param overwrite:
+        If False, append to an existing file with the same number of shells
+
+    Example::
+
+        sk = metadynamics.analyze.structure_factor(mesh, filename='sk.npy',
+            n_bins=64, k_max=8.0, period=100, window=10)
+    """
+
+    def __init__(self, mesh, filename, n_bins, k_max, period=1, window=1, format='numpy', overwrite=False):
+        hoomd.util.print_status_line()
+
+        # initialize base class
+        hoomd.analyze._analyzer.__init__(self)
+
+        if not isinstance(mesh, cv.mesh):
+            hoomd.context.msg.error("analyze.structure_factor: Requires a cv.mesh collective variable.\n")
+            raise RuntimeError('Error creating analyzer.')
+
+        if format not in ('numpy', 'binary'):
+            hoomd.context.msg.error("analyze.structure_factor: Unknown output format " + str(format) + ".\n")
+            raise RuntimeError('Error creating analyzer.')
+
+        self.cpp_analyzer = _metadynamics.StructureFactorAnalyzer(
+            hoomd.context.current.system_definition, mesh.cpp_force, filename,
+            int(n_bins), float(k_max), int(window), format, bool(overwrite))
+
+        self.setupAnalyzer(period)
@@ -220,9 +220,34 @@ class lamellar(_collective_variable):
         List of reciprocal lattice vectors (Miller indices) for every mode
     :param name:
         Name given to this collective variable
+    :param mesh:
+        Number of mesh points `(nx, ny, nz)` (or a single number for all axes) to evaluate
+        the modes from the Fourier transform of a density mesh instead of a sum over the
+        particles (see below)
+    :param fft_backend:
+        Library for the FFTs on a single rank with a mesh ('auto', 'kiss' or 'fftw')
+
+    ## Mesh evaluation
+
+    The direct evaluation costs O(N n). With a mesh, the particles are assigned to
+    the mesh as in :py:class:`mesh`, and every mode is read off the transformed mesh
+    after dividing out the transform of the assignment function. The forces are
+    interpolated from the inverse transform of the modes. The cost is O(N + M log M)
+    for M mesh points, independent of the number of modes, which pays off for many
+    lattice vectors, e.g. a full star of reflections.
+
+    Every Miller index has to be smaller than half the number of mesh points along
+    its axis. The error is due to aliasing and decreases quickly with the order of
+    the assignment function (see :py:meth:`set_params`) and the number of mesh
+    points per wave length. The mesh is evaluated on the host.
+
+    Example::
+
+        metadynamics.cv.lamellar(sigma=.05, mode=dict(A=1.0, B=-1.0), lattice_vectors=star,
+                                 mesh=(32,32,32))
     """
 
-    def __init__(self, mode, lattice_vectors, name=None, sigma=1.0):
+    def __init__(self, mode, lattice_vectors, name=None, sigma=1.0, mesh=None, fft_backend='auto'):
         hoomd.util.print_status_line()
 
         if name is not None:
@@ -257,7 +282,21 @@ class lamellar(_collective_variable):
                 raise RuntimeError('Error creating collective variable.')
             cpp_lattice_vectors.append(hoomd.make_int3(l[0], l[1], l[2]))
 
-        if not hoomd.context.exec_conf.isCUDAEnabled():
+        self.mesh = mesh is not None
+        if self.mesh:
+            if type(mesh) == int:
+                mesh = (mesh, mesh, mesh)
+            if len(mesh) != 3:
+                hoomd.context.msg.error("cv.lamellar: Mesh size has to be a number or a triple.\n")
+                raise RuntimeError('Error creating collective variable.')
+
+            if hoomd.context.exec_conf.isCUDAEnabled():
+                hoomd.context.msg.warning("cv.lamellar: Mesh is evaluated on the host.\n")
+
+            self.cpp_force = _metadynamics.LamellarOrderParameterMesh(
+                hoomd.context.current.system_definition, int(mesh[0]), int(mesh[1]), int(mesh[2]),
+                cpp_mode, cpp_lattice_vectors, suffix, fft_backend)
+        elif not hoomd.context.exec_conf.isCUDAEnabled():
             self.cpp_force = _metadynamics.LamellarOrderParameter(
                 hoomd.context.current.system_definition, cpp_mode, cpp_lattice_vectors, suffix)
         else:
@@ -269,6 +308,33 @@ class lamellar(_collective_variable):
     ## \var cpp_force
     # \internal
 
+    def set_params(self, num_threads=None, order=None, **args):
+        """Set parameters for the collective variable
+
+        :param num_threads:
+            Number of host threads for the Fourier modes and the forces (requires OpenMP).
+            The default is the maximum number of OpenMP threads.
+        :param order:
+            Order of the B-spline assignment function with a mesh (2 to 7, default 3)
+        """
+        hoomd.util.print_status_line()
+
+        if num_threads is not None:
+            if hoomd.context.exec_conf.isCUDAEnabled() and not self.mesh:
+                hoomd.context.msg.warning("cv.lamellar: num_threads has no effect on the GPU.\n")
+            self.cpp_force.setNumThreads(int(num_threads))
+
+        if order is not None:
+            if not self.mesh:
+                hoomd.context.msg.error("cv.lamellar: The order of the assignment function requires a mesh.\n")
+                raise RuntimeError('Error setting parameters.')
+            self.cpp_force.setOrder(int(order))
+
+        # call base class method
+        hoomd.util.quiet_status()
+        _collective_variable.set_params(self, **args)
+        hoomd.util.unquiet_status()
+
     ## \internal
     def update_coeffs(self):
         pass
@@ -351,6 +417,25 @@ def _table_eval(r, rmin, rmax, V, F, width):
     return (V[i], F[i])
 
 
+def _kernel_table(func, kmin, kmax, width, coeff):
+    # allocate arrays to store kernel and derivative
+    Ktable = _hoomd.std_vector_scalar()
+    dKtable = _hoomd.std_vector_scalar()
+
+    # calculate dr
+    dk = (kmax - kmin) / float(width - 1)
+
+    # evaluate the function
+    for i in range(0, width):
+        k = kmin + dk * i
+        (K, dK) = func(k, kmin, kmax, **coeff)
+
+        Ktable.append(K)
+        dKtable.append(dK)
+
+    return (Ktable, dKtable)
+
+
 class mesh(_collective_variable):
     """Construct a lamellar order parameter.
 
@@ -363,14 +448,34 @@ class mesh(_collective_variable):
     :param ny:
         Number of mesh points along second axis
     :param nz:
-        Number of mesh points along third axis
+        Number of mesh points along third axis (always one in two dimensions)
     :param name:
         Name given to this collective variable
     :param zero_modes:
         Indices of modes that should be zeroed
+    :param fft_backend:
+        Library for the FFTs on a single rank ('auto', 'kiss' or 'fftw').
+        'auto' selects FFTW if the plugin was compiled with it.
+    :param fft_wisdom:
+        File to load and store FFTW wisdom from and to
+    :param influence_cache:
+        File to load and store the influence function and the wave vectors from and to.
+        The cache is only used if it matches the mesh, the box and the convolution kernel,
+        which avoids the setup cost of very large meshes in repeated runs. With MPI, every
+        rank appends its rank to the file name. If `fft_wisdom` is not given, the FFTW
+        wisdom is stored in the file with the suffix ``.wisdom``.
+
+    If the plugin is configured with ``ENABLE_MESH_SINGLE_PRECISION``, the meshes are
+    stored in single precision, while the collective variable, the forces and the virial
+    are still accumulated in double precision. The option requires FFTW in single precision
+    (fftw3f), which then runs the local FFTs, and the 'kiss' backend is not available. With
+    domain decomposition, the 'dfft' distributed FFT still operates in double precision on a
+    converted copy of the mesh, while the 'gather' method transforms in single precision
+    (see :py:meth:`set_params`).
     """
 
-    def __init__(self, mode, nx, ny=None, nz=None, name=None, sigma=1.0, zero_modes=None):
+    def __init__(self, mode, nx, ny=None, nz=None, name=None, sigma=1.0, zero_modes=None, fft_backend='auto', fft_wisdom=None,
+                 influence_cache=None):
         hoomd.util.print_status_line()
 
         if name is not None:
@@ -383,7 +488,10 @@ class mesh(_collective_variable):
             ny = nx
 
         if nz is None:
-            nz = nx
+            if hoomd.context.current.system_definition.getNDimensions() == 2:
+                nz = 1
+            else:
+                nz = nx
 
         _collective_variable.__init__(self, sigma, name)
 
@@ -410,24 +518,87 @@ class mesh(_collective_variable):
 
         if not hoomd.context.exec_conf.isCUDAEnabled():
             self.cpp_force = _metadynamics.OrderParameterMesh(
-                hoomd.context.current.system_definition, nx, ny, nz, cpp_mode, cpp_zero_modes)
+                hoomd.context.current.system_definition, nx, ny, nz, cpp_mode, cpp_zero_modes, fft_backend)
+            if fft_wisdom is not None:
+                self.cpp_force.setFFTWisdomFile(fft_wisdom)
         else:
             self.cpp_force = _metadynamics.OrderParameterMeshGPU(
                 hoomd.context.current.system_definition, nx, ny, nz, cpp_mode, cpp_zero_modes)
 
+        if influence_cache is not None:
+            self.cpp_force.setInfluenceCacheFile(influence_cache)
+
         hoomd.context.current.system.addCompute(self.cpp_force, self.force_name)
 
     ## \var cpp_force
     # \internal
 
-    def set_params(self, use_table=None, **args):
+    def set_params(self, use_table=None, num_threads=None, sort_period=None, order=None, interlace=None,
+                   deconvolve=None, num_peaks=None, peak_shell=None, distributed_fft=None, **args):
         """Set parameters for the collective variable
+
+        :param use_table:
+            True if the tabulated convolution kernel should be used
+        :param num_threads:
+            Number of host threads for the mesh operations (requires OpenMP)
+        :param sort_period:
+            Visit particles in the order of their mesh cells, sorting them every
+            this many mesh updates (0 to disable)
+        :param order:
+            Order of the B-spline assignment function (2 to 7, default 3). A higher
+            order allows for a coarser mesh. The GPU implementation only supports order 3.
+        :param interlace:
+            True if the density should also be assigned to a mesh shifted by half a cell,
+            to reduce aliasing at the cost of a second set of FFTs (not supported on the GPU)
+        :param deconvolve:
+            True if the transformed density should be divided by the transform of the
+            assignment function, which removes the attenuation of the modes at large wave
+            numbers (default False, not supported on the GPU)
+        :param num_peaks:
+            Number of structure factor peaks to track (default 1). The wave vector and the
+            structure factor of peak i are logged as **q_max_i** (length), **qx_max_i**,
+            **qy_max_i**, **qz_max_i** and **sq_max_i**. The GPU implementation only tracks one peak.
+        :param peak_shell:
+            Width of the shell in k-space around every peak over which the structure factor
+            is averaged and logged as **sq_shell_i** (0 to disable, not supported on the GPU)
+        :param distributed_fft:
+            FFT of the mesh with domain decomposition: 'dfft' for the distributed FFT, 'gather'
+            to transform the whole mesh on the root rank, which avoids the latency of the
+            distributed FFT for small meshes on many ranks, or 'auto' (default) to choose
+            'gather' if every rank holds at most 16^3 and the whole mesh at most 64^3 mesh
+            points (not supported on the GPU)
         """
         hoomd.util.print_status_line()
 
         if use_table is not None:
             self.cpp_force.setUseTable(use_table)
 
+        if num_threads is not None:
+            if hoomd.context.exec_conf.isCUDAEnabled():
+                hoomd.context.msg.warning("cv.mesh: num_threads has no effect on the GPU.\n")
+            self.cpp_force.setNumThreads(int(num_threads))
+
+        if sort_period is not None:
+            self.cpp_force.setSortPeriod(int(sort_period))
+
+        if order is not None:
+            self.cpp_force.setOrder(int(order))
+
+        if interlace is not None:
+            self.cpp_force.setInterlace(bool(interlace))
+
+        if deconvolve is not None:
+            self.cpp_force.setDeconvolve(bool(deconvolve))
+
+        if num_peaks is not None:
+            self.cpp_force.setNumPeaks(int(num_peaks))
+
+        if peak_shell is not None:
+            self.cpp_force.setPeakShellWidth(float(peak_shell))
+
+        if distributed_fft is not None:
+            self.cpp_force.setDistributedFFT(str(distributed_fft))
+
         # call base class method
         hoomd.util.quiet_status()
         _collective_variable.set_params(self, **args)
@@ -447,20 +618,176 @@ class mesh(_collective_variable):
         :param coeff:
             Additional parameters to the function, as a dict (optional)
         """
-        # allocate arrays to store kernel and derivative
-        Ktable = _hoomd.std_vector_scalar()
-        dKtable = _hoomd.std_vector_scalar()
+        (Ktable, dKtable) = _kernel_table(func, kmin, kmax, width, coeff)
+
+        # pass table to C++ collective variable
+        self.cpp_force.setTable(Ktable, dKtable, kmin, kmax)
+
+    ## \internal
+    def update_coeffs(self):
+        pass
+
 
-        # calculate dr
-        dk = (kmax - kmin) / float(width - 1)
+class mesh_multi(object):
+    """Several mesh order parameters sharing one density mesh.
 
-        # evaluate the function
-        for i in range(0, width):
-            k = kmin + dk * i
-            (K, dK) = func(k, kmin, kmax, **coeff)
+    Every channel is a :py:class:`mesh` order parameter with its own mode
+    coefficients and convolution kernel, and is biased as a collective
+    variable of its own (see :py:attr:`channels`). The particles are
+    assigned to the mesh once for all channels, and two channels are
+    transformed with a single complex FFT if the mesh is not decomposed
+    over several ranks, so that biasing k order parameters costs about
+    k/2 FFTs.
 
-            Ktable.append(K)
-            dKtable.append(dK)
+    ## Logging
+
+    The log name of channel i is **cv_mesh_i**, or **cv_mesh_name_i**
+    if a name is given.
+
+    :param modes:
+        List of per-type dictionaries of mode coefficients, one per channel
+    :param nx:
+        Number of mesh points along first axis
+    :param ny:
+        Number of mesh points along second axis
+    :param nz:
+        Number of mesh points along third axis (always one in two dimensions)
+    :param name:
+        Name given to this set of collective variables
+    :param sigma:
+        Standard deviation of deposited Gaussians (for every channel)
+    :param fft_backend:
+        Library for the FFTs on a single rank ('auto', 'kiss' or 'fftw').
+    :param fft_wisdom:
+        File to load and store FFTW wisdom from and to
+    """
+
+    def __init__(self, modes, nx, ny=None, nz=None, name=None, sigma=1.0, fft_backend='auto', fft_wisdom=None):
+        hoomd.util.print_status_line()
+
+        if ny is None:
+            ny = nx
+
+        if nz is None:
+            if hoomd.context.current.system_definition.getNDimensions() == 2:
+                nz = 1
+            else:
+                nz = nx
+
+        if len(modes) == 0:
+            hoomd.context.msg.error("cv.mesh_multi: List of modes is empty.\n")
+            raise RuntimeError('Error creating collective variable.')
+
+        cpp_modes = _hoomd.std_vector_scalar()
+        for mode in modes:
+            if type(mode) != type(dict()):
+                hoomd.context.msg.error("cv.mesh_multi: Mode amplitudes specified incorrectly.\n")
+                raise RuntimeError('Error creating collective variable.')
+
+            for i in range(0, hoomd.context.current.system_definition.getParticleData().getNTypes()):
+                t = hoomd.context.current.system_definition.getParticleData().getNameByType(i)
+
+                if t not in mode.keys():
+                    hoomd.context.msg.error("cv.mesh_multi: Missing mode amplitude for particle type " + t + ".\n")
+                    raise RuntimeError('Error creating collective variable.')
+                cpp_modes.append(mode[t])
+
+        if hoomd.context.exec_conf.isCUDAEnabled():
+            hoomd.context.msg.warning("cv.mesh_multi: Mesh is evaluated on the host.\n")
+
+        self.cpp_mesh = _metadynamics.OrderParameterMeshMulti(
+            hoomd.context.current.system_definition, nx, ny, nz, cpp_modes, fft_backend)
+        if fft_wisdom is not None:
+            self.cpp_mesh.setFFTWisdomFile(fft_wisdom)
+
+        hoomd.util.quiet_status()
+        self.channels = []
+        for i in range(0, len(modes)):
+            suffix = "_" + (name + "_" if name is not None else "") + str(i)
+            self.channels.append(_mesh_channel(self, i, suffix, sigma))
+        hoomd.util.unquiet_status()
+
+    ## \var cpp_mesh
+    # \internal
+
+    ## \var channels
+    # List of collective variables, one per channel
+
+    def set_params(self, num_threads=None, sort_period=None, order=None, deconvolve=None):
+        """Set parameters of the shared mesh
+
+        :param num_threads:
+            Number of host threads for the mesh operations (requires OpenMP)
+        :param sort_period:
+            Visit particles in the order of their mesh cells, sorting them every
+            this many mesh updates (0 to disable)
+        :param order:
+            Order of the B-spline assignment function (2 to 7, default 3)
+        :param deconvolve:
+            True if the transformed density should be divided by the transform of the
+            assignment function (default False)
+        """
+        hoomd.util.print_status_line()
+
+        if num_threads is not None:
+            self.cpp_mesh.setNumThreads(int(num_threads))
+
+        if sort_period is not None:
+            self.cpp_mesh.setSortPeriod(int(sort_period))
+
+        if order is not None:
+            self.cpp_mesh.setOrder(int(order))
+
+        if deconvolve is not None:
+            self.cpp_mesh.setDeconvolve(bool(deconvolve))
+
+
+class _mesh_channel(_collective_variable):
+    """A single channel of a :py:class:`mesh_multi`.
+
+    :param mesh:
+        The :py:class:`mesh_multi`
+    :param channel:
+        Index of the channel
+    :param suffix:
+        Suffix of the name of the collective variable
+    :param sigma:
+        Standard deviation of deposited Gaussians
+    """
+
+    def __init__(self, mesh, channel, suffix, sigma):
+        _collective_variable.__init__(self, sigma, suffix)
+
+        self.mesh = mesh
+        self.channel = channel
+
+        self.cpp_force = _metadynamics.OrderParameterMeshChannel(
+            hoomd.context.current.system_definition, mesh.cpp_mesh, channel, suffix)
+
+        hoomd.context.current.system.addCompute(self.cpp_force, self.force_name)
+
+    def set_params(self, use_table=None, **args):
+        """Set parameters for this channel
+
+        :param use_table:
+            True if the tabulated convolution kernel should be used
+        """
+        hoomd.util.print_status_line()
+
+        if use_table is not None:
+            self.cpp_force.setUseTable(use_table)
+
+        # call base class method
+        hoomd.util.quiet_status()
+        _collective_variable.set_params(self, **args)
+        hoomd.util.unquiet_status()
+
+    def set_kernel(self, func, kmin, kmax, width, coeff=dict()):
+        """Set the table to be used for the convolution kernel of this channel.
+
+        See :py:meth:`mesh.set_kernel`.
+        """
+        (Ktable, dKtable) = _kernel_table(func, kmin, kmax, width, coeff)
 
         # pass table to C++ collective variable
         self.cpp_force.setTable(Ktable, dKtable, kmin, kmax)
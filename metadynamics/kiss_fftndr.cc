@@ -0,0 +1,215 @@
+/*! \file kiss_fftndr.cc
+    \brief Implements real-to-complex FFTs on top of kiss_fft
+ */
+
+#include "kiss_fftndr.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+//! Complex multiplication
+static inline kiss_fft_cpx cpx_mul(const kiss_fft_cpx& a, const kiss_fft_cpx& b)
+    {
+    kiss_fft_cpx c;
+    c.r = a.r*b.r - a.i*b.i;
+    c.i = a.r*b.i + a.i*b.r;
+    return c;
+    }
+
+/*! \param nfft Length of the real sequence (has to be even)
+    \param inverse_fft Non-zero for the inverse (complex-to-real) transform
+    \returns the configuration, or NULL if nfft is odd
+ */
+kiss_fftr_cfg kiss_fftr_alloc(int nfft, int inverse_fft)
+    {
+    if (nfft & 1)
+        return NULL;
+
+    int ncfft = nfft/2;
+
+    kiss_fftr_cfg st = (kiss_fftr_cfg) malloc(sizeof(struct kiss_fftr_state));
+    st->ncfft = ncfft;
+    st->substate = kiss_fft_alloc(ncfft, inverse_fft, NULL, NULL);
+    st->tmpbuf = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx)*ncfft);
+    st->super_twiddles = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx)*(ncfft/2+1));
+
+    for (int i = 0; i < ncfft/2+1; ++i)
+        {
+        double phase = -M_PI*((double)(i+1)/ncfft + 0.5);
+        if (inverse_fft)
+            phase *= -1.0;
+        st->super_twiddles[i].r = cos(phase);
+        st->super_twiddles[i].i = sin(phase);
+        }
+
+    return st;
+    }
+
+void kiss_fftr(kiss_fftr_cfg st, const kiss_fft_scalar *timedata, kiss_fft_cpx *freqdata)
+    {
+    int ncfft = st->ncfft;
+
+    // transform the even and odd samples as real and imaginary parts
+    kiss_fft(st->substate, (const kiss_fft_cpx *) timedata, st->tmpbuf);
+
+    kiss_fft_cpx tdc = st->tmpbuf[0];
+    freqdata[0].r = tdc.r + tdc.i;
+    freqdata[ncfft].r = tdc.r - tdc.i;
+    freqdata[0].i = freqdata[ncfft].i = 0;
+
+    for (int k = 1; k <= ncfft/2; ++k)
+        {
+        kiss_fft_cpx fpk = st->tmpbuf[k];
+        kiss_fft_cpx fpnk;
+        fpnk.r = st->tmpbuf[ncfft-k].r;
+        fpnk.i = -st->tmpbuf[ncfft-k].i;
+
+        kiss_fft_cpx f1k, f2k;
+        f1k.r = fpk.r + fpnk.r;
+        f1k.i = fpk.i + fpnk.i;
+        f2k.r = fpk.r - fpnk.r;
+        f2k.i = fpk.i - fpnk.i;
+
+        kiss_fft_cpx tw = cpx_mul(f2k, st->super_twiddles[k-1]);
+
+        freqdata[k].r = kiss_fft_scalar(0.5)*(f1k.r + tw.r);
+        freqdata[k].i = kiss_fft_scalar(0.5)*(f1k.i + tw.i);
+        freqdata[ncfft-k].r = kiss_fft_scalar(0.5)*(f1k.r - tw.r);
+        freqdata[ncfft-k].i = kiss_fft_scalar(0.5)*(tw.i - f1k.i);
+        }
+    }
+
+void kiss_fftri(kiss_fftr_cfg st, const kiss_fft_cpx *freqdata, kiss_fft_scalar *timedata)
+    {
+    int ncfft = st->ncfft;
+
+    st->tmpbuf[0].r = freqdata[0].r + freqdata[ncfft].r;
+    st->tmpbuf[0].i = freqdata[0].r - freqdata[ncfft].r;
+
+    for (int k = 1; k <= ncfft/2; ++k)
+        {
+        kiss_fft_cpx fk = freqdata[k];
+        kiss_fft_cpx fnkc;
+        fnkc.r = freqdata[ncfft-k].r;
+        fnkc.i = -freqdata[ncfft-k].i;
+
+        kiss_fft_cpx fek, tmp;
+        fek.r = fk.r + fnkc.r;
+        fek.i = fk.i + fnkc.i;
+        tmp.r = fk.r - fnkc.r;
+        tmp.i = fk.i - fnkc.i;
+
+        kiss_fft_cpx fok = cpx_mul(tmp, st->super_twiddles[k-1]);
+
+        st->tmpbuf[k].r = fek.r + fok.r;
+        st->tmpbuf[k].i = fek.i + fok.i;
+        st->tmpbuf[ncfft-k].r = fek.r - fok.r;
+        st->tmpbuf[ncfft-k].i = -(fek.i - fok.i);
+        }
+
+    kiss_fft(st->substate, st->tmpbuf, (kiss_fft_cpx *) timedata);
+    }
+
+void kiss_fftr_free(kiss_fftr_cfg st)
+    {
+    if (! st) return;
+    free(st->substate);
+    free(st->tmpbuf);
+    free(st->super_twiddles);
+    free(st);
+    }
+
+/*! \param dims Dimensions of the real data, in row-major order
+    \param ndims Number of dimensions
+    \param inverse_fft Non-zero for the inverse (complex-to-real) transform
+    \returns the configuration, or NULL if the last dimension is odd
+ */
+kiss_fftndr_cfg kiss_fftndr_alloc(const int *dims, int ndims, int inverse_fft)
+    {
+    int dimReal = dims[ndims-1];
+    if (dimReal & 1)
+        return NULL;
+
+    int dimOther = 1;
+    for (int i = 0; i < ndims-1; ++i)
+        dimOther *= dims[i];
+
+    int nrbins = dimReal/2+1;
+
+    kiss_fftndr_cfg st = (kiss_fftndr_cfg) malloc(sizeof(struct kiss_fftndr_state));
+    st->dimReal = dimReal;
+    st->dimOther = dimOther;
+    st->cfg_r = kiss_fftr_alloc(dimReal, inverse_fft);
+    st->cfg_nd = (ndims > 1) ? kiss_fftnd_alloc(dims, ndims-1, inverse_fft, NULL, NULL) : NULL;
+    st->tmpbuf = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx)*nrbins*dimOther);
+    st->colbuf = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx)*dimOther);
+    st->colbuf_out = (kiss_fft_cpx *) malloc(sizeof(kiss_fft_cpx)*dimOther);
+
+    return st;
+    }
+
+void kiss_fftndr(kiss_fftndr_cfg st, const kiss_fft_scalar *timedata, kiss_fft_cpx *freqdata)
+    {
+    int nrbins = st->dimReal/2+1;
+
+    // real transform of every row
+    for (int k1 = 0; k1 < st->dimOther; ++k1)
+        kiss_fftr(st->cfg_r, timedata + k1*st->dimReal, st->tmpbuf + k1*nrbins);
+
+    if (! st->cfg_nd)
+        {
+        for (int k = 0; k < nrbins; ++k)
+            freqdata[k] = st->tmpbuf[k];
+        return;
+        }
+
+    // complex transform of every column of the half spectrum
+    for (int k2 = 0; k2 < nrbins; ++k2)
+        {
+        for (int k1 = 0; k1 < st->dimOther; ++k1)
+            st->colbuf[k1] = st->tmpbuf[k1*nrbins + k2];
+
+        kiss_fftnd(st->cfg_nd, st->colbuf, st->colbuf_out);
+
+        for (int k1 = 0; k1 < st->dimOther; ++k1)
+            freqdata[k1*nrbins + k2] = st->colbuf_out[k1];
+        }
+    }
+
+void kiss_fftndri(kiss_fftndr_cfg st, const kiss_fft_cpx *freqdata, kiss_fft_scalar *timedata)
+    {
+    int nrbins = st->dimReal/2+1;
+
+    if (! st->cfg_nd)
+        {
+        kiss_fftri(st->cfg_r, freqdata, timedata);
+        return;
+        }
+
+    // complex transform of every column of the half spectrum
+    for (int k2 = 0; k2 < nrbins; ++k2)
+        {
+        for (int k1 = 0; k1 < st->dimOther; ++k1)
+            st->colbuf[k1] = freqdata[k1*nrbins + k2];
+
+        kiss_fftnd(st->cfg_nd, st->colbuf, st->colbuf_out);
+
+        for (int k1 = 0; k1 < st->dimOther; ++k1)
+            st->tmpbuf[k1*nrbins + k2] = st->colbuf_out[k1];
+        }
+
+    // complex-to-real transform of every row
+    for (int k1 = 0; k1 < st->dimOther; ++k1)
+        kiss_fftri(st->cfg_r, st->tmpbuf + k1*nrbins, timedata + k1*st->dimReal);
+    }
+
+void kiss_fftndr_free(kiss_fftndr_cfg st)
+    {
+    if (! st) return;
+    kiss_fftr_free(st->cfg_r);
+    free(st->cfg_nd);
+    free(st->tmpbuf);
+    free(st->colbuf);
+    free(st->colbuf_out);
+    free(st);
+    }
@@ -0,0 +1,72 @@
+#ifndef __KISS_FFTNDR_H__
+#define __KISS_FFTNDR_H__
+
+/*! \file kiss_fftndr.h
+    \brief Real-to-complex multi-dimensional FFTs on top of kiss_fft
+
+    HOOMD only ships the complex kiss_fft/kiss_fftnd transforms. This file
+    provides the real-valued variants (kiss_fftr, kiss_fftndr) following the
+    interface of the upstream kissfft tools, with the difference that the
+    configurations are released with the corresponding _free() function.
+
+    The real transform packs the even and odd samples of a real sequence of
+    even length N into a complex sequence of length N/2, and recovers the
+    N/2+1 non-redundant Fourier coefficients using a set of twiddle factors.
+
+    The multi-dimensional transform operates on row-major data, where the
+    last (fastest varying) dimension is real. Its Fourier representation
+    is row-major as well, with dims[ndims-1]/2+1 complex entries along the
+    last dimension. Neither transform is normalized.
+ */
+
+#include <hoomd/extern/kiss_fft.h>
+#include <hoomd/extern/kiss_fftnd.h>
+
+//! Configuration of a one-dimensional real FFT
+struct kiss_fftr_state
+    {
+    int ncfft;                      //!< Half of the real sequence length
+    kiss_fft_cfg substate;          //!< Complex FFT of half length
+    kiss_fft_cpx *tmpbuf;           //!< Scratch space of half length
+    kiss_fft_cpx *super_twiddles;   //!< Twiddle factors to split the packed transform
+    };
+typedef struct kiss_fftr_state *kiss_fftr_cfg;
+
+//! Configuration of a multi-dimensional real FFT
+struct kiss_fftndr_state
+    {
+    int dimReal;                    //!< Length of the last (real) dimension
+    int dimOther;                   //!< Product of the remaining dimensions
+    kiss_fftr_cfg cfg_r;            //!< Real transform along the last dimension
+    kiss_fftnd_cfg cfg_nd;          //!< Complex transform along the remaining dimensions
+    kiss_fft_cpx *tmpbuf;           //!< Half-spectrum scratch space
+    kiss_fft_cpx *colbuf;           //!< Scratch space for a single column
+    kiss_fft_cpx *colbuf_out;       //!< Scratch space for a transformed column
+    };
+typedef struct kiss_fftndr_state *kiss_fftndr_cfg;
+
+//! Allocate a real FFT of even length nfft
+kiss_fftr_cfg kiss_fftr_alloc(int nfft, int inverse_fft);
+
+//! Forward real FFT, nfft real inputs, nfft/2+1 complex outputs
+void kiss_fftr(kiss_fftr_cfg cfg, const kiss_fft_scalar *timedata, kiss_fft_cpx *freqdata);
+
+//! Inverse real FFT, nfft/2+1 complex inputs, nfft real outputs
+void kiss_fftri(kiss_fftr_cfg cfg, const kiss_fft_cpx *freqdata, kiss_fft_scalar *timedata);
+
+//! Release a real FFT configuration
+void kiss_fftr_free(kiss_fftr_cfg cfg);
+
+//! Allocate a multi-dimensional real FFT, dims[ndims-1] has to be even
+kiss_fftndr_cfg kiss_fftndr_alloc(const int *dims, int ndims, int inverse_fft);
+
+//! Forward multi-dimensional real FFT
+void kiss_fftndr(kiss_fftndr_cfg cfg, const kiss_fft_scalar *timedata, kiss_fft_cpx *freqdata);
+
+//! Inverse multi-dimensional real FFT
+void kiss_fftndri(kiss_fftndr_cfg cfg, const kiss_fft_cpx *freqdata, kiss_fft_scalar *timedata);
+
+//! Release a multi-dimensional real FFT configuration
+void kiss_fftndr_free(kiss_fftndr_cfg cfg);
+
+#endif // __KISS_FFTNDR_H__
@@ -4,10 +4,13 @@
 #include "LamellarOrderParameter.h"
 #include "AspectRatio.h"
 #include "OrderParameterMesh.h"
+#include "OrderParameterMeshMulti.h"
+#include "LamellarOrderParameterMesh.h"
 #include "WellTemperedEnsemble.h"
 #include "CollectiveWrapper.h"
 #include "SteinhardtQl.h"
 #include "Density.h"
+#include "StructureFactorAnalyzer.h"
 
 #ifdef ENABLE_CUDA
 #include "LamellarOrderParameterGPU.h"
@@ -29,10 +32,13 @@ PYBIND11_MODULE(_metadynamics, m)
     export_LamellarOrderParameter(m);
     export_AspectRatio(m);
     export_OrderParameterMesh(m);
+    export_OrderParameterMeshMulti(m);
+    export_LamellarOrderParameterMesh(m);
     export_WellTemperedEnsemble(m);
     export_CollectiveWrapper(m);
     export_SteinhardtQl(m);
     export_Density(m);
+    export_StructureFactorAnalyzer(m);
 
 #ifdef ENABLE_CUDA
     export_LamellarOrderParameterGPU(m);
@@ -0,0 +1,185 @@
+"""This module defines utilities to tune the parameters of collective variables."""
+from hoomd.metadynamics import _metadynamics
+from hoomd import _hoomd
+import hoomd
+
+import math
+
+
+def _is_fft_friendly(n):
+    """Return True if n has no prime factors other than 2, 3 and 5."""
+    for p in (2, 3, 5):
+        while n % p == 0:
+            n //= p
+    return n == 1
+
+
+def _next_fft_friendly(n):
+    """Return the smallest FFT-friendly integer not smaller than n."""
+    while not _is_fft_friendly(n):
+        n += 1
+    return n
+
+
+def mesh_size(mode, tolerance=0.01, order=None, interlace=None, deconvolve=None, num_threads=None,
+              fft_backend='auto', n_min=8, n_max=128, num_candidates=4, num_iters=10):
+    """Choose the mesh size of a :py:class:`hoomd.metadynamics.cv.mesh` order parameter.
+
+    Candidate meshes are generated from sizes with no prime factors other than
+    2, 3 and 5 along the longest box axis, with the other axes chosen for a
+    mesh spacing as close to isotropic as possible (one layer along z in two
+    dimensions). For every candidate, in the order of increasing number of mesh
+    points, the collective variable of the current configuration is compared to a
+    reference from a direct sum over the particles, which evaluates the same wave
+    vectors exactly. The first `num_candidates` meshes with a relative error below
+    `tolerance` are timed on the actual system, and the fastest one is returned.
+
+    Without deconvolution, the attenuation of the modes by the assignment function
+    is part of the error. It only decreases with the mesh spacing if the structure
+    factor decays at large wave numbers, so that a mesh with deconvolution usually
+    meets the tolerance with fewer points.
+
+    The direct sum scales with the number of particles times the number of mesh
+    points, so the tuner should be run once on a representative configuration,
+    e.g. after equilibration. The error is relative to the value of the
+    collective variable, which is only meaningful if the value is not close to
+    zero, as it is for a disordered configuration.
+
+    :param mode:
+        Per-type dictionary of mode coefficients, as for :py:class:`hoomd.metadynamics.cv.mesh`
+    :param tolerance:
+        Maximum relative error of the collective variable
+    :param order:
+        Order of the B-spline assignment function (default 3)
+    :param interlace:
+        True if interlacing is used
+    :param deconvolve:
+        True if the assignment function is deconvolved
+    :param num_threads:
+        Number of host threads for the mesh operations
+    :param fft_backend:
+        Local FFT backend ("auto", "kiss" or "fftw")
+    :param n_min:
+        Smallest number of mesh points along any axis
+    :param n_max:
+        Largest number of mesh points along the longest axis
+    :param num_candidates:
+        Number of meshes that meet the tolerance to be timed
+    :param num_iters:
+        Number of mesh evaluations per timing
+
+    :returns: The tuple `(nx, ny, nz)` of the fastest mesh
+
+    Example::
+
+        nx, ny, nz = metadynamics.tune.mesh_size(mode=dict(A=1.0, B=-1.0), tolerance=0.01, deconvolve=True)
+        mesh = meta.cv.mesh(mode=dict(A=1.0, B=-1.0), nx=nx, ny=ny, nz=nz)
+        mesh.set_params(deconvolve=True)
+    """
+    hoomd.util.print_status_line()
+
+    if not hoomd.init.is_initialized():
+        hoomd.context.msg.error("tune.mesh_size: Cannot tune the mesh before initialization.\n")
+        raise RuntimeError('Error tuning mesh size.')
+
+    # the GPU implementation rejects these options, see cv.mesh.set_params()
+    if hoomd.context.exec_conf.isCUDAEnabled():
+        if order is not None and int(order) != 3:
+            hoomd.context.msg.error("tune.mesh_size: The GPU implementation only supports assignment order 3.\n")
+            raise RuntimeError('Error tuning mesh size.')
+        if interlace:
+            hoomd.context.msg.error("tune.mesh_size: Interlacing is not supported on the GPU.\n")
+            raise RuntimeError('Error tuning mesh size.')
+        if deconvolve:
+            hoomd.context.msg.error("tune.mesh_size: Deconvolution of the assignment function is not supported on the GPU.\n")
+            raise RuntimeError('Error tuning mesh size.')
+
+    sysdef = hoomd.context.current.system_definition
+    pdata = sysdef.getParticleData()
+
+    if type(mode) != type(dict()):
+        hoomd.context.msg.error("tune.mesh_size: Mode amplitudes specified incorrectly.\n")
+        raise RuntimeError('Error tuning mesh size.')
+
+    cpp_mode = _hoomd.std_vector_scalar()
+    for i in range(0, pdata.getNTypes()):
+        t = pdata.getNameByType(i)
+
+        if t not in mode.keys():
+            hoomd.context.msg.error("tune.mesh_size: Missing mode amplitude for particle type " + t + ".\n")
+            raise RuntimeError('Error tuning mesh size.')
+        cpp_mode.append(mode[t])
+
+    # generate candidate meshes with approximately isotropic spacing
+    L = pdata.getGlobalBox().getL()
+    dim = sysdef.getNDimensions()
+    lengths = [L.x, L.y, L.z] if dim == 3 else [L.x, L.y]
+    L_max = max(lengths)
+
+    candidates = []
+    for n in range(n_min, n_max+1):
+        if not _is_fft_friendly(n):
+            continue
+
+        h = L_max/n
+        sizes = [_next_fft_friendly(max(n_min, int(math.ceil(l/h - 1e-6)))) for l in lengths]
+        if dim == 2:
+            sizes.append(1)
+
+        if tuple(sizes) not in candidates:
+            candidates.append(tuple(sizes))
+
+    candidates.sort(key=lambda s: (s[0]*s[1]*s[2], s))
+
+    timestep = hoomd.get_step()
+
+    hoomd.context.msg.notice(2, "tune.mesh_size: Testing up to {} meshes\n".format(len(candidates)))
+    hoomd.context.msg.notice(2, "{:>6} {:>6} {:>6} {:>14} {:>12}\n".format('nx', 'ny', 'nz', 'rel. error', 'time (ms)'))
+
+    results = []
+    for (nx, ny, nz) in candidates:
+        try:
+            if not hoomd.context.exec_conf.isCUDAEnabled():
+                cpp_mesh = _metadynamics.OrderParameterMesh(sysdef, nx, ny, nz, cpp_mode,
+                    _metadynamics.std_vector_int3(), fft_backend)
+            else:
+                cpp_mesh = _metadynamics.OrderParameterMeshGPU(sysdef, nx, ny, nz, cpp_mode,
+                    _metadynamics.std_vector_int3())
+        except RuntimeError:
+            # e.g., the size is not a multiple of the processor grid
+            hoomd.context.msg.notice(2, "{:>6} {:>6} {:>6}   skipped\n".format(nx, ny, nz))
+            continue
+
+        if order is not None:
+            cpp_mesh.setOrder(int(order))
+        if interlace is not None:
+            cpp_mesh.setInterlace(bool(interlace))
+        if deconvolve is not None:
+            cpp_mesh.setDeconvolve(bool(deconvolve))
+        if num_threads is not None:
+            cpp_mesh.setNumThreads(int(num_threads))
+
+        cv = cpp_mesh.getCurrentValue(timestep)
+        cv_ref = cpp_mesh.computeDirectValue(timestep)
+        err = abs(cv - cv_ref)/abs(cv_ref) if cv_ref != 0.0 else abs(cv)
+
+        if err > tolerance:
+            hoomd.context.msg.notice(2, "{:>6} {:>6} {:>6} {:>14.4e}\n".format(nx, ny, nz, err))
+            continue
+
+        t = cpp_mesh.benchmarkMesh(timestep, int(num_iters))
+        hoomd.context.msg.notice(2, "{:>6} {:>6} {:>6} {:>14.4e} {:>12.4f}\n".format(nx, ny, nz, err, t))
+        results.append((t, (nx, ny, nz)))
+
+        if len(results) >= num_candidates:
+            break
+
+    if len(results) == 0:
+        hoomd.context.msg.error("tune.mesh_size: No mesh with up to " + str(n_max)
+                                + " points per axis meets the tolerance.\n")
+        raise RuntimeError('Error tuning mesh size.')
+
+    t, best = min(results)
+    hoomd.context.msg.notice(2, "tune.mesh_size: Fastest mesh is {} x {} x {} ({:.4f} ms)\n".format(
+        best[0], best[1], best[2], t))
+    return best
@@ -0,0 +1,178 @@
+# Configurations and numpy reference values shared by the tests of the mesh order parameter
+
+from hoomd import data, comm, md
+
+import math
+
+import numpy as np
+
+def lamellar_snapshot(N=2000, L=10.0, seed=123, particle_types=['A','B'], dimensions=3):
+    """ Random positions in a cubic box, or a square in two dimensions, with A and B particles
+        distributed according to a lamellar composition profile sin(4 pi x/L) along x
+    """
+    snap = data.make_snapshot(N=N, box=data.boxdim(L=L, dimensions=dimensions), particle_types=particle_types)
+    if comm.get_rank() == 0:
+        rng = np.random.RandomState(seed)
+        pos = rng.uniform(-L/2, L/2, size=(N,3))
+        if dimensions == 2:
+            pos[:,2] = 0
+        snap.particles.position[:] = pos
+        snap.particles.typeid[:] = rng.uniform(size=N) >= 0.5*(1+np.sin(4*np.pi*pos[:,0]/L))
+    return snap
+
+def integrate_in_place():
+    """ Set up an integrator without integration methods, which evaluates the forces
+        in every time step but does not move the particles
+    """
+    md.integrate.mode_standard(dt=0.001)
+
+def bspline(u, order):
+    """ Cardinal B-spline of the given order, centered at zero
+    """
+    M = np.zeros_like(u)
+    for k in range(order+1):
+        binom = math.factorial(order)//(math.factorial(k)*math.factorial(order-k))
+        t = u + 0.5*order - k
+        M += (-1)**k*binom*np.where(t > 0, np.abs(t)**(order-1), 0.0)
+    return M/math.factorial(order-1)
+
+def assignment_weights(x, L, n, order, shift=0.0):
+    """ Weights of the n mesh points along an axis of length L for particles at x,
+        and their derivatives with respect to x
+
+        The mesh points are shifted from the cell centers by shift cells.
+    """
+    h = L/n
+
+    # distance from the mesh points, as the minimum image
+    u = (x[:,None] + 0.5*L)/h - (np.arange(n)[None,:] + 0.5 + shift)
+    u -= n*np.round(u/n)
+
+    return bspline(u, order), (bspline(u + 0.5, order-1) - bspline(u - 0.5, order-1))/h
+
+def transform_mesh(snap, mode, n, order=3, interlace=False, deconvolve=False):
+    """ Mode amplitudes, assignment weights and normalized Fourier transform of the density
+        on a mesh with n = (nx, ny, nz) points, and the self term of the mode amplitudes
+
+        The density is assigned with B-splines of the given order, where order 3 is the
+        triangular-shaped cloud scheme, and transformed with a complex FFT over the full
+        spectrum. With interlacing, it is averaged with the density on a mesh shifted by
+        half a cell, whose transform is multiplied by the phase of the shift. With
+        deconvolution, the transform is divided by the transform of the B-spline.
+
+        The weights are returned as a list with one entry per mesh, together with the
+        coefficient of the mesh in the transform. In two dimensions, the mesh has a single
+        layer along z, on which all particles have unit weight.
+    """
+    pos = np.asarray(snap.particles.position, dtype=float)
+    a = np.array([mode[snap.particles.types[t]] for t in snap.particles.typeid], dtype=float)
+    N = len(a)
+    L = np.array([snap.box.Lx, snap.box.Ly, snap.box.Lz])
+    dimensions = snap.box.dimensions
+    if dimensions == 2:
+        n = (n[0], n[1], 1)
+
+    # the Fourier transform of the assignment function, sinc(k h/2)^P per axis, which
+    # attenuates the self term unless it is deconvolved
+    miller = [np.fft.fftfreq(n[d], 1.0/n[d]) for d in range(3)]
+    transform = [np.sinc(miller[d]/n[d])**order for d in range(3)]
+    W = np.einsum('i,j,k->ijk', *transform)
+    diag = 0.5*np.sum(a**2)/N**2*(np.ones(n) if deconvolve else W**2)
+
+    shifts = (0.0, 0.5) if interlace else (0.0,)
+
+    meshes = []
+    f = np.zeros(n, dtype=complex)
+    for shift in shifts:
+        # phase of the shift, which is real at the Nyquist frequency
+        arg = [np.where(2*np.abs(miller[d]) == n[d], 0.0, 2*np.pi*shift*miller[d]/n[d]) for d in range(3)]
+        coeff = np.exp(-1j*(arg[0][:,None,None] + arg[1][None,:,None] + arg[2][None,None,:]))/len(shifts)
+        if deconvolve:
+            coeff /= W
+
+        w = [assignment_weights(pos[:,d], L[d], n[d], order, shift) for d in range(dimensions)]
+        if dimensions == 2:
+            w.append((np.ones((N,1)), np.zeros((N,1))))
+        rho = np.einsum('p,pi,pj,pk->ijk', a, w[0][0], w[1][0], w[2][0], optimize=True)
+        f += coeff*np.fft.fftn(rho)/N
+        meshes.append((w, coeff))
+
+    return a, meshes, f, diag
+
+def wave_vectors(snap, n):
+    """ Wave vectors of the mesh, in the layout of the numpy FFT
+    """
+    L = np.array([snap.box.Lx, snap.box.Ly, snap.box.Lz])
+    miller = [np.fft.fftfreq(n[d], 1.0/n[d]) for d in range(3)]
+    return np.array(np.meshgrid(*miller, indexing='ij'))*2*np.pi/L[:,None,None,None]
+
+def transform_direct(snap, mode, n):
+    """ Mode amplitudes and normalized Fourier transform of the particle density at the
+        wave vectors of a mesh with n = (nx, ny, nz) points, summed directly over the
+        particles, and the self term of the mode amplitudes
+    """
+    pos = np.asarray(snap.particles.position, dtype=float)
+    a = np.array([mode[snap.particles.types[t]] for t in snap.particles.typeid], dtype=float)
+    N = len(a)
+    if snap.box.dimensions == 2:
+        n = (n[0], n[1], 1)
+
+    k = wave_vectors(snap, n)
+    f = np.zeros(n, dtype=complex)
+    for p in range(N):
+        f += a[p]*np.exp(-1j*np.einsum('d,dijk->ijk', pos[p], k))
+    f /= N
+
+    return a, f, 0.5*np.sum(a**2)/N**2*np.ones(n)
+
+def evaluate_direct(snap, mode, n):
+    """ Collective variable of the mesh order parameter with n = (nx, ny, nz) mesh points,
+        evaluated with the exact transform of the particle density
+    """
+    a, f, diag = transform_direct(snap, mode, n)
+    f2 = np.abs(f)**2
+    cv_k = 0.5*f2*(f2 - 2*diag)
+    cv_k[0,0,0] = 0
+    return np.sum(cv_k)
+
+def evaluate_mesh(snap, mode, n, order=3, interlace=False, deconvolve=False):
+    """ Collective variable and forces of the mesh order parameter with n = (nx, ny, nz)
+        mesh points, for a linear umbrella potential of unit strength
+    """
+    a, meshes, f, diag = transform_mesh(snap, mode, n, order, interlace, deconvolve)
+    N = len(a)
+
+    # CV = 1/2 sum_k |f|^4 - 2 diag |f|^2, without the DC bin
+    f2 = np.abs(f)**2
+    cv_k = 0.5*f2*(f2 - 2*diag)
+    cv_k[0,0,0] = 0
+    cv = np.sum(cv_k)
+
+    # the derivative of the CV with respect to the conjugate mode, transformed back
+    G = f*(f2 - diag)
+    G[0,0,0] = 0
+
+    forces = np.zeros((N,3))
+    for w, coeff in meshes:
+        phi = np.real(np.fft.ifftn(np.conj(coeff)*G))*f.size
+        for d in range(3):
+            wd = [w[e][1] if e == d else w[e][0] for e in range(3)]
+            forces[:,d] -= 2.0/N*a*np.einsum('ijk,pi,pj,pk->p', phi, wd[0], wd[1], wd[2], optimize=True)
+
+    return cv, forces
+
+def evaluate_virial(snap, mode, n, dK, order=3, interlace=False, deconvolve=False):
+    """ Virial of the mesh order parameter with the convolution kernel derivative dK(|k|),
+        for a linear umbrella potential of unit strength, as (xx, xy, xz, yy, yz, zz)
+    """
+    a, meshes, f, diag = transform_mesh(snap, mode, n, order, interlace, deconvolve)
+    N = len(a)
+
+    k = wave_vectors(snap, f.shape)
+    knorm = np.sqrt(np.sum(k**2, axis=0))
+    knorm[0,0,0] = 1
+
+    rhog = np.abs(f)**4/N**2*dK(knorm)/(2*knorm)
+    rhog[0,0,0] = 0
+
+    return np.array([np.sum(rhog*k[i]*k[j]) for i, j in [(0,0), (0,1), (0,2), (1,1), (1,2), (2,2)]])
@@ -0,0 +1,66 @@
+# The lamellar order parameter and its forces must match a direct numpy evaluation
+#   s = 1/N sum_k sum_j a_j cos(q_k.r_j),  F_j = 2 bias/N sum_k a_j q_k sin(q_k.r_j)
+# for one and for several host threads, also after the configuration has changed.
+# The mesh evaluation of order 7 on a 32^3 mesh agrees up to a small aliasing error
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+L = 10.0
+lattice_vectors = [(2,0,0), (0,3,0), (1,1,1), (-1,2,0), (0,-1,3)]
+q = 2*np.pi/L*np.array(lattice_vectors, dtype=float)
+
+mode = {'A': 1.0, 'B': -0.5}
+
+def reference(snap):
+    pos = np.asarray(snap.particles.position, dtype=float)
+    a = np.array([mode[snap.particles.types[t]] for t in snap.particles.typeid])
+    phase = pos.dot(q.T)
+    cv = np.sum(a[:,None]*np.cos(phase))/len(a)
+    forces = 2.0/len(a)*a[:,None]*np.sin(phase).dot(q)
+    return cv, forces
+
+system = init.read_snapshot(mesh_reference.lamellar_snapshot(L=L))
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+lamellar = []
+for num_threads in (1, 4):
+    l = metadynamics.cv.lamellar(mode=mode, lattice_vectors=lattice_vectors, name='t%d' % num_threads)
+    l.set_params(num_threads=num_threads, umbrella='linear', scale=1.0)
+    lamellar.append(l)
+
+lamellar_mesh = metadynamics.cv.lamellar(mode=mode, lattice_vectors=lattice_vectors, name='mesh', mesh=32)
+lamellar_mesh.set_params(order=7, umbrella='linear', scale=1.0)
+
+mesh_reference.integrate_in_place()
+
+for seed in (123, 124):
+    snap = mesh_reference.lamellar_snapshot(L=L, seed=seed)
+    system.restore_snapshot(snap)
+    run(1)
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = reference(snap)
+
+    for l in lamellar:
+        cv = l.cpp_force.getCurrentValue(get_step())
+        forces = np.array([l.forces[i].force for i in range(N)])
+
+        if comm.get_rank() == 0:
+            np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+            np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
+
+    cv = lamellar_mesh.cpp_force.getCurrentValue(get_step())
+    forces = np.array([lamellar_mesh.forces[i].force for i in range(N)])
+
+    if comm.get_rank() == 0:
+        np.testing.assert_allclose(cv, cv_ref, rtol=1e-5, atol=1e-6)
+        np.testing.assert_allclose(forces, forces_ref, rtol=1e-4, atol=1e-4*np.max(np.abs(forces_ref)))
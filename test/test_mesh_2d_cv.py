@@ -0,0 +1,44 @@
+# In two dimensions, the mesh order parameter uses a single mesh layer along z, also
+# when nz is given explicitly. The collective variable and the forces must match the
+# numpy evaluation on that layer, and the forces must stay in the plane
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot(N=1000, dimensions=2)
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+# the default number of layers, and an explicit one that is overridden
+settings = [(3, False, None), (5, False, None), (7, False, None), (5, True, None), (3, False, 16)]
+
+meshes = []
+for i, (order, interlace, nz) in enumerate(settings):
+    m = metadynamics.cv.mesh(mode=mode, nx=32, ny=24, nz=nz, name='m%d' % i)
+    m.set_params(order=order, interlace=interlace, umbrella='linear', scale=1.0)
+    meshes.append((m, order, interlace))
+
+mesh_reference.integrate_in_place()
+run(1)
+
+for m, order, interlace in meshes:
+    cv = m.cpp_force.getCurrentValue(get_step())
+    forces = np.array([m.forces[i].force for i in range(N)])
+
+    assert np.max(np.abs(forces[:,:2])) > 0
+    np.testing.assert_array_equal(forces[:,2], 0)
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, (32, 24, 1), order, interlace)
+        np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+        np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
@@ -0,0 +1,68 @@
+# When the box changes, the mesh order parameter rescales its wave vectors instead of
+# setting up the mesh again. The collective variable and the forces must match the
+# numpy evaluation in every box, and the logged wave vector of the lamellar peak,
+# with two periods along x, must follow the box length. The virial of a tabulated
+# kernel, which is cached per wave vector, must follow changes of the box and the kernel
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+system = init.read_snapshot(mesh_reference.lamellar_snapshot())
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+mesh = metadynamics.cv.mesh(mode=mode, nx=16)
+mesh.set_params(umbrella='linear', scale=1.0, use_table=True)
+
+# a linear kernel, which the table interpolates exactly
+def kernel(k, kmin, kmax, slope):
+    return (1.0 + slope*k, slope)
+
+pressure = ['pressure_xx', 'pressure_xy', 'pressure_xz', 'pressure_yy', 'pressure_yz', 'pressure_zz']
+log = analyze.log(quantities=['qx_max', 'qy_max', 'qz_max'] + pressure, period=1, filename=None)
+
+mesh_reference.integrate_in_place()
+
+# the boxes grow, so that the particles stay inside
+states = [(None, 0.3),
+          (data.boxdim(Lx=11.0, Ly=10.5, Lz=12.0), 0.3),
+          (None, 0.6),
+          (data.boxdim(Lx=12.0, Ly=12.0, Lz=11.0), 0.6)]
+
+current_slope = None
+for box, slope in states:
+    if box is not None:
+        system.box = box
+    if slope != current_slope:
+        mesh.set_kernel(kernel, kmin=0.0, kmax=20.0, width=101, coeff=dict(slope=slope))
+        current_slope = slope
+    run(1)
+
+    snap = system.take_snapshot()
+    cv = mesh.cpp_force.getCurrentValue(get_step())
+    forces = np.array([mesh.forces[i].force for i in range(N)])
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, (16, 16, 16))
+        np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+        np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
+
+    q_max = [log.query(q) for q in ['qx_max', 'qy_max', 'qz_max']]
+    np.testing.assert_allclose(np.abs(q_max), [4*np.pi/system.box.Lx, 0, 0], rtol=1e-5, atol=1e-6)
+
+    # the particles are at rest, so the pressure is the virial over the volume. The
+    # products of the wave vector components are ambiguous at the Nyquist frequency,
+    # which leaves small differences in the off-diagonal components
+    virial = np.array([log.query(p) for p in pressure])*system.box.get_volume()
+    if comm.get_rank() == 0:
+        virial_ref = mesh_reference.evaluate_virial(snap, mode, (16, 16, 16), lambda k: slope*np.ones_like(k))
+        np.testing.assert_allclose(virial, virial_ref, rtol=1e-5, atol=1e-4*np.max(np.abs(virial_ref)))
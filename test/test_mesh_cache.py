@@ -0,0 +1,85 @@
+# The mesh order parameter stores the influence function and the wave vectors in a
+# cache file, which a later mesh with the same mesh, box and kernel reads instead of
+# computing them, and which a mesh with a different setup rewrites. Either way, the
+# collective variable, the forces and the virial must not change
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+import os
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot()
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+slope = 0.3
+
+# with several ranks, every rank has its own file
+cache = 'mesh_influence.bin'
+fname = cache if comm.get_num_ranks() == 1 else cache + '.%d' % comm.get_rank()
+if os.path.exists(fname):
+    os.remove(fname)
+
+def kernel(k, kmin, kmax, slope):
+    return (1.0 + slope*k, slope)
+
+def make_mesh(n, name):
+    m = metadynamics.cv.mesh(mode=mode, nx=n, name=name, influence_cache=cache)
+    m.set_params(umbrella='linear', scale=1.0, use_table=True)
+    m.set_kernel(kernel, kmin=0.0, kmax=20.0, width=101, coeff=dict(slope=slope))
+    return m
+
+pressure = ['pressure_xx', 'pressure_xy', 'pressure_xz', 'pressure_yy', 'pressure_yz', 'pressure_zz']
+log = analyze.log(quantities=pressure, period=1, filename=None)
+
+mesh_reference.integrate_in_place()
+
+# the particles are at rest, so the pressure of the only enabled mesh is its virial over the volume
+def evaluate(m):
+    cv = m.cpp_force.getCurrentValue(get_step())
+    forces = np.array([m.forces[i].force for i in range(N)])
+    virial = np.array([log.query(p) for p in pressure])*system.box.get_volume()
+    return cv, forces, virial
+
+# the first mesh writes the cache
+first = make_mesh(16, 'first')
+run(1)
+cv, forces, virial = evaluate(first)
+assert os.path.exists(fname)
+
+# the second one reads it, so the file is not touched
+os.utime(fname, (0, 0))
+first.disable()
+second = make_mesh(16, 'second')
+run(1)
+assert os.stat(fname).st_mtime == 0
+
+cv_cached, forces_cached, virial_cached = evaluate(second)
+np.testing.assert_allclose(cv_cached, cv, rtol=1e-12)
+np.testing.assert_allclose(forces_cached, forces, rtol=1e-12, atol=1e-12*np.max(np.abs(forces)))
+np.testing.assert_allclose(virial_cached, virial, rtol=1e-12, atol=1e-12*np.max(np.abs(virial)))
+
+# a different mesh does not match the key, and rewrites the file
+second.disable()
+third = make_mesh(12, 'third')
+run(1)
+assert os.stat(fname).st_mtime > 0
+
+cv, forces, virial = evaluate(third)
+if comm.get_rank() == 0:
+    cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, (12, 12, 12))
+    np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+    np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
+
+    # the products of the wave vector components are ambiguous at the Nyquist frequency,
+    # which leaves small differences in the off-diagonal components
+    virial_ref = mesh_reference.evaluate_virial(snap, mode, (12, 12, 12), lambda k: slope*np.ones_like(k))
+    np.testing.assert_allclose(virial, virial_ref, rtol=1e-5, atol=1e-4*np.max(np.abs(virial_ref)))
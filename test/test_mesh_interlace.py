@@ -0,0 +1,45 @@
+# With interlacing, the mesh order parameter averages the transform of the density
+# with that on a mesh shifted by half a cell, multiplied by the phase of the shift,
+# and interpolates the forces from both meshes. For every assignment order and for
+# even and odd numbers of mesh points, where the phase at the Nyquist frequency is
+# handled differently, the collective variable and the forces must match the numpy
+# evaluation with the same interlaced meshes
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot(N=4000)
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+orders = range(2, 8)
+shapes = [(16, 16, 16), (15, 16, 14)]
+
+meshes = []
+for order in orders:
+    for i, (nx, ny, nz) in enumerate(shapes):
+        m = metadynamics.cv.mesh(mode=mode, nx=nx, ny=ny, nz=nz, name='interlace%d_%d' % (order, i))
+        m.set_params(order=order, interlace=True, umbrella='linear', scale=1.0)
+        meshes.append((m, order, (nx, ny, nz)))
+
+mesh_reference.integrate_in_place()
+run(1)
+
+for m, order, n in meshes:
+    cv = m.cpp_force.getCurrentValue(get_step())
+    forces = np.array([m.forces[i].force for i in range(N)])
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, n, order, interlace=True)
+        np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+        np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
@@ -0,0 +1,51 @@
+# Run with several MPI ranks. With domain decomposition, the mesh order parameter
+# sends the ghost cells of the density mesh while it assigns the particles away from
+# the ghost layer, and transforms the mesh with the distributed FFT or on the root
+# rank. With both FFTs, the collective variable and the forces must match the numpy
+# evaluation, also after the particles have been redistributed over the ranks
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+system = init.read_snapshot(mesh_reference.lamellar_snapshot(N=4000))
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+# default assignment, and a wider stencil with interlacing, which reaches one cell further
+params = [dict(order=3, interlace=False), dict(order=5, interlace=True)]
+
+meshes = []
+for i, p in enumerate(params):
+    meshes.append([])
+    for method in ('dfft', 'gather'):
+        m = metadynamics.cv.mesh(mode=mode, nx=32, name='%s%d' % (method, i))
+        m.set_params(distributed_fft=method, umbrella='linear', scale=1.0, **p)
+        meshes[i].append(m)
+
+mesh_reference.integrate_in_place()
+
+for seed in (123, 124):
+    snap = mesh_reference.lamellar_snapshot(N=4000, seed=seed)
+    system.restore_snapshot(snap)
+    run(1)
+
+    for p, methods in zip(params, meshes):
+        if comm.get_rank() == 0:
+            cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, (32, 32, 32), **p)
+
+        for m in methods:
+            cv = m.cpp_force.getCurrentValue(get_step())
+            forces = np.array([m.forces[i].force for i in range(N)])
+
+            if comm.get_rank() == 0:
+                np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+                np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
@@ -0,0 +1,49 @@
+# Every channel of mesh_multi must give the same collective variable and forces as a
+# standalone mesh order parameter with the same mode coefficients, although the
+# channels share the density assignment and two channels share one complex FFT.
+# The third type C is not part of the lamellar profile
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot(particle_types=['A','B','C'])
+if comm.get_rank() == 0:
+    rng = np.random.RandomState(42)
+    snap.particles.typeid[rng.uniform(size=snap.particles.N) < 0.2] = 2
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+modes = [{'A': 1.0, 'B': -1.0, 'C': 0.0},
+         {'A': 0.5, 'B': 0.5, 'C': -1.0},
+         {'A': 1.0, 'B': 0.0, 'C': -0.5}]
+
+multi = metadynamics.cv.mesh_multi(modes=modes, nx=16, name='multi')
+for c in multi.channels:
+    c.set_params(umbrella='linear', scale=1.0)
+
+single = []
+for i, mode in enumerate(modes):
+    m = metadynamics.cv.mesh(mode=mode, nx=16, name='single_%d' % i)
+    m.set_params(umbrella='linear', scale=1.0)
+    single.append(m)
+
+mesh_reference.integrate_in_place()
+run(1)
+
+for channel, m in zip(multi.channels, single):
+    cv_channel = channel.cpp_force.getCurrentValue(get_step())
+    cv_single = m.cpp_force.getCurrentValue(get_step())
+    np.testing.assert_allclose(cv_channel, cv_single, rtol=1e-5)
+
+    f_channel = np.array([channel.forces[i].force for i in range(N)])
+    f_single = np.array([m.forces[i].force for i in range(N)])
+    np.testing.assert_allclose(f_channel, f_single, rtol=1e-5, atol=1e-5*np.max(np.abs(f_single)))
+    assert np.max(np.abs(f_single)) > 0
@@ -0,0 +1,60 @@
+# The mesh order parameter assigns the density with B-splines of orders 2 to 7, and
+# interpolates the forces with the same splines. For every order and for even and odd
+# numbers of mesh points, with and without deconvolution of the assignment function,
+# the collective variable and the forces must match the numpy evaluation with the same
+# assignment. With deconvolution, the collective variable must also approach the
+# direct sum over the particles, which the attenuated modes of the mesh miss
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot(N=4000)
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+orders = range(2, 8)
+shapes = [(16, 16, 16), (15, 16, 14)]
+
+meshes = []
+for order in orders:
+    for i, (nx, ny, nz) in enumerate(shapes):
+        for deconvolve in (False, True):
+            m = metadynamics.cv.mesh(mode=mode, nx=nx, ny=ny, nz=nz, name='order%d_%d_%d' % (order, i, deconvolve))
+            m.set_params(order=order, deconvolve=deconvolve, umbrella='linear', scale=1.0)
+            meshes.append((m, order, (nx, ny, nz), deconvolve))
+
+mesh_reference.integrate_in_place()
+run(1)
+
+# relative deviation from the direct sum, per shape, order and deconvolution
+error = {}
+
+for m, order, n, deconvolve in meshes:
+    cv = m.cpp_force.getCurrentValue(get_step())
+    forces = np.array([m.forces[i].force for i in range(N)])
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, n, order, deconvolve=deconvolve)
+        np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+        np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
+
+        if n not in error:
+            error[n] = {}
+        error[n][order, deconvolve] = cv/mesh_reference.evaluate_direct(snap, mode, n) - 1
+
+if comm.get_rank() == 0:
+    for n in shapes:
+        for order in orders:
+            assert abs(error[n][order, True]) < 1e-2
+            assert abs(error[n][order, False]) > 0.1
+        assert abs(error[n][orders[-1], True]) < 0.5*abs(error[n][orders[0], True])
@@ -0,0 +1,76 @@
+# The mesh order parameter tracks the highest peaks of the structure factor. A
+# composition modulated strongly along x and weakly along y must give the x modulation
+# as the first and the y modulation as the second peak, each counted once although the
+# conjugate wave vector has the same amplitude. The structure factor of the peaks and
+# its average over the shells around them must match the numpy transform of the density
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+N = 4000
+L = 10.0
+nx, ny = 4, 3
+
+snap = data.make_snapshot(N=N, box=data.boxdim(L=L), particle_types=['A','B'])
+if comm.get_rank() == 0:
+    rng = np.random.RandomState(123)
+    pos = rng.uniform(-L/2, L/2, size=(N,3))
+    snap.particles.position[:] = pos
+    p = 0.5 + 0.35*np.sin(2*np.pi*nx*pos[:,0]/L) + 0.15*np.sin(2*np.pi*ny*pos[:,1]/L)
+    snap.particles.typeid[:] = rng.uniform(size=N) >= p
+init.read_snapshot(snap)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+shell = 0.1
+
+mesh = metadynamics.cv.mesh(mode=mode, nx=32)
+mesh.set_params(num_peaks=2, peak_shell=shell)
+
+names = ['q_max', 'qx_max', 'qy_max', 'qz_max', 'sq_max', 'sq_shell']
+quantities = ['qx_max', 'qy_max', 'qz_max', 'sq_max']
+for i in range(2):
+    quantities += [q + '_%d' % i for q in names]
+log = analyze.log(quantities=quantities, period=1, filename=None)
+
+mesh_reference.integrate_in_place()
+run(1)
+
+peaks = [dict((q, log.query(q + '_%d' % i)) for q in names) for i in range(2)]
+
+# the peaks are sorted by decreasing amplitude
+assert peaks[0]['sq_max'] > peaks[1]['sq_max'] > 0
+
+# the modulation along x, and the one along y
+np.testing.assert_allclose(abs(peaks[0]['qx_max']), 2*np.pi*nx/L, rtol=1e-5)
+np.testing.assert_allclose(abs(peaks[1]['qy_max']), 2*np.pi*ny/L, rtol=1e-5)
+np.testing.assert_allclose([peaks[0]['qy_max'], peaks[0]['qz_max'], peaks[1]['qx_max'], peaks[1]['qz_max']], 0, atol=1e-6)
+np.testing.assert_allclose([peaks[0]['q_max'], peaks[1]['q_max']], [2*np.pi*nx/L, 2*np.pi*ny/L], rtol=1e-5)
+
+# the highest peak is also logged without index
+np.testing.assert_allclose([log.query(q) for q in ['qx_max', 'qy_max', 'qz_max', 'sq_max']],
+                           [peaks[0][q] for q in ['qx_max', 'qy_max', 'qz_max', 'sq_max']])
+
+if comm.get_rank() == 0:
+    a, meshes, f, diag = mesh_reference.transform_mesh(snap, mode, (32, 32, 32))
+    k = mesh_reference.wave_vectors(snap, f.shape)
+    knorm = np.sqrt(np.sum(k**2, axis=0))
+    sq = N*np.abs(f)**2
+
+    for p in peaks:
+        q = np.array([p['qx_max'], p['qy_max'], p['qz_max']])
+        peak = np.all(np.abs(k - q[:,None,None,None]) < 1e-4, axis=0)
+        np.testing.assert_allclose(p['sq_max'], sq[peak], rtol=1e-5)
+
+        # the shell also contains the equivalent wave vectors along the other axes
+        in_shell = np.abs(knorm - p['q_max']) <= 0.5*shell
+        in_shell[0,0,0] = False
+        np.testing.assert_allclose(p['sq_shell'], np.mean(sq[in_shell]), rtol=1e-5)
+        assert 0 < p['sq_shell'] < p['sq_max']
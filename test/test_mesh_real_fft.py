@@ -0,0 +1,42 @@
+# With an even number of mesh points along x, the mesh order parameter transforms the
+# density with a real-to-complex FFT and only visits half of the spectrum, weighting
+# every wave vector by its conjugate partner. With an odd number it falls back to the
+# complex FFT. Both must match a numpy evaluation on the full spectrum
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot()
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -0.5}
+
+# even and odd numbers of mesh points along x, and unequal axes
+shapes = [(16, 16, 16), (16, 12, 8), (15, 16, 14)]
+
+meshes = []
+for i, (nx, ny, nz) in enumerate(shapes):
+    m = metadynamics.cv.mesh(mode=mode, nx=nx, ny=ny, nz=nz, name='m%d' % i)
+    m.set_params(umbrella='linear', scale=1.0)
+    meshes.append(m)
+
+mesh_reference.integrate_in_place()
+run(1)
+
+for m, n in zip(meshes, shapes):
+    cv = m.cpp_force.getCurrentValue(get_step())
+    forces = np.array([m.forces[i].force for i in range(N)])
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, n)
+        np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+        np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
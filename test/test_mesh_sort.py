@@ -0,0 +1,44 @@
+# With a sort period, the mesh order parameter visits the particles in the order of
+# their mesh cells, which is only recomputed every sort_period mesh updates. Whether
+# the order is fresh or stale, it must not change the collective variable and the
+# forces, which must match the numpy evaluation for a sequence of configurations
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+system = init.read_snapshot(mesh_reference.lamellar_snapshot())
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+meshes = []
+for sort_period in (0, 1, 2):
+    m = metadynamics.cv.mesh(mode=mode, nx=16, name='s%d' % sort_period)
+    m.set_params(sort_period=sort_period, umbrella='linear', scale=1.0)
+    meshes.append(m)
+
+mesh_reference.integrate_in_place()
+
+for seed in (123, 124, 125):
+    snap = mesh_reference.lamellar_snapshot(seed=seed)
+    system.restore_snapshot(snap)
+    run(1)
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, (16, 16, 16))
+
+    for m in meshes:
+        cv = m.cpp_force.getCurrentValue(get_step())
+        forces = np.array([m.forces[i].force for i in range(N)])
+
+        if comm.get_rank() == 0:
+            np.testing.assert_allclose(cv, cv_ref, rtol=1e-5)
+            np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
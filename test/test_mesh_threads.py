@@ -0,0 +1,44 @@
+# The assignment, the k-space loops and the force interpolation of the mesh order
+# parameter run on several host threads. Serial and threaded evaluations must agree up
+# to the rounding errors of the per-thread reductions, and match the numpy evaluation,
+# also when the configuration changes. Requires the plugin to be compiled with OpenMP
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+system = init.read_snapshot(mesh_reference.lamellar_snapshot())
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+meshes = []
+for num_threads in (1, 4):
+    m = metadynamics.cv.mesh(mode=mode, nx=16, name='t%d' % num_threads)
+    m.set_params(num_threads=num_threads, umbrella='linear', scale=1.0)
+    meshes.append(m)
+
+mesh_reference.integrate_in_place()
+
+for seed in (123, 124):
+    snap = mesh_reference.lamellar_snapshot(seed=seed)
+    system.restore_snapshot(snap)
+    run(1)
+
+    cv = [m.cpp_force.getCurrentValue(get_step()) for m in meshes]
+    forces = [np.array([m.forces[i].force for i in range(N)]) for m in meshes]
+
+    np.testing.assert_allclose(cv[1], cv[0], rtol=1e-5)
+    np.testing.assert_allclose(forces[1], forces[0], rtol=1e-5, atol=1e-5*np.max(np.abs(forces[0])))
+
+    if comm.get_rank() == 0:
+        cv_ref, forces_ref = mesh_reference.evaluate_mesh(snap, mode, (16, 16, 16))
+        np.testing.assert_allclose(cv[0], cv_ref, rtol=1e-5)
+        np.testing.assert_allclose(forces[0], forces_ref, rtol=1e-5, atol=1e-5*np.max(np.abs(forces_ref)))
@@ -0,0 +1,43 @@
+# The mesh size tuner compares candidate meshes to the exact value of the collective
+# variable from a direct sum over the particles. The direct sum must match the numpy
+# evaluation, up to the choice of the wave vectors in the Nyquist planes, and the
+# returned mesh must meet the tolerance. Without deconvolution, the attenuation of the
+# modes by the assignment function exceeds the tolerance on every candidate mesh
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot()
+system = init.read_snapshot(snap)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+
+mesh = metadynamics.cv.mesh(mode=mode, nx=12)
+mesh.set_params(order=5, deconvolve=True)
+
+cv_direct = mesh.cpp_force.computeDirectValue(get_step())
+if comm.get_rank() == 0:
+    np.testing.assert_allclose(cv_direct, mesh_reference.evaluate_direct(snap, mode, (12, 12, 12)), rtol=1e-3)
+
+tolerance = 0.005
+nx, ny, nz = metadynamics.tune.mesh_size(mode=mode, tolerance=tolerance, order=5, deconvolve=True,
+    n_max=16, num_candidates=2, num_iters=2)
+
+if comm.get_rank() == 0:
+    cv, forces = mesh_reference.evaluate_mesh(snap, mode, (nx, ny, nz), order=5, deconvolve=True)
+    assert abs(cv/mesh_reference.evaluate_direct(snap, mode, (nx, ny, nz)) - 1) < tolerance
+
+try:
+    metadynamics.tune.mesh_size(mode=mode, tolerance=tolerance, order=5, n_max=16, num_candidates=2, num_iters=2)
+except RuntimeError:
+    pass
+else:
+    raise AssertionError('a mesh without deconvolution met the tolerance')
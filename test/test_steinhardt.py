@@ -0,0 +1,64 @@
+# The Steinhardt order parameter evaluates the spherical harmonics by a Cartesian
+# recurrence. Its Q_l and forces for a distorted simple cubic lattice are pinned
+# to the values of the previous implementation, which evaluated every harmonic
+# from its closed form. Only even l are checked, which are independent of the
+# storage mode of the neighbor list
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+n = 5
+a = 1.1
+L = n*a
+N = n**3
+
+snap = data.make_snapshot(N=N, box=data.boxdim(L=L), particle_types=['A','B'])
+if comm.get_rank() == 0:
+    i = np.arange(N)
+    site = np.array([i % n, (i//n) % n, i//(n*n)]).T
+    pos = (site + 0.5)*a - L/2 + 0.1*np.sin(1.3*i[:,None] + 0.7*np.arange(3)[None,:])
+    snap.particles.position[:] = pos
+    snap.particles.typeid[:] = i % 3 == 2
+init.read_snapshot(snap)
+
+from hoomd import metadynamics
+
+nl = md.nlist.cell()
+
+lmax = 6
+
+# Q_2, Q_4 and Q_6 on their own, and a combination of them with forces
+Ql = []
+for l in (2, 4, 6):
+    Ql_ref = [0.0]*(lmax+1)
+    Ql_ref[l] = 1.0
+    Ql.append(metadynamics.cv.steinhardt(r_cut=1.5, r_on=1.2, lmax=lmax, Ql_ref=Ql_ref, nlist=nl, type='A', name='Q%d' % l))
+
+combined = metadynamics.cv.steinhardt(r_cut=1.5, r_on=1.2, lmax=lmax, Ql_ref=[0.0, 0.0, 1.0, 0.0, 0.5, 0.0, 0.25],
+                                      nlist=nl, type='A', name='combined')
+combined.set_params(umbrella='linear', scale=1.0)
+
+mesh_reference.integrate_in_place()
+run(1)
+
+np.testing.assert_allclose([q.cpp_force.getCurrentValue(get_step()) for q in Ql],
+                           [8.7445401492e-03, 2.1480588481e+00, 3.3281740785e-01], rtol=1e-5)
+np.testing.assert_allclose(combined.cpp_force.getCurrentValue(get_step()), 1.1659783161e+00, rtol=1e-5)
+
+# every 17th particle, type B particles have no force
+forces_ref = np.array([[-6.6619645834e-04, 1.2273504775e-02, 3.7285579119e-02],
+                       [0.0, 0.0, 0.0],
+                       [1.3632830527e-02, 1.3377358833e-02, 1.0048944385e-02],
+                       [2.1964576340e-03, -1.7453928530e-03, -1.2509366710e-02],
+                       [0.0, 0.0, 0.0],
+                       [-2.1661244264e-02, -1.7131522078e-02, -1.2814505384e-02],
+                       [9.4406848643e-03, 1.3458511913e-02, 2.5768151661e-02],
+                       [0.0, 0.0, 0.0]])
+forces = np.array([combined.forces[i].force for i in range(0, N, 17)])
+np.testing.assert_allclose(forces, forces_ref, rtol=1e-5, atol=1e-7)
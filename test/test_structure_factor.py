@@ -0,0 +1,72 @@
+# The structure factor analyzer writes one row per window, with the time step and
+# the average of S(k) over the wave vectors in every shell, in the numpy format and
+# as raw doubles. The shell averages must match those of the numpy transform of the
+# density on the mesh, and with deconvolution of the assignment function, those of
+# the direct sum over the particles
+
+from hoomd import *
+from hoomd import md
+
+import numpy as np
+
+context.initialize()
+
+import mesh_reference
+
+snap = mesh_reference.lamellar_snapshot()
+system = init.read_snapshot(snap)
+N = len(system.particles)
+
+from hoomd import metadynamics
+
+mode = {'A': 1.0, 'B': -1.0}
+mesh = metadynamics.cv.mesh(mode=mode, nx=32)
+mesh_deconvolved = metadynamics.cv.mesh(mode=mode, nx=32, name='deconvolved')
+mesh_deconvolved.set_params(deconvolve=True)
+
+# no shell edge coincides with the length of a wave vector
+L = system.box.Lx
+n_bins = 10
+k_max = 2*np.pi/L*6.1
+sk_numpy = metadynamics.analyze.structure_factor(mesh, filename='sk.npy', n_bins=n_bins, k_max=k_max,
+    period=1, window=2, overwrite=True)
+sk_binary = metadynamics.analyze.structure_factor(mesh, filename='sk.bin', n_bins=n_bins, k_max=k_max,
+    period=1, window=2, format='binary', overwrite=True)
+sk_deconvolved = metadynamics.analyze.structure_factor(mesh_deconvolved, filename='sk_deconvolved.npy',
+    n_bins=n_bins, k_max=k_max, period=1, window=2, overwrite=True)
+
+mesh_reference.integrate_in_place()
+run(4)
+
+if comm.get_rank() == 0:
+    sk = np.load('sk.npy')
+    assert sk.shape == (2, n_bins+1)
+    np.testing.assert_array_equal(sk[:,0], [1, 3])
+    np.testing.assert_array_equal(np.fromfile('sk.bin').reshape(sk.shape), sk)
+
+    # radially averaged structure factor, without the DC bin
+    def shell_average(f):
+        k = mesh_reference.wave_vectors(snap, f.shape)
+        knorm = np.sqrt(np.sum(k**2, axis=0)).flatten()
+        s = (N*np.abs(f)**2).flatten()
+
+        inside = knorm < k_max
+        inside[0] = False
+        shell = (knorm[inside]/(k_max/n_bins)).astype(int)
+        with np.errstate(invalid='ignore'):
+            return np.bincount(shell, s[inside], n_bins)/np.bincount(shell, None, n_bins)
+
+    a, meshes, f, diag = mesh_reference.transform_mesh(snap, mode, (32, 32, 32))
+    ref = shell_average(f)
+
+    # empty shells are NaN
+    for row in sk:
+        np.testing.assert_allclose(row[1:], ref, rtol=1e-5)
+
+    # the attenuation of the mesh grows to 30% in the last shell, while the deconvolved
+    # structure factor is only affected by aliasing
+    a, f, diag = mesh_reference.transform_direct(snap, mode, (32, 32, 32))
+    ref = shell_average(f)
+
+    for row in np.load('sk_deconvolved.npy'):
+        np.testing.assert_allclose(row[1:], ref, rtol=2e-3)